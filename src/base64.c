@@ -15,31 +15,60 @@
 #include "hypermail.h"
 #include "base64.h"
 
+/*
+** The value of each input character: 0-63 for the alphabet, B64_PAD for
+** the '=' that ends the text and B64_SKIP for everything else.
+*/
+
+#define B64_PAD  64
+#define B64_SKIP 65
+
+static unsigned char b64_value[256];
+
+static void b64_init(void)
+{
+    static const char alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int i;
+
+    memset(b64_value, B64_SKIP, sizeof(b64_value));
+    for (i = 0; i < 64; i++)
+	b64_value[(unsigned char)alphabet[i]] = i;
+    b64_value['='] = B64_PAD;
+}
+
 void base64Decode(char *intext, char *out, int *length)
 {
+    const unsigned char *in = (const unsigned char *)intext;
+    unsigned char *o = (unsigned char *)out;
     unsigned char ibuf[4];
-    unsigned char obuf[3];
-    char ignore;
     char endtext = FALSE;
-    char ch;
+    unsigned char v;
     int lindex = 0;
-    *length = 0;
 
+    if (b64_value[0] != B64_SKIP)
+	b64_init();
     memset(ibuf, 0, sizeof(ibuf));
 
-    while (*intext) {
-	ch = *intext;
+    for (;;) {
+	/* whole groups of four, the bulk of any attachment line */
+	if (!endtext && lindex == 0) {
+	    unsigned char a, b, c, d;
+	    while ((a = b64_value[in[0]]) < 64 && (b = b64_value[in[1]]) < 64
+		   && (c = b64_value[in[2]]) < 64
+		   && (d = b64_value[in[3]]) < 64) {
+		o[0] = (a << 2) | (b >> 4);
+		o[1] = (b << 4) | (c >> 2);
+		o[2] = (c << 6) | d;
+		o += 3;
+		in += 4;
+	    }
+	}
+	if (!*in)
+	    break;
 
-	ignore = FALSE;
-	if ((ch >= 'A') && (ch <= 'Z'))
-	    ch = ch - 'A';
-	else if ((ch >= 'a') && (ch <= 'z'))
-	    ch = ch - 'a' + 26;
-	else if ((ch >= '0') && (ch <= '9'))
-	    ch = ch - '0' + 52;
-	else if (ch == '+')
-	    ch = 62;
-	else if (ch == '=') {	/* end of text */
+	v = b64_value[*in++];
+	if (v == B64_PAD) {	/* end of text */
 	    if (endtext)
 		break;
 	    endtext = TRUE;
@@ -47,48 +76,27 @@ void base64Decode(char *intext, char *out, int *length)
 	    if (lindex < 0)
 		lindex = 3;
 	}
-	else if (ch == '/')
-	    ch = 63;
-	else if (endtext)
-	    break;
-	else
-	    ignore = TRUE;
-
-	if (!ignore) {
-	    if (!endtext) {
-		ibuf[lindex] = ch;
-
-		lindex++;
-		lindex &= 3;	/* use bit arithmetic instead of remainder */
-	    }
-	    if ((0 == lindex) || endtext) {
-
-		obuf[0] = (ibuf[0] << 2) | ((ibuf[1] & 0x30) >> 4);
-		obuf[1] =
-		    ((ibuf[1] & 0x0F) << 4) | ((ibuf[2] & 0x3C) >> 2);
-		obuf[2] = ((ibuf[2] & 0x03) << 6) | (ibuf[3] & 0x3F);
+	else if (v == B64_SKIP) {
+	    if (endtext)
+		break;
+	    continue;
+	}
+	else if (!endtext) {
+	    ibuf[lindex] = v;
+	    lindex = (lindex + 1) & 3;
+	}
 
-		switch (lindex) {
-		case 1:
-		    sprintf(out, "%c", obuf[0]);
-		    out++;
-		    (*length)++;
-		    break;
-		case 2:
-		    sprintf(out, "%c%c", obuf[0], obuf[1]);
-		    out += 2;
-		    (*length) += 2;
-		    break;
-		default:
-		    sprintf(out, "%c%c%c", obuf[0], obuf[1], obuf[2]);
-		    out += 3;
-		    (*length) += 3;
-		    break;
-		}
-		memset(ibuf, 0, sizeof(ibuf));
+	if ((0 == lindex) || endtext) {
+	    o[0] = (ibuf[0] << 2) | ((ibuf[1] & 0x30) >> 4);
+	    if (lindex != 1) {
+		o[1] = ((ibuf[1] & 0x0F) << 4) | ((ibuf[2] & 0x3C) >> 2);
+		if (lindex != 2)
+		    o[2] = ((ibuf[2] & 0x03) << 6) | (ibuf[3] & 0x3F);
 	    }
+	    o += (lindex == 1 || lindex == 2) ? lindex : 3;
+	    memset(ibuf, 0, sizeof(ibuf));
 	}
-	intext++;
     }
-    *out = 0;
+    *o = 0;
+    *length = o - (unsigned char *)out;
 }
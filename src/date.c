@@ -24,6 +24,10 @@
 ** but easier to maintain
 */
 
+#ifdef DATE_BENCH
+#define MAIN_FILE
+#endif
+
 #include "hypermail.h"
 #include "setup.h"
 
@@ -37,7 +41,310 @@ extern time_t get_date(const char *, const time_t *);
 static time_t ydhms_tm_diff(int, int, int, int, int, const struct tm *);
 static time_t my_mktime(struct tm *);
 
-time_t convtoyearsecs(char *date)
+/*
+** Broken-down time. glibc's localtime() takes a lock and looks at TZ and
+** the zone file again on every call, and an archive converts the same
+** dates over and over for its pages and indices. So the offset from UTC
+** is looked up once per hour of time and kept, and the calendar date is
+** worked out from it without calling libc at all.
+*/
+
+#define HOUR_CACHE_SIZE 4096
+
+struct hour_zone {
+    time_t hour;		/* floor(t / 3600) this entry is for */
+    long offset;		/* local time minus UTC, in seconds */
+    struct tm tm;		/* the start of the hour, for tm_zone & co */
+    int valid;
+};
+
+static struct hour_zone *hour_cache;
+
+static long floor_div(time_t a, long b)
+{
+    return (long)(a >= 0 ? a / b : -((-a + b - 1) / b));
+}
+
+/* days since 1970-01-01 of a date in the proleptic Gregorian calendar */
+
+static long days_from_civil(long y, int m, int d)
+{
+    long era;
+    long yoe, doy;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+static void civil_from_days(long z, long *y, int *m, int *d)
+{
+    long era, doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+static long tm_secs(const struct tm *tm)
+{
+    return days_from_civil(tm->tm_year + 1900L, tm->tm_mon + 1, tm->tm_mday) * 86400
+	+ tm->tm_hour * 3600L + tm->tm_min * 60 + tm->tm_sec;
+}
+
+static struct tm *libc_tm(time_t t, struct tm *result, int utc)
+{
+#if defined(HAVE_LOCALTIME_R) && defined(HAVE_GMTIME_R)
+    return utc ? gmtime_r(&t, result) : localtime_r(&t, result);
+#else
+    struct tm *tm = utc ? gmtime(&t) : localtime(&t);
+    if (!tm)
+	return NULL;
+    *result = *tm;
+    return result;
+#endif
+}
+
+static struct tm *fill_tm(time_t t, struct tm *result, int utc)
+{
+    struct hour_zone *hz;
+    time_t hour = floor_div(t, 3600);
+    long secs, days, y;
+    int m, d;
+
+    if (!hour_cache) {
+	hour_cache = (struct hour_zone *)emalloc(2 * HOUR_CACHE_SIZE * sizeof(struct hour_zone));
+	memset(hour_cache, 0, 2 * HOUR_CACHE_SIZE * sizeof(struct hour_zone));
+    }
+    hz = hour_cache + (utc ? HOUR_CACHE_SIZE : 0)
+	+ (unsigned long)hour % HOUR_CACHE_SIZE;
+    if (!hz->valid || hz->hour != hour) {
+	struct tm end;
+
+	/* an hour with a change of offset in it goes the slow way */
+	if (!libc_tm(hour * 3600, &hz->tm, utc)
+	    || !libc_tm(hour * 3600 + 3599, &end, utc)
+	    || tm_secs(&hz->tm) - hour * 3600 != tm_secs(&end) - (hour * 3600 + 3599)
+	    || hz->tm.tm_isdst != end.tm_isdst) {
+	    hz->valid = FALSE;
+	    return libc_tm(t, result, utc);
+	}
+	hz->hour = hour;
+	hz->offset = tm_secs(&hz->tm) - hour * 3600;
+	hz->valid = TRUE;
+    }
+
+    secs = (long)t + hz->offset;
+    days = floor_div(secs, 86400);
+    secs -= days * 86400;
+    civil_from_days(days, &y, &m, &d);
+    *result = hz->tm;
+    result->tm_year = y - 1900;
+    result->tm_mon = m - 1;
+    result->tm_mday = d;
+    result->tm_hour = secs / 3600;
+    result->tm_min = secs / 60 % 60;
+    result->tm_sec = secs % 60;
+    result->tm_wday = (int)((days % 7 + 11) % 7);	/* 1970-01-01 was a Thursday */
+    result->tm_yday = days - days_from_civil(y, 1, 1);
+    return result;
+}
+
+/*
+** Like localtime_r(), or gmtime_r() with the gmtime option, which is
+** how the archive shows dates.
+*/
+
+struct tm *datenum_tm(time_t t, struct tm *result)
+{
+    return fill_tm(t, result, set_gmtime);
+}
+
+/*
+** Like localtime_r(), whatever the gmtime option says.
+*/
+
+struct tm *local_tm(time_t t, struct tm *result)
+{
+    return fill_tm(t, result, FALSE);
+}
+
+/*
+** Nearly every Date: header and From_ line is in one of the two forms
+** "Mon, 3 Jan 2005 10:00:00 -0500" (RFC 5322, weekday, seconds and
+** zone optional) or "Mon Jan  3 10:00:00 2005" (asctime). fast_date()
+** reads just those and returns what get_date() would make of them, or
+** -1 for anything else, which then goes through the full grammar.
+** Dates it can't be sure about, like those within two hours of a
+** change of the local UTC offset that mktime() may shift, go there too.
+*/
+
+static int name3(const char *p, const char *names)
+{
+    int i;
+
+    if (!isalpha((unsigned char)p[0]) || !isalpha((unsigned char)p[1])
+	|| !isalpha((unsigned char)p[2]) || isalpha((unsigned char)p[3])
+	|| p[3] == '.')
+	return -1;
+    for (i = 0; names[i]; i += 3)
+	if (names[i] == tolower((unsigned char)p[0])
+	    && names[i + 1] == tolower((unsigned char)p[1])
+	    && names[i + 2] == tolower((unsigned char)p[2]))
+	    return i / 3;
+    return -1;
+}
+
+/* 1 to maxdigits digits, not followed by another one */
+
+static const char *fast_number(const char *p, int maxdigits, int *val)
+{
+    int n = 0;
+
+    *val = 0;
+    while (isdigit((unsigned char)*p)) {
+	if (++n > maxdigits)
+	    return NULL;
+	*val = *val * 10 + (*p++ - '0');
+    }
+    return n ? p : NULL;
+}
+
+static const char *fast_space(const char *p)
+{
+    while (isspace((unsigned char)*p))
+	++p;
+    return p;
+}
+
+/* HH:MM or HH:MM:SS */
+
+static const char *fast_time(const char *p, int *h, int *m, int *sec)
+{
+    if ((p = fast_number(p, 2, h)) == NULL || *p++ != ':'
+	|| (p = fast_number(p, 2, m)) == NULL)
+	return NULL;
+    *sec = 0;
+    if (*p == ':' && (p = fast_number(p + 1, 2, sec)) == NULL)
+	return NULL;
+    return p;
+}
+
+static long local_offset(long t)
+{
+    struct tm tm;
+
+    return tm_secs(local_tm(t, &tm)) - t;
+}
+
+static time_t fast_date(const char *date)
+{
+    static const int mdays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    const char *p = fast_space(date);
+    int year, mon, day, hour, min, sec;
+    int have_zone = FALSE;
+    long zone = 0;		/* minutes west of UTC, like yyTimezone */
+    long wall, t, off;
+
+    if (name3(p, "sunmontuewedthufrisat") >= 0) {
+	p = fast_space(p + 3);
+	if (*p == ',')
+	    p = fast_space(p + 1);
+    }
+    if (isdigit((unsigned char)*p)) {
+	if ((p = fast_number(p, 2, &day)) == NULL)
+	    return -1;
+	p = fast_space(p);
+	if ((mon = name3(p, "janfebmaraprmayjunjulaugsepoctnovdec")) < 0)
+	    return -1;
+	p = fast_space(p + 3);
+	if ((p = fast_number(p, 4, &year)) == NULL || year < 1000)
+	    return -1;
+	p = fast_space(p);
+	if ((p = fast_time(p, &hour, &min, &sec)) == NULL)
+	    return -1;
+	p = fast_space(p);
+	if ((*p == '+' || *p == '-') && isdigit((unsigned char)p[1])) {
+	    int n;
+	    const char *q = fast_number(p + 1, 4, &n);
+	    if (q == NULL || q - p != 5)
+		return -1;
+	    zone = (*p == '-') ? n % 100 + (n / 100) * 60 : -(n % 100 + (n / 100) * 60);
+	    have_zone = TRUE;
+	    p = q;
+	}
+	else if (name3(p, "gmtutc") >= 0 || (tolower((unsigned char)p[0]) == 'u'
+		  && tolower((unsigned char)p[1]) == 't'
+		  && !isalpha((unsigned char)p[2]) && p[2] != '.')) {
+	    have_zone = TRUE;
+	    p += isalpha((unsigned char)p[2]) ? 3 : 2;
+	}
+    }
+    else {
+	if ((mon = name3(p, "janfebmaraprmayjunjulaugsepoctnovdec")) < 0)
+	    return -1;
+	p = fast_space(p + 3);
+	if ((p = fast_number(p, 2, &day)) == NULL)
+	    return -1;
+	p = fast_space(p);
+	if ((p = fast_time(p, &hour, &min, &sec)) == NULL)
+	    return -1;
+	p = fast_space(p);
+	if ((p = fast_number(p, 4, &year)) == NULL || year < 1000)
+	    return -1;
+    }
+
+    /* comments are skipped like the grammar does, an open one runs to the end */
+    for (;;) {
+	p = fast_space(p);
+	if (*p == '(') {
+	    int depth = 0;
+	    do {
+		if (*p == '\0')
+		    break;
+		if (*p == '(')
+		    depth++;
+		else if (*p == ')')
+		    depth--;
+		p++;
+	    } while (depth > 0);
+	}
+	else
+	    break;
+    }
+    if (*p)
+	return -1;
+
+    if (day < 1 || day > mdays[mon]
+	|| (mon == 1 && day == 29
+	    && (year % 4 || (year % 100 == 0 && year % 400)))
+	|| hour > 23 || min > 59 || sec > 59)
+	return -1;
+
+    /* get_date() goes through mktime(), so the local time has to exist */
+    wall = days_from_civil(year, mon + 1, day) * 86400 + hour * 3600L + min * 60 + sec;
+    off = local_offset(wall);
+    t = wall - off;
+    if (local_offset(t) != off) {
+	off = local_offset(t);
+	t = wall - off;
+	if (local_offset(t) != off)
+	    return -1;
+    }
+    if (t == -1 || local_offset(t - 7200) != off || local_offset(t + 7200) != off)
+	return -1;
+    return have_zone ? (time_t)(wall + zone * 60) : (time_t)t;
+}
+
+static time_t grammar_date(char *date)
 {
     time_t yearsecs;
     char *p, *s = date;
@@ -70,18 +377,32 @@ time_t convtoyearsecs(char *date)
     return yearsecs;
 }
 
+time_t convtoyearsecs(char *date)
+{
+    time_t yearsecs;
+
+    if ((yearsecs = fast_date(date)) != -1)
+	return yearsecs;
+    return grammar_date(date);
+}
+
 /* 
-** Gets the local time and returns it formatted.
+** Gets the local time and returns it formatted. The time is taken once,
+** so that every page of a run carries the same generation date.
 */
 
 char *getlocaltime(void)
 {
     static char s[DATESTRLEN + 5];
     time_t tp;
+    struct tm tmbuf;
     struct tm *tmptr;
 
+    if (s[0])
+	return s;
+
     time(&tp);
-    tmptr = (set_gmtime ? gmtime(&tp) : localtime(&tp));
+    tmptr = datenum_tm(tp, &tmbuf);
 
     s[0] = '\0';
 
@@ -118,10 +439,10 @@ char *getlocaltime(void)
 void gettimezone(void)
 {
     time_t tp;
+    struct tm tm;
 
     time(&tp);
-    strftime(timezonestr, TIMEZONELEN, "%Z",
-	     set_gmtime ? gmtime(&tp) : localtime(&tp));
+    strftime(timezonestr, TIMEZONELEN, "%Z", datenum_tm(tp, &tm));
 }
 
 /*
@@ -131,21 +452,22 @@ void gettimezone(void)
 void getthisyear(void)
 {
     time_t tp;
+    struct tm tm;
 
     time(&tp);
-    strftime(thisyear, YEARLEN, "%Y", set_gmtime ? gmtime(&tp) : localtime(&tp));
+    strftime(thisyear, YEARLEN, "%Y", datenum_tm(tp, &tm));
 }
 
 int year_of_datenum(time_t t)
 {
-  struct tm *tptr = (set_gmtime ? gmtime(&t) : localtime(&t));
-  return tptr->tm_year + 1900;
+  struct tm tm;
+  return datenum_tm(t, &tm)->tm_year + 1900;
 }
 
 int month_of_datenum(time_t t)
 {
-  struct tm *tptr = (set_gmtime ? gmtime(&t) : localtime(&t));
-  return tptr->tm_mon;
+  struct tm tm;
+  return datenum_tm(t, &tm)->tm_mon;
 }
 
 /* 
@@ -153,25 +475,72 @@ int month_of_datenum(time_t t)
 ** a date for you. 
 */
 
+/*
+** The same dates get formatted for the article pages and every index,
+** so getdatestr() keeps what it made by date and format. Formats are
+** told apart by their text, as the callers swap set_dateformat around.
+*/
+
+#define DATESTR_CACHE_SIZE 4096
+#define DATESTR_FORMATS 16
+
+struct datestr_entry {
+    time_t t;
+    int format;			/* index into datestr_formats + 1, 0 if unused */
+    char str[DATESTRLEN];
+};
+
+static struct datestr_entry *datestr_cache;
+static char *datestr_formats[DATESTR_FORMATS];
+
+static int datestr_format(const char *fmt)
+{
+    int i;
+
+    for (i = 0; i < DATESTR_FORMATS && datestr_formats[i]; i++)
+	if (!strcmp(datestr_formats[i], fmt))
+	    return i + 1;
+    if (i == DATESTR_FORMATS)
+	return 0;		/* too many, don't cache */
+    datestr_formats[i] = strsav(fmt);
+    return i + 1;
+}
+
 char *getdatestr(time_t yearsecs)
 {
     static char date[DATESTRLEN];
-    struct tm *tmptr = (set_gmtime ? gmtime(&yearsecs) : localtime(&yearsecs));
-
-    if (set_dateformat != NULL) {
-	strftime(date, DATESTRLEN, set_dateformat, tmptr);
+    struct datestr_entry *entry;
+    struct tm tm;
+    const char *fmt;
+    int format;
+
+    if (set_dateformat != NULL)
+	fmt = set_dateformat;
+    else if (set_eurodate)
+	fmt = "%a %d %b %Y - %H:%M:%S %Z";
+    else if (set_isodate)
+	fmt = set_gmtime ? "%Y-%m-%dZ%H:%M:%S" : "%Y-%m-%d %H:%M:%S";
+    else
+	fmt = "%a %b %d %Y - %H:%M:%S %Z";
+
+    if (!datestr_cache) {
+	datestr_cache = (struct datestr_entry *)emalloc(DATESTR_CACHE_SIZE * sizeof(struct datestr_entry));
+	memset(datestr_cache, 0, DATESTR_CACHE_SIZE * sizeof(struct datestr_entry));
     }
-    else {
-	if (set_eurodate)
-	    strftime(date, DATESTRLEN, "%a %d %b %Y - %H:%M:%S %Z", tmptr);
-	else if (set_isodate) {
-	    if (set_gmtime)
-	        strftime(date, DATESTRLEN, "%Y-%m-%dZ%H:%M:%S", tmptr);
-	    else
-	        strftime(date, DATESTRLEN, "%Y-%m-%d %H:%M:%S", tmptr);
-	}
-	else
-	    strftime(date, DATESTRLEN, "%a %b %d %Y - %H:%M:%S %Z", tmptr);
+    format = datestr_format(fmt);
+    entry = datestr_cache
+	+ ((unsigned long)yearsecs * 31 + format) % DATESTR_CACHE_SIZE;
+    if (format && entry->format == format && entry->t == yearsecs) {
+	strcpy(date, entry->str);
+	return date;
+    }
+
+    date[0] = '\0';
+    strftime(date, DATESTRLEN, fmt, datenum_tm(yearsecs, &tm));
+    if (format) {
+	entry->t = yearsecs;
+	entry->format = format;
+	strcpy(entry->str, date);
     }
     return date;
 }
@@ -226,9 +595,10 @@ char *secs_to_iso(time_t t)
      * This buffer will be overwritten by next call to secs_to_iso.
      */
     static char s[15];
+    struct tm tmbuf;
     struct tm *tm;
 
-    tm = gmtime(&t);
+    tm = fill_tm(t, &tmbuf, TRUE);
     sprintf(s, "%4.4d%02.2d%02.2d%02.2d%02.2d%02.2d",
 	    tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 	    tm->tm_hour, tm->tm_min, tm->tm_sec);
@@ -244,9 +614,10 @@ char *secs_to_iso_meta(time_t t)
      * This buffer will be overwritten by next call to secs_to_iso_meta.
      */
     static char s[11];
+    struct tm tmbuf;
     struct tm *tm;
 
-    tm = localtime(&t);
+    tm = local_tm(t, &tmbuf);
     sprintf(s, "%4.4d-%02.2d-%02.2d",
 	    tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday);
     return s;
@@ -374,3 +745,122 @@ static time_t my_mktime(struct tm *tp)
 
     return t0;
 }
+
+#ifdef DATE_BENCH
+
+/*
+** datebench: time the Date: and From_ line parsing on real mailboxes,
+** the fast path against the full grammar, and check that the two agree
+** on every date the fast path takes.
+**
+**   datebench [-r rounds] mailbox ...
+*/
+
+bool set_eurodate;
+bool set_gmtime;
+bool set_isodate;
+char *set_dateformat;
+char *set_indexdateformat;
+
+void *emalloc(int i)
+{
+    void *p = malloc(i);
+
+    if (p == NULL) {
+	fputs("out of memory\n", stderr);
+	exit(1);
+    }
+    return p;
+}
+
+char *strsav(const char *s)
+{
+    char *p = (char *)emalloc(strlen(s) + 1);
+
+    strcpy(p, s);
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    char **dates = NULL;
+    int ndates = 0;
+    int alloc = 0;
+    int rounds = 20;
+    int fast = 0;
+    int mismatch = 0;
+    char line[MAXLINE];
+    clock_t start;
+    double t_fast, t_grammar;
+    volatile time_t sink = 0;
+    int i, r;
+
+    if (argc > 2 && !strcmp(argv[1], "-r")) {
+	rounds = atoi(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2 || rounds < 1) {
+	fputs("usage: datebench [-r rounds] mailbox ...\n", stderr);
+	return 1;
+    }
+    for (i = 1; i < argc; i++) {
+	FILE *fp = fopen(argv[i], "r");
+	if (!fp) {
+	    perror(argv[i]);
+	    return 1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+	    char *d = NULL;
+	    if (!strncasecmp(line, "Date:", 5))
+		d = line + 5;
+	    else if (!strncmp(line, "From ", 5)) {
+		d = strchr(line + 5, ' ');	/* skip the envelope sender */
+	    }
+	    if (!d)
+		continue;
+	    d[strcspn(d, "\n")] = '\0';
+	    if (ndates == alloc) {
+		alloc = alloc ? 2 * alloc : 1024;
+		dates = (char **)realloc(dates, alloc * sizeof(char *));
+	    }
+	    dates[ndates++] = strsav(d);
+	}
+	fclose(fp);
+    }
+    if (!ndates) {
+	fputs("no dates found\n", stderr);
+	return 1;
+    }
+
+    for (i = 0; i < ndates; i++) {
+	time_t t = fast_date(dates[i]);
+	if (t != -1) {
+	    fast++;
+	    if (t != grammar_date(dates[i])) {
+		printf("mismatch: \"%s\": %ld, grammar %ld\n", dates[i],
+		       (long)t, (long)grammar_date(dates[i]));
+		mismatch++;
+	    }
+	}
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < ndates; i++)
+	    sink += convtoyearsecs(dates[i]);
+    t_fast = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < ndates; i++)
+	    sink += grammar_date(dates[i]);
+    t_grammar = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%d dates, %d (%.1f%%) taken by the fast path, %d mismatches\n",
+	   ndates, fast, 100.0 * fast / ndates, mismatch);
+    printf("convtoyearsecs: %.3fs, grammar only: %.3fs (%d rounds)\n",
+	   t_fast, t_grammar, rounds);
+    return mismatch != 0;
+}
+
+#endif
@@ -28,6 +28,8 @@
 #include "setup.h"
 #include "struct.h"
 #include "parse.h"
+#include "hdrindex.h"
+#include "print.h"
 #ifdef HAVE_DIRENT_H
 #ifdef __LCC__
 #include "../lcc/dirent.h"
@@ -161,6 +163,27 @@ void checkdir(char *dir)
     }
 }
 
+/*
+** Rename tmpname over filename. It gets the mode of the file it replaces,
+** or set_filemode if there was none, so a page or index rewritten later
+** keeps any mode it was given since. Returns -1 if the rename failed.
+*/
+
+int replace_file(const char *tmpname, const char *filename)
+{
+    struct stat st;
+    int mode = set_filemode;
+
+    if (stat(filename, &st) == 0)
+	mode = st.st_mode & 07777;
+    if (chmod(tmpname, mode) == -1) {
+	unlink(tmpname);
+	snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, mode);
+	progerr(errmsg);
+    }
+    return rename(tmpname, filename);
+}
+
 char *getfilecontents(char *filename)
 {
     FILE *infile;
@@ -363,7 +386,7 @@ int find_max_msgnum()
 	return -1;
 #ifdef GDBM
     if (set_folder_by_date && set_usegdbm) {
-	return loadoldheadersfromGDBMindex(set_dir, 1) - 1;
+	return loadoldheadersfromGDBMindex(1) - 1;
     }
 #endif
     if (set_msgsperfolder) {
@@ -604,10 +627,13 @@ struct emailsubdir *msg_subdir(int msgnum, time_t date)
 	desc = msgsperfolder_label(fmt, subdir_no);
     }
     else if (set_folder_by_date) {
-	strftime(s, DATESTRLEN - 1, set_folder_by_date, localtime(&date));
+	struct tm tm;
+
+	local_tm(date, &tm);
+	strftime(s, DATESTRLEN - 1, set_folder_by_date, &tm);
 	if (!fmt)
 	    fmt = set_folder_by_date;
-	strftime(desc_buf, DATESTRLEN, fmt, localtime(&date));
+	strftime(desc_buf, DATESTRLEN, fmt, &tm);
 	desc = strsav(desc_buf);
 
 	if (s[0] && s[strlen(s) - 1] != '/')
@@ -747,13 +773,10 @@ int matches_existing(int msgnum)
 
 #ifdef GDBM
   if (set_usegdbm) {
-      char *indexname;
       GDBM_FILE gp;
       int num;
 
-      trio_asprintf(&indexname, "%s%s", set_dir, GDBM_INDEX_NAME);
-
-      if ((gp = gdbm_open(indexname, 0, GDBM_READER, 0, 0))) {
+      if ((gp = (GDBM_FILE)gdbm_session(FALSE))) {
 
 	/* we _can_ read the index */
 
@@ -801,13 +824,20 @@ int matches_existing(int msgnum)
 	  if (strcmp(msgid, eptr->msgid))
 	      return 0;
 	}
-
-	gdbm_close(gp);
       } /* end case of able to read gdbm index */
-
-      free(indexname);
   }  
 #endif
+  if (HDRINDEX_ENABLED) {
+      struct hdrindex *idx = hdrindex_open(set_dir, find_max_msgnum());
+      if (idx) {
+	  struct hdrindex_entry entry;
+	  int same = 1;
+	  if (hdrindex_get(idx, msgnum, &entry) && entry.str[HDRINDEX_MSGID])
+	      same = !strcmp(entry.str[HDRINDEX_MSGID], eptr->msgid);
+	  hdrindex_close(idx);
+	  return same;
+      }
+  }
   if (!set_usegdbm) {
 	int msgids_are_same;
 	msgids_are_same = parse_old_html(msgnum, eptr, 0, 0, NULL, 1);
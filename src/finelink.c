@@ -59,7 +59,7 @@ static struct body *place_anchor(const String_Match * match_info,
 	    if (*ptr == match_info->start_match) {
 		strcpy(token, last_ptr);
 		*last_ptr = 0;
-		fprintf(fp2, "%s<a name=\"%s\">", buffer, anchor);
+		hm_fprintf(fp2, "%s<a name=\"%s\">", buffer, anchor);
 		strcpy(buffer, token);
 		*ptr = last_ptr0;
 		return bp;
@@ -86,7 +86,7 @@ static struct body *place_anchor(const String_Match * match_info,
 	if (0)
 	    printf("No match found %s; %s", anchor, buffer);
     }
-    fprintf(fp2, "<a name=\"%s\">", anchor);
+    hm_fprintf(fp2, "<a name=\"%s\">", anchor);
     return bp;
 }
 
@@ -103,7 +103,7 @@ static int place_a_end(const String_Match * match_info, struct body **bp, char *
 	if (*ptr == match_info->stop_match) {
 	    strcpy(token, ptr1);
 	    *ptr1 = 0;
-	    fprintf(fp2, "%s</a>%s", buffer, token);
+	    hm_fprintf(fp2, "%s</a>%s", buffer, token);
 	    return TRUE;
 	}
 	last_ptr = ptr1;
@@ -181,7 +181,7 @@ static int add_anchor(int msgnum, int quoting_msgnum, int quote_num, const char
 	        struct emailinfo *ep2;
 		if (hashnumlookup(quoting_msgnum, &ep2)) {
 		    char *path = get_path(ep, ep2);
-					fprintf(fp2, "<a href=\"%s%.4d.%s#qlink%d\">%s</a>", path, quoting_msgnum, set_htmlsuffix, quote_num, set_link_to_replies);
+					hm_fprintf(fp2, "<a href=\"%s%.4d.%s#qlink%d\">%s</a>", path, quoting_msgnum, set_htmlsuffix, quote_num, set_link_to_replies);
 		    if (*path)
 		        free(path);
 		}
@@ -241,14 +241,10 @@ static int add_anchor(int msgnum, int quoting_msgnum, int quote_num, const char
     if (matches != 1)
 	remove(tmpfilename);
     else {
-	if (rename(tmpfilename, filename) == -1) {
+	if (replace_file(tmpfilename, filename) == -1) {
 	    snprintf(errmsg, sizeof(errmsg), "Couldn't rename \"%s\" to %s.", tmpfilename, filename);
 	    progerr(errmsg);
 	}
-	if (chmod(filename, set_filemode) == -1) {
-	    snprintf(errmsg, sizeof(errmsg), "Couldn't chmod \"%s\" to %o.", filename, set_filemode);
-	    progerr(errmsg);
-	}
     }
     free(filename);
     free(tmpfilename);
@@ -409,7 +405,7 @@ int handle_quoted_text(FILE *fp, struct emailinfo *email, const struct body *bp,
     if (strlen(cvtd_line) < 5 && (!replace_quoted || !inquote)) {
 	char *parsed = ConvURLsString(line, email->msgid, email->subject, email->charset);
 	if (parsed) {
-	    fprintf(fp, fmt2, parsed);
+	    hm_fprintf(fp, fmt2, parsed);
 	    free(parsed);
 	}
     }
@@ -430,14 +426,14 @@ int handle_quoted_text(FILE *fp, struct emailinfo *email, const struct body *bp,
 	    tmpline[part2 - line] = 0;
 	}
 	if (set_link_to_replies)
-	    fprintf(fp, "<a name=\"qlink%d\"></a>", quote_num);
+	    hm_fprintf(fp, "<a name=\"qlink%d\"></a>", quote_num);
 	p2 = ConvURLsString(part2, email->msgid, email->subject, email->charset);
 	if (replacing)
-	    fprintf(fp, fmt1, url1, set_quote_link_string, p2 ? p2 : "");
+	    hm_fprintf(fp, fmt1, url1, set_quote_link_string, p2 ? p2 : "");
 	else {
 	    char *tmpptr = convchars(tmpline, email->charset);
 	    if (tmpptr) {
-		fprintf(fp, fmt1, url1, tmpptr, p2 ? p2 : "");
+		hm_fprintf(fp, fmt1, url1, tmpptr, p2 ? p2 : "");
 		free(tmpptr);
 	    }
 	}
@@ -453,7 +449,7 @@ int handle_quoted_text(FILE *fp, struct emailinfo *email, const struct body *bp,
     else if (!replace_quoted || !inquote) {
 	char *parsed = ConvURLsString(bp->line, email->msgid, email->subject, email->charset);
 	if (parsed) {
-	    fprintf(fp, quoting_msgnum >= 0 ? fmt2 : "%s<br>\n", parsed);
+	    hm_fprintf(fp, quoting_msgnum >= 0 ? fmt2 : "%s<br>\n", parsed);
 	    free(parsed);
 	}
     }
@@ -541,7 +537,7 @@ void replace_maybe_replies(const char *filename, struct emailinfo *ep, int new_r
 		char *tmpptr = convchars(ep2->subject, ep2->charset);
 		if (tmpptr) {
 		    char *path = get_path(ep, ep2);
-                    fprintf(fp2,"[ <a href=\"%s%.4d.%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
+                    hm_fprintf(fp2,"[ <a href=\"%s%.4d.%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
 			    path, new_reply_to, set_htmlsuffix, lang[MSG_LTITLE_IN_REPLY_TO], 
 			    ep2->name, tmpptr ? tmpptr : "");
 		    free(tmpptr);
@@ -552,7 +548,7 @@ void replace_maybe_replies(const char *filename, struct emailinfo *ep, int new_r
 	        char *tmpptr = convchars(ep2->subject, ep2->charset);
 		if (tmpptr) {
 		    char *path = get_path(ep, ep2);
-                    fprintf(fp2, "<li><dfn>%s</dfn> " 
+                    hm_fprintf(fp2, "<li><dfn>%s</dfn> " 
 			    "<a href=\"%s%.4d.%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
 			    lang[MSG_IN_REPLY_TO], path, 
 			    new_reply_to, set_htmlsuffix, lang[MSG_LTITLE_IN_REPLY_TO], 
@@ -565,7 +561,7 @@ void replace_maybe_replies(const char *filename, struct emailinfo *ep, int new_r
 		char *tmpptr = convchars(ep2->subject, ep2->charset);
 		if (tmpptr) {
 		    char *path = get_path(ep, ep2);
-                    fprintf(fp2, "<li> <strong>%s:</strong> " "<a href=\"%s%.4d.%s\">%s: \"%s\"</a>\n", lang[MSG_IN_REPLY_TO], path, new_reply_to, set_htmlsuffix, ep2->name, tmpptr ? tmpptr : "");
+                    hm_fprintf(fp2, "<li> <strong>%s:</strong> " "<a href=\"%s%.4d.%s\">%s: \"%s\"</a>\n", lang[MSG_IN_REPLY_TO], path, new_reply_to, set_htmlsuffix, ep2->name, tmpptr ? tmpptr : "");
 		    free(tmpptr);
 		}
 	  }
@@ -618,7 +614,7 @@ void replace_maybe_replies(const char *filename, struct emailinfo *ep, int new_r
     fclose(fp1);
     fclose(fp2);
 
-    if (rename(tmpfilename, filename) == -1) {
+    if (replace_file(tmpfilename, filename) == -1) {
 	snprintf(errmsg, sizeof(errmsg), "Couldn't rename \"%s\" to %s.", tmpfilename, filename);
 	progerr(errmsg);
     }
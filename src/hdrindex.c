@@ -0,0 +1,300 @@
+/*
+** Header index.
+**
+** A binary copy of the per message header comments, kept in the
+** archive directory so that an incremental run can load the old
+** messages without opening and parsing every article page. The file
+** holds one fixed size record per message number followed by a heap of
+** zero terminated strings, and is read with a single mmap(). It is in
+** host byte order and only meant to be read by the hypermail binary
+** that wrote it; anything unexpected just makes the caller fall back to
+** parsing the pages.
+*/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "hypermail.h"
+#include "setup.h"
+#include "struct.h"
+#include "proto.h"
+#include "hdrindex.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define HDRINDEX_MAGIC		"HMHDRIX"
+#define HDRINDEX_VERSION	1
+
+struct hdrindex_head {
+    char magic[8];
+    int version;
+    int recsize;		/* sizeof(struct hdrindex_rec) of the writer */
+    int nrecords;		/* highest message number + 1 */
+    long heapsize;
+};
+
+struct hdrindex_rec {
+    long exp_time;
+    int is_deleted;
+    int present;		/* FALSE for gaps in the numbering */
+    unsigned int str[HDRINDEX_NSTRINGS];	/* heap offsets, 0 for NULL */
+};
+
+struct hdrindex {
+    char *data;
+    size_t size;
+    int mapped;
+    struct hdrindex_rec *recs;
+    int nrecords;
+    char *heap;
+    long heapsize;
+};
+
+static char *hdrindex_name(char *dir)
+{
+    char *name;
+
+    trio_asprintf(&name, (dir[strlen(dir) - 1] == '/') ? "%s%s" : "%s/%s",
+		  dir, HEADER_INDEX_NAME);
+    return name;
+}
+
+/*
+** Open the header index of the archive in dir, if there is one and it
+** describes exactly the messages 0 to max_num. Returns NULL otherwise.
+*/
+
+struct hdrindex *hdrindex_open(char *dir, int max_num)
+{
+    struct hdrindex *idx;
+    struct hdrindex_head *head;
+    struct stat st;
+    char *name;
+    int fd;
+
+    name = hdrindex_name(dir);
+    fd = open(name, O_RDONLY);
+    free(name);
+    if (fd == -1)
+	return NULL;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct hdrindex_head)) {
+	close(fd);
+	return NULL;
+    }
+
+    idx = (struct hdrindex *)emalloc(sizeof(struct hdrindex));
+    memset(idx, 0, sizeof(struct hdrindex));
+    idx->size = (size_t)st.st_size;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+    {
+	void *p = mmap(NULL, idx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED) {
+	    idx->data = (char *)p;
+	    idx->mapped = TRUE;
+	}
+    }
+#endif
+    if (!idx->data) {
+	idx->data = (char *)emalloc(idx->size);
+	if (read(fd, idx->data, idx->size) != (ssize_t)idx->size) {
+	    close(fd);
+	    hdrindex_close(idx);
+	    return NULL;
+	}
+    }
+    close(fd);
+
+    head = (struct hdrindex_head *)idx->data;
+    if (memcmp(head->magic, HDRINDEX_MAGIC, sizeof(head->magic))
+	|| head->version != HDRINDEX_VERSION
+	|| head->recsize != sizeof(struct hdrindex_rec)
+	|| head->nrecords != max_num + 1 || head->nrecords < 0
+	|| head->heapsize < 1
+	|| idx->size != sizeof(struct hdrindex_head)
+	   + (size_t)head->nrecords * sizeof(struct hdrindex_rec)
+	   + (size_t)head->heapsize) {
+	hdrindex_close(idx);
+	return NULL;
+    }
+    idx->nrecords = head->nrecords;
+    idx->recs = (struct hdrindex_rec *)(idx->data + sizeof(struct hdrindex_head));
+    idx->heap = (char *)(idx->recs + idx->nrecords);
+    idx->heapsize = head->heapsize;
+    if (idx->heap[idx->heapsize - 1]) {
+	hdrindex_close(idx);
+	return NULL;
+    }
+    return idx;
+}
+
+/*
+** Fill in *entry for message num. The strings point into the index and
+** stay valid until hdrindex_close(). Returns FALSE if the index has no
+** such message.
+*/
+
+int hdrindex_get(struct hdrindex *idx, int num, struct hdrindex_entry *entry)
+{
+    struct hdrindex_rec *rec;
+    int i;
+
+    if (num < 0 || num >= idx->nrecords)
+	return FALSE;
+    rec = idx->recs + num;
+    if (!rec->present)
+	return FALSE;
+    for (i = 0; i < HDRINDEX_NSTRINGS; i++) {
+	if (rec->str[i] >= (unsigned long)idx->heapsize)
+	    return FALSE;
+	entry->str[i] = rec->str[i] ? idx->heap + rec->str[i] : NULL;
+    }
+    entry->exp_time = rec->exp_time;
+    entry->is_deleted = rec->is_deleted;
+    return TRUE;
+}
+
+void hdrindex_close(struct hdrindex *idx)
+{
+    if (!idx)
+	return;
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+    if (idx->mapped)
+	munmap(idx->data, idx->size);
+    else
+#endif
+	free(idx->data);
+    free(idx);
+}
+
+/*
+** Append s to the string heap and return its offset. Empty strings are
+** stored as NULL (offset 0), like printcomment() leaves them out of the
+** page.
+*/
+
+static unsigned int heap_add(char **heap, long *heaplen, long *heapsize,
+			     const char *s)
+{
+    long len;
+    long off = *heaplen;
+
+    if (!s || !*s)
+	return 0;
+    len = strlen(s) + 1;
+    if (*heaplen + len > *heapsize) {
+	while (*heaplen + len > *heapsize)
+	    *heapsize *= 2;
+	*heap = (char *)erealloc(*heap, *heapsize);
+    }
+    memcpy(*heap + *heaplen, s, len);
+    *heaplen += len;
+    return (unsigned int)off;
+}
+
+/*
+** Write the index for messages 0 to maxnum - 1 as they are in memory
+** now. The new file replaces the old one with a rename(), so a reader
+** never sees a half written index.
+*/
+
+void hdrindex_write(char *dir, int maxnum)
+{
+    struct hdrindex_head head;
+    struct hdrindex_rec *recs;
+    char *heap;
+    long heaplen = 1;		/* offset 0 means NULL */
+    long heapsize = 64 * 1024;
+    char *name;
+    char *tmpname;
+    FILE *fp;
+    int num;
+    int ok;
+
+    if (maxnum <= 0)
+	return;
+    recs = (struct hdrindex_rec *)emalloc(maxnum * sizeof(struct hdrindex_rec));
+    memset(recs, 0, maxnum * sizeof(struct hdrindex_rec));
+    heap = (char *)emalloc(heapsize);
+    heap[0] = '\0';
+
+    for (num = 0; num < maxnum; num++) {
+	struct emailinfo *ep;
+	struct hdrindex_rec *rec = recs + num;
+
+	if (!hashnumlookup(num, &ep))
+	    continue;
+	if (ep->is_deleted) {
+	    /* deleted messages may have had their page removed */
+	    char *filename = articlehtmlfilename(ep);
+	    int exists = isfile(filename);
+	    free(filename);
+	    if (!exists)
+		continue;
+	}
+	rec->present = TRUE;
+	rec->exp_time = ep->exp_time;
+	rec->is_deleted = ep->is_deleted;
+	rec->str[HDRINDEX_FROMDATE] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->fromdatestr);
+	rec->str[HDRINDEX_DATE] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->datestr);
+	rec->str[HDRINDEX_NAME] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->name);
+	rec->str[HDRINDEX_EMAIL] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->emailaddr);
+	rec->str[HDRINDEX_SUBJECT] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->subject);
+	rec->str[HDRINDEX_MSGID] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->msgid);
+	rec->str[HDRINDEX_INREPLY] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->inreplyto);
+	rec->str[HDRINDEX_CHARSET] =
+	    heap_add(&heap, &heaplen, &heapsize, ep->charset);
+	rec->str[HDRINDEX_ISOFROMDATE] =
+	    heap_add(&heap, &heaplen, &heapsize, secs_to_iso(ep->fromdate));
+	rec->str[HDRINDEX_ISODATE] =
+	    heap_add(&heap, &heaplen, &heapsize, secs_to_iso(ep->date));
+	if (heaplen > (long)(unsigned int)-1)
+	    break;		/* offsets no longer fit, don't write one */
+    }
+
+    if (num == maxnum) {
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, HDRINDEX_MAGIC, sizeof(head.magic));
+	head.version = HDRINDEX_VERSION;
+	head.recsize = sizeof(struct hdrindex_rec);
+	head.nrecords = maxnum;
+	head.heapsize = heaplen;
+
+	name = hdrindex_name(dir);
+	trio_asprintf(&tmpname, "%s.tmp", name);
+	if ((fp = fopen(tmpname, "w")) != NULL) {
+	    ok = fwrite(&head, sizeof(head), 1, fp) == 1
+		&& fwrite(recs, sizeof(struct hdrindex_rec), maxnum, fp)
+		   == (size_t)maxnum
+		&& fwrite(heap, 1, heaplen, fp) == (size_t)heaplen;
+	    if (fclose(fp))
+		ok = FALSE;
+	    if (!ok || replace_file(tmpname, name) == -1)
+		unlink(tmpname);
+	}
+	free(tmpname);
+	free(name);
+    }
+    free(heap);
+    free(recs);
+}
+
+/*
+** Remove the index, before the pages it describes get rewritten.
+*/
+
+void hdrindex_remove(char *dir)
+{
+    char *name = hdrindex_name(dir);
+    unlink(name);
+    free(name);
+}
@@ -0,0 +1,34 @@
+/*
+** hdrindex.c functions
+*/
+
+/* the strings of one record, in the order togdbm() stores them */
+#define HDRINDEX_FROMDATE	0
+#define HDRINDEX_DATE		1
+#define HDRINDEX_NAME		2
+#define HDRINDEX_EMAIL		3
+#define HDRINDEX_SUBJECT	4
+#define HDRINDEX_MSGID		5
+#define HDRINDEX_INREPLY	6
+#define HDRINDEX_CHARSET	7
+#define HDRINDEX_ISOFROMDATE	8
+#define HDRINDEX_ISODATE	9
+#define HDRINDEX_NSTRINGS	10
+
+/* the index holds no bodies or reply links, and gdbm has its own */
+#define HDRINDEX_ENABLED (set_headerindex && !set_usegdbm \
+			  && !set_linkquotes && !set_nonsequential)
+
+struct hdrindex_entry {
+    char *str[HDRINDEX_NSTRINGS];	/* NULL where the message had none */
+    long exp_time;
+    int is_deleted;
+};
+
+struct hdrindex;
+
+struct hdrindex *hdrindex_open(char *, int);
+int hdrindex_get(struct hdrindex *, int, struct hdrindex_entry *);
+void hdrindex_close(struct hdrindex *);
+void hdrindex_write(char *, int);
+void hdrindex_remove(char *);
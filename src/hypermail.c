@@ -35,6 +35,8 @@
 #include "finelink.h"
 #include "search.h"
 #include "struct.h"
+#include "hdrindex.h"
+#include "mboxread.h"
 
 #ifdef HAVE_LOCALE_H
 #include <locale.h>
@@ -126,7 +128,7 @@ void usage(void)
 {
     struct language_entry *lte;
 
-    printf("%s: %s [options]\n", lang[MSG_USAGE], PROGNAME);
+    printf("%s: %s [options] [mailbox ...]\n", lang[MSG_USAGE], PROGNAME);
 
     printf("%s:\n", lang[MSG_OPTIONS]);
     printf("  -a URL        : %s\n", lang[MSG_OPTION_A]);
@@ -140,6 +142,7 @@ void usage(void)
     printf("  [ -g            : %s ]\n", lang[MSG_OPTION_G_NOT_BUILD_IN]);
 #endif
     printf("  -i            : %s\n", lang[MSG_OPTION_I]);
+    printf("  -j jobs       : %s\n", "Processes writing the message pages");
     printf("  -l label      : %s\n", lang[MSG_OPTION_L]);
     printf("  -m mbox       : %s\n", lang[MSG_OPTION_M]);
     printf("  -M            : %s\n", "Use metadata");
@@ -198,7 +201,7 @@ int main(int argc, char **argv)
 
     opterr = 0;
 
-#define GETOPT_OPTSTRING ("a:Ab:c:d:gil:L:m:n:o:ps:tTuvVxX0:1M?")
+#define GETOPT_OPTSTRING ("a:Ab:c:d:gij:l:L:m:n:o:ps:tTuvVxX0:1M?")
 
     /* get pre config options here */
 	while ((i = getopt(argc, argv, GETOPT_OPTSTRING)) != -1) {
@@ -217,6 +220,7 @@ int main(int argc, char **argv)
 	case 'd':
 	case 'g':
 	case 'i':
+	case 'j':
 	case 'l':
 	case 'L':
 	case 'm':
@@ -279,6 +283,9 @@ int main(int argc, char **argv)
 	case 'i':
 	    use_stdin = TRUE;
 	    break;
+	case 'j':
+	    set_jobs = atoi(optarg);
+	    break;
 	case 'l':
 	    set_label = strreplace(set_label, optarg);
 	    break;
@@ -416,13 +423,25 @@ int main(int argc, char **argv)
      * the options.h or environment values.
      */
     if (!use_stdin) {
-	if (optind < argc && set_increment == -1 && !set_mbox) {
+	if (optind < argc && !set_mbox) {
+	    /* read them all in this order, numbering on from one to the next */
+	    for (i = optind; i < argc; i++)
+		mboxes = add_2_list(mboxes, argv[i]);
 	    set_mbox = strsav(argv[optind]);
 	}
 	else if (!set_mbox || !strcasecmp(set_mbox, "NONE"))
 	    use_stdin = TRUE;
 	else
 	    use_stdin = FALSE;
+	if (!use_stdin && isdir(set_mbox)) {
+	    /* a Maildir or MH folder, name the archive after its last part */
+	    char *end = set_mbox + strlen(set_mbox);
+
+	    while (end > set_mbox + 1 && end[-1] == '/')
+		*--end = '\0';
+	}
+	if (!use_stdin && !mboxes)
+	    mboxes = add_2_list(mboxes, set_mbox);
     }
     else {
 	if (set_mbox)
@@ -645,12 +664,14 @@ int main(int argc, char **argv)
 		update_deletions(amount_old);
 
 	    if (set_show_msg_links) {
+		patch_begin();
 		fixnextheader(set_dir, amount_old, -1);
 		for (i = amount_old; i <= max_msgnum; ++i) {
 		    if (set_showreplies)
 			fixreplyheader(set_dir, i, 0, amount_old);
 		    fixthreadheader(set_dir, i, amount_old);
 		}
+		patch_flush();
 	    }
 	}
     }
@@ -677,12 +698,17 @@ int main(int argc, char **argv)
 
 	writearticles(0, max_msgnum + 1);
     }
+    /* the message pages are done, their bodies aren't read again */
+    release_bodies(max_msgnum + 1);
+#ifdef GDBM
+    /* nothing reads or stores summaries after the articles are done */
+    gdbm_session_close();
+#endif
 
     if (amount_new) {		/* Always write the index files */
 	if (set_linkquotes) {
 	    threadlist = NULL;
 	    threadlist_end = NULL;
-	    printedthreadlist = NULL;
 	    for (i = 0; i <= max_msgnum; ++i) {
 	        struct emailinfo *ep;
 		if (hashnumlookup(i, &ep)) {
@@ -694,6 +720,7 @@ int main(int argc, char **argv)
 		threadlist_by_msgnum[i] = NULL;
 	    } /* redo threading with more complete info than in 1st pass */
 	    crossindexthread1(datelist);
+	    patch_begin();
 	    for (i = 0; i <= max_msgnum; ++i) {
 	        struct emailinfo *ep, *etmp;
 		hashnumlookup(i, &ep);
@@ -702,8 +729,12 @@ int main(int argc, char **argv)
 		    fixthreadheader(set_dir, etmp->msgnum, amount_new);
 		/* if (ep->flags & THREADING_ALTERED) */
 	    }
+	    patch_flush();
 	}
 	count_deleted(max_msgnum + 1);
+	if (set_folder_by_date || set_msgsperfolder
+	    || set_monthly_index || set_yearly_index)
+	    mark_touched_periods(amount_old);
 	if (show_index[0][DATE_INDEX])
 	    writedates(amount_new, NULL);
 	if (show_index[0][THREAD_INDEX])
@@ -723,6 +754,11 @@ int main(int argc, char **argv)
 	    write_summary_indices(amount_new);
 	if (set_latest_folder)
 	    symlink_latest();
+	if (HDRINDEX_ENABLED)
+	    hdrindex_write(set_dir, max_msgnum + 1);
+	if (set_linkquotes)
+	    replyindex_write(set_dir, max_msgnum + 1);
+	maildir_index_write(set_dir);
     }
     else {
 	printf("No mails to output!\n");
@@ -731,6 +767,15 @@ int main(int argc, char **argv)
     if (set_uselock)
 	unlock_archive();
 
+    if (set_showprogress && (set_filter_out || set_filter_require
+			     || set_filter_out_full_body
+			     || set_filter_require_full_body))
+	filter_report();
+    if (set_showprogress)
+	page_report();
+    if (set_showprogress > 1)
+	arena_report();
+
     if (configfile)
 	free(configfile);
     if (ihtmlheaderfile)
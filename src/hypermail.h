@@ -124,6 +124,9 @@
 #define NOSUBJECT   "(no subject)"
 
 #define GDBM_INDEX_NAME ".hm2index"
+#define HEADER_INDEX_NAME ".hm2hdrindex"
+#define REPLY_INDEX_NAME ".hm2replyindex"
+#define MAILDIR_INDEX_NAME ".hm2maildir"
 
 /* Name of the Hypertext Archive Overview File an XML file
  * which contains pointers to the various index files
@@ -144,7 +147,6 @@
 #define URLSTRLEN    256
 #define HOSTSTRLEN   256
 #define TITLESTRLEN  64
-#define HASHSIZE     673
 
 #define SHORTDATELEN   12
 #define TIMEZONELEN    10
@@ -236,16 +238,12 @@ struct body {
     char attached;		/* part of attachment */
     char demimed;		/* if this is a header, this is set to TRUE if
 				   it has passed the decoderfc2047() function */
+    char inarena;		/* node and line belong to a message arena */
     int format_flowed;          /* TRUE if this a text/plain f=f line */
     int msgnum;
     struct body *next;
 };
 
-struct printed {
-    int msgnum;
-    struct printed *next;
-};
-
 struct hmlist {
     char *val;
     struct hmlist *next;
@@ -268,6 +266,8 @@ struct emailsubdir {	/* used by set_folder_by_date, set_msgsperfolder */
     int count;
     char *description;		/* label to go in folders.html */
     time_t a_date; /* date of msg which first generated this subdir. not guaranteed to be earliest date in subdir */
+    int touched;		/* index pages need rewriting this run */
+    int index;			/* position in folders, for folder_lists */
 };
 
 struct emailinfo {
@@ -287,8 +287,8 @@ struct emailinfo {
     long datenum;		/* moved here from 'struct header' */
     long flags;			/* added 1999-03-19 for the new thread output functions */
 
-#define PRINT_THREAD  1		/* set if already used in the thread output */
 #define USED_THREAD   2		/* set if already stored in threadlist */
+#define DELETION_CHANGED 4	/* set if deleted or expired by this run */
 
     int initial_next_in_thread;	/* msgnum written as next during normal print*/
 
@@ -309,10 +309,18 @@ struct emailinfo {
                             /* that file was rewritten to reflect is_deleted */
 };
 
-struct header {
+struct header {			/* an entry of a struct headerlist */
     struct emailinfo *data;
-    struct header *left;
-    struct header *right;
+    char *key;			/* casefolded name or subject, NULL by date */
+    long datekey;
+    int seq;			/* order of addition, to break ties */
+};
+
+struct headerlist {		/* messages sorted by date, subject or author */
+    struct header *items;
+    int count;
+    int size;
+    int sorted;			/* items[0..sorted-1] are in order */
 };
 
 struct attach {
@@ -349,19 +357,17 @@ struct charset_stack {
     char *charsetsave;
 };
 
-VAR struct header *subjectlist;
-VAR struct header *authorlist;
-VAR struct header *datelist;
+VAR struct headerlist *subjectlist;
+VAR struct headerlist *authorlist;
+VAR struct headerlist *datelist;
 VAR struct hashemail *deletedlist;
 VAR struct reply *replylist;
 VAR struct reply *replylist_end; /* last node in replylist */
 VAR struct reply *threadlist;
 VAR struct reply *threadlist_end; /* last node in threadlist */
 VAR struct reply **threadlist_by_msgnum; /* array of ptrs into threadlist */
-VAR struct printed *printedlist;
-VAR struct printed *printedthreadlist;
-VAR struct hashemail *etable[HASHSIZE];
 VAR struct emailsubdir *folders;
+VAR struct hmlist *mboxes;	/* all mailboxes named on the command line */
 
 VAR struct hmlist *show_headers;
 
@@ -0,0 +1,755 @@
+/*
+** Line reader for mailboxes.
+**
+** Regular files are mmap()ed and walked in place, anything else (stdin,
+** pipes) is read through one large buffer that is refilled with fread()
+** and grown when a single line doesn't fit. Either way the caller gets
+** whole lines, however long, instead of MAXLINE sized fgets() chunks.
+*/
+
+#include "hypermail.h"
+#include "setup.h"
+#include "struct.h"
+#include "parse.h"
+#include "mboxread.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#ifdef __LCC__
+#include "../lcc/dirent.h"
+#include <direct.h>
+#else
+#include <dirent.h>
+#endif
+#else
+#include <sys/dir.h>
+#endif
+
+#define MBOX_BUFSIZE (256 * 1024)
+
+/*
+** Set up reading fp from its current position, mmap()ing it if it is a
+** regular file.
+*/
+
+static void mbox_start(struct mbox_reader *mr, FILE *fp)
+{
+    mr->fp = fp;
+    mr->map = NULL;
+    mr->buf = NULL;
+    mr->start = mr->end = 0;
+    mr->eof = 0;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+    {
+	struct stat st;
+	long offset = ftell(fp);
+
+	if (offset >= 0 && !fstat(fileno(fp), &st) && S_ISREG(st.st_mode)
+	    && st.st_size > offset && (off_t)(size_t)st.st_size == st.st_size) {
+	    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+			   fileno(fp), 0);
+	    if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+		madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+		mr->map = (char *)p;
+		mr->maplen = (size_t)st.st_size;
+		mr->start = (size_t)offset;
+		mr->end = mr->maplen;
+		mr->eof = 1;
+		return;
+	    }
+	}
+    }
+#endif
+
+    mr->bufsize = MBOX_BUFSIZE;
+    mr->buf = (char *)emalloc(mr->bufsize);
+}
+
+/*
+** Undo mbox_start(). For mmap()ed files the stream is positioned after
+** the last line handed out.
+*/
+
+static void mbox_stop(struct mbox_reader *mr)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+    if (mr->map) {
+	munmap(mr->map, mr->maplen);
+	fseek(mr->fp, (long)mr->start, SEEK_SET);
+    }
+#endif
+    if (mr->buf)
+	free(mr->buf);
+    mr->map = mr->buf = NULL;
+}
+
+/*
+** Start reading the mailbox at the current position of fp. The stream
+** is left open, the caller still owns it.
+*/
+
+struct mbox_reader *mbox_open(FILE *fp)
+{
+    struct mbox_reader *mr;
+
+    mr = (struct mbox_reader *)emalloc(sizeof(struct mbox_reader));
+    memset(mr, 0, sizeof(struct mbox_reader));
+    mbox_start(mr, fp);
+    return mr;
+}
+
+static FILE *mbox_fopen(const char *name)
+{
+    FILE *fp = fopen(name, "rb");
+
+    if (!fp) {
+	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".",
+		 lang[MSG_CANNOT_OPEN_MAIL_ARCHIVE], name);
+	progerr(errmsg);
+    }
+    return fp;
+}
+
+/*
+** Maildir and MH folders. Each message is a file of its own, read as if
+** it were a mailbox with one message: it gets a From_ line with its
+** delivery time when it has none. Its other lines are handed out as they
+** are; mbox_bodyline() tells the parser that a "From " line among them
+** does not start a new message. The keys of the message files read are
+** kept in MAILDIR_INDEX_NAME in the archive, so that incremental runs
+** only open the files added since.
+*/
+
+struct mbox_file {
+    char *path;
+    char *key;			/* name in the maildir index, NULL for mailboxes */
+    long order;			/* delivery time, or the MH message number */
+    time_t delivered;
+};
+
+static char **maildir_seen;	/* keys of the maildir index, sorted */
+static int maildir_nseen;
+static char **maildir_read;	/* keys of the message files read this run */
+static int maildir_nread;
+
+static int compare_keys(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    const struct mbox_file *fa = (const struct mbox_file *)a;
+    const struct mbox_file *fb = (const struct mbox_file *)b;
+
+    if (fa->order != fb->order)
+	return fa->order < fb->order ? -1 : 1;
+    return strcmp(fa->key, fb->key);
+}
+
+static char *maildir_index_name(char *dir)
+{
+    char *name;
+
+    trio_asprintf(&name, (dir[strlen(dir) - 1] == '/') ? "%s%s" : "%s/%s",
+		  dir, MAILDIR_INDEX_NAME);
+    return name;
+}
+
+/*
+** Load the keys of the message files the archive in dir was built from.
+*/
+
+static void maildir_index_load(char *dir)
+{
+    char *name = maildir_index_name(dir);
+    FILE *fp = fopen(name, "r");
+    char *line = NULL;
+    size_t linesize = 0;
+    size_t len;
+    struct mbox_reader *mr;
+    int max = 0;
+
+    free(name);
+    if (!fp)
+	return;
+    mr = mbox_open(fp);
+    while (mbox_getline(mr, &line, &linesize, &len)) {
+	if (len && line[len - 1] == '\n')
+	    line[--len] = '\0';
+	if (!len)
+	    continue;
+	if (maildir_nseen == max) {
+	    max = max ? 2 * max : 1024;
+	    maildir_seen = (char **)erealloc(maildir_seen, max * sizeof(char *));
+	}
+	maildir_seen[maildir_nseen++] = strsav(line);
+    }
+    mbox_close(mr);
+    fclose(fp);
+    if (line)
+	free(line);
+    qsort(maildir_seen, maildir_nseen, sizeof(char *), compare_keys);
+}
+
+static int maildir_is_seen(char *key)
+{
+    return maildir_nseen
+	&& bsearch(&key, maildir_seen, maildir_nseen, sizeof(char *),
+		   compare_keys) != NULL;
+}
+
+static int compare_prefix(const void *a, const void *b)
+{
+    const char *prefix = *(char *const *)a;
+
+    return strncmp(prefix, *(char *const *)b, strlen(prefix));
+}
+
+/*
+** Returns TRUE if a key starting with prefix is in the maildir index.
+*/
+
+static int maildir_prefix_seen(char *prefix)
+{
+    return maildir_nseen
+	&& bsearch(&prefix, maildir_seen, maildir_nseen, sizeof(char *),
+		   compare_prefix) != NULL;
+}
+
+/*
+** Add key to those of the message files read this run.
+*/
+
+static void maildir_note_read(char *key)
+{
+    if (maildir_nread % 1024 == 0)
+	maildir_read = (char **)erealloc(maildir_read,
+				       (maildir_nread + 1024) * sizeof(char *));
+    maildir_read[maildir_nread++] = key;
+}
+
+/*
+** Returns TRUE if the Message-ID of the message in file is one of the
+** archive, as loaded with its old headers.
+*/
+
+static int maildir_archived(char *file)
+{
+    FILE *fp = fopen(file, "r");
+    char line[MAXLINE];
+    int found = FALSE;
+
+    if (!fp)
+	return FALSE;
+    while (fgets(line, sizeof(line), fp) && line[0] != '\n'
+	   && strcmp(line, "\r\n")) {
+	if (!strncasecmp(line, "Message-ID:", 11)) {
+	    char *id = getid(line);
+
+	    found = hashlookupbymsgid(id) != NULL;
+	    free(id);
+	    break;
+	}
+    }
+    fclose(fp);
+    return found;
+}
+
+/*
+** Add the messages of one Maildir subdirectory (cur or new), or of an MH
+** folder, to the files of a list. Messages already in the maildir index
+** are left out. A Maildir message is known by the unique part of its
+** name and is skipped without being looked at. An MH message is known
+** by its number in the real path of the folder, with the inode and size
+** of its file added to tell when the file changed: MH reuses the numbers
+** of removed messages, and tools such as anno rewrite a message. A
+** changed file is only read again if its Message-ID is not archived.
+*/
+
+static void maildir_scan(char *folder, char *sub, int mh,
+			 struct mbox_file **files, int *nfiles, int *max)
+{
+    char *path;
+    char *real = NULL;
+    DIR *dir;
+    struct dirent *entry;
+
+    if (sub)
+	trio_asprintf(&path, "%s/%s", folder, sub);
+    else
+	path = strsav(folder);
+    if ((dir = opendir(path)) == NULL) {
+	free(path);
+	return;
+    }
+    if (mh && (real = realpath(folder, NULL)) == NULL)
+	real = strsav(folder);
+    while ((entry = readdir(dir)) != NULL) {
+	char *name = entry->d_name;
+	struct mbox_file *mf;
+	struct stat st;
+	char *file;
+	char *key;
+	char *cp;
+
+	if (name[0] == '.')
+	    continue;
+	if (mh) {
+	    for (cp = name; isdigit((unsigned char)*cp); cp++)
+		;
+	    if (*cp)
+		continue;	/* .mh_sequences and such */
+	    trio_asprintf(&file, "%s/%s", path, name);
+	    if (stat(file, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+		free(file);
+		continue;
+	    }
+	    trio_asprintf(&key, "%s/%s:%lu.%lu", real, name,
+			  (unsigned long)st.st_ino, (unsigned long)st.st_size);
+	    if (maildir_is_seen(key)) {
+		free(file);
+		free(key);
+		continue;
+	    }
+	    trio_asprintf(&cp, "%s/%s:", real, name);
+	    if (maildir_prefix_seen(cp) && maildir_archived(file)) {
+		/* changed in place, only its key is new */
+		maildir_note_read(key);
+		free(cp);
+		free(file);
+		continue;
+	    }
+	    free(cp);
+	}
+	else {
+	    /* the unique part stays when new/ moves to cur/ or flags change */
+	    key = strsav(name);
+	    if ((cp = strchr(key, ':')) != NULL)
+		*cp = '\0';
+	    if (maildir_is_seen(key)) {
+		free(key);
+		continue;
+	    }
+	    trio_asprintf(&file, "%s/%s", path, name);
+	    if (stat(file, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+		free(file);
+		free(key);
+		continue;
+	    }
+	}
+	if (*nfiles == *max) {
+	    *max = *max ? 2 * *max : 256;
+	    *files = (struct mbox_file *)erealloc(*files,
+					*max * sizeof(struct mbox_file));
+	}
+	mf = *files + (*nfiles)++;
+	mf->path = file;
+	mf->key = key;
+	mf->delivered = st.st_mtime;
+	if (!mh && isdigit((unsigned char)name[0]))
+	    mf->delivered = (time_t)atol(name);	/* it starts the name */
+	mf->order = mh ? atol(name) : (long)mf->delivered;
+    }
+    closedir(dir);
+    if (real)
+	free(real);
+    free(path);
+}
+
+/*
+** Expand the mailboxes and folders named in the list into the files to
+** read, in order. Folders are sorted by delivery time for Maildir, by
+** message number for MH.
+*/
+
+static struct mbox_file *mbox_list_files(struct hmlist *names, int *nfiles)
+{
+    struct mbox_file *files = NULL;
+    int max = 0;
+    struct hmlist *name;
+
+    *nfiles = 0;
+    for (name = names; name; name = name->next) {
+	char *folder;
+	char *end;
+	int first = *nfiles;
+
+	if (!isdir(name->val)) {
+	    /* fail before anything is parsed, not halfway through the list */
+	    if (access(name->val, R_OK)) {
+		snprintf(errmsg, sizeof(errmsg), "%s \"%s\".",
+			 lang[MSG_CANNOT_OPEN_MAIL_ARCHIVE], name->val);
+		progerr(errmsg);
+	    }
+	    if (*nfiles == max) {
+		max = max ? 2 * max : 256;
+		files = (struct mbox_file *)erealloc(files,
+					       max * sizeof(struct mbox_file));
+	    }
+	    files[*nfiles].path = strsav(name->val);
+	    files[*nfiles].key = NULL;
+	    files[*nfiles].order = 0;
+	    files[(*nfiles)++].delivered = 0;
+	    continue;
+	}
+
+	folder = strsav(name->val);
+	for (end = folder + strlen(folder); end > folder + 1 && end[-1] == '/';)
+	    *--end = '\0';
+	trio_asprintf(&end, "%s/cur", folder);
+	if (isdir(end)) {
+	    maildir_scan(folder, "cur", 0, &files, nfiles, &max);
+	    maildir_scan(folder, "new", 0, &files, nfiles, &max);
+	}
+	else
+	    maildir_scan(folder, NULL, 1, &files, nfiles, &max);
+	free(end);
+	free(folder);
+	qsort(files + first, *nfiles - first, sizeof(struct mbox_file),
+	      compare_files);
+    }
+    return files;
+}
+
+/*
+** Write the maildir index of the archive in dir: the keys it was read
+** with and those of the message files read since. It is left alone when
+** no new message file was read.
+*/
+
+void maildir_index_write(char *dir)
+{
+    char **keys;
+    int nkeys = 0;
+    char *name;
+    char *tmpname;
+    FILE *fp;
+    int ok;
+    int i;
+
+    if (!maildir_nread)
+	return;
+    keys = (char **)emalloc((maildir_nseen + maildir_nread) * sizeof(char *));
+    memcpy(keys, maildir_seen, maildir_nseen * sizeof(char *));
+    memcpy(keys + maildir_nseen, maildir_read, maildir_nread * sizeof(char *));
+    qsort(keys, maildir_nseen + maildir_nread, sizeof(char *), compare_keys);
+    for (i = 0; i < maildir_nseen + maildir_nread; i++)
+	if (!nkeys || strcmp(keys[nkeys - 1], keys[i]))
+	    keys[nkeys++] = keys[i];
+
+    name = maildir_index_name(dir);
+    trio_asprintf(&tmpname, "%s.tmp", name);
+    if ((fp = fopen(tmpname, "w")) != NULL) {
+	ok = TRUE;
+	for (i = 0; i < nkeys && ok; i++)
+	    ok = fputs(keys[i], fp) != EOF && putc('\n', fp) != EOF;
+	if (fclose(fp))
+	    ok = FALSE;
+	if (!ok || replace_file(tmpname, name) == -1)
+	    unlink(tmpname);
+    }
+    free(tmpname);
+    free(name);
+    free(keys);
+}
+
+/*
+** Open the file after the current one of a list, and ask the kernel to
+** start reading it in while the current one is being parsed.
+*/
+
+static void mbox_read_ahead(struct mbox_reader *mr)
+{
+    if (mr->cur + 1 >= mr->nfiles) {
+	mr->ahead = NULL;
+	return;
+    }
+    mr->ahead = mbox_open(mbox_fopen(mr->files[mr->cur + 1].path));
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(MADV_WILLNEED)
+    if (mr->ahead->map)
+	madvise(mr->ahead->map, mr->ahead->maplen, MADV_WILLNEED);
+#endif
+}
+
+/*
+** Note that the current file of the list is about to be read.
+*/
+
+static void mbox_enter_file(struct mbox_reader *mr)
+{
+    struct mbox_file *mf = mr->files + mr->cur;
+
+    mr->message = mf->key != NULL;
+    mr->first = 1;
+    if (mr->message) {
+	maildir_note_read(mf->key);
+	mf->key = NULL;
+    }
+}
+
+/*
+** Read the mailboxes, Maildir and MH folders of a list one after the
+** other, as if they had been concatenated into one mailbox. The reader
+** opens and closes the files itself. If dir is given, the messages of
+** folders that are in its maildir index are skipped.
+*/
+
+struct mbox_reader *mbox_open_list(struct hmlist *names, char *dir)
+{
+    struct mbox_reader *mr;
+    struct mbox_file *files;
+    int nfiles;
+    int i;
+
+    for (i = 0; i < maildir_nseen; i++)
+	free(maildir_seen[i]);
+    maildir_nseen = 0;
+    for (i = 0; i < maildir_nread; i++)
+	free(maildir_read[i]);
+    maildir_nread = 0;
+    if (dir)
+	maildir_index_load(dir);
+
+    files = mbox_list_files(names, &nfiles);
+    if (!nfiles) {
+	/* nothing new in the folders */
+	mr = (struct mbox_reader *)emalloc(sizeof(struct mbox_reader));
+	memset(mr, 0, sizeof(struct mbox_reader));
+	mr->eof = 1;
+    }
+    else {
+	mr = mbox_open(mbox_fopen(files[0].path));
+	mr->owned = 1;
+    }
+    mr->files = files;
+    mr->nfiles = nfiles;
+    mr->cur = 0;
+    mr->tail = 2;
+    if (nfiles) {
+	mbox_enter_file(mr);
+	mbox_read_ahead(mr);
+    }
+    return mr;
+}
+
+/*
+** Move on to the next file of the list. Returns 0 when there is none.
+*/
+
+static int mbox_next_file(struct mbox_reader *mr)
+{
+    struct mbox_reader *ahead = mr->ahead;
+
+    if (!ahead)
+	return 0;
+    mbox_stop(mr);
+    fclose(mr->fp);
+    mr->fp = ahead->fp;
+    mr->map = ahead->map;
+    mr->maplen = ahead->maplen;
+    mr->buf = ahead->buf;
+    mr->bufsize = ahead->bufsize;
+    mr->start = ahead->start;
+    mr->end = ahead->end;
+    mr->eof = ahead->eof;
+    free(ahead);
+    mr->cur++;
+    mbox_enter_file(mr);
+    mbox_read_ahead(mr);
+    return 1;
+}
+
+/*
+** The next line of the current file, or NULL at its end.
+*/
+
+static const char *mbox_fileline(struct mbox_reader *mr, size_t *len)
+{
+    char *data = mr->map ? mr->map : mr->buf;
+    char *line;
+    char *nl;
+    size_t scanned = 0;
+
+    if (mr->eof && mr->start == mr->end)
+	return NULL;
+    while (!(nl = memchr(data + mr->start + scanned, '\n',
+			 mr->end - mr->start - scanned))) {
+	size_t got;
+
+	scanned = mr->end - mr->start;
+	if (mr->eof)
+	    break;
+	if (mr->start) {
+	    memmove(mr->buf, mr->buf + mr->start, scanned);
+	    mr->start = 0;
+	    mr->end = scanned;
+	}
+	if (mr->end == mr->bufsize) {
+	    mr->bufsize *= 2;
+	    mr->buf = (char *)erealloc(mr->buf, mr->bufsize);
+	}
+	data = mr->buf;
+	got = fread(mr->buf + mr->end, 1, mr->bufsize - mr->end, mr->fp);
+	if (!got)
+	    mr->eof = 1;
+	mr->end += got;
+    }
+
+    if (mr->start == mr->end)
+	return NULL;
+
+    line = data + mr->start;
+    *len = nl ? (size_t)(nl + 1 - line) : mr->end - mr->start;
+    mr->start += *len;
+    return line;
+}
+
+/*
+** Hand out line, of length len, from mr->line after putting prefix in
+** front of it.
+*/
+
+static const char *mbox_madeline(struct mbox_reader *mr, const char *prefix,
+				 const char *line, size_t *len)
+{
+    size_t plen = strlen(prefix);
+
+    if (plen + *len > mr->linesize) {
+	mr->linesize = plen + *len + MAXLINE;
+	mr->line = (char *)erealloc(mr->line, mr->linesize);
+    }
+    memcpy(mr->line, prefix, plen);
+    memcpy(mr->line + plen, line, *len);
+    *len += plen;
+    return mr->line;
+}
+
+/*
+** Return the next line, including its newline if it has one, and store
+** its length in *len. The line is not zero terminated and stays valid
+** only until the next call. Returns NULL at the end of the mailbox.
+*/
+
+const char *mbox_nextline(struct mbox_reader *mr, size_t *len)
+{
+    const char *line;
+
+    if (mr->message && mr->first) {
+	char sep[DATESTRLEN + 32];
+	struct tm tm;
+
+	/* end the previous message with an empty line, as in a mailbox */
+	if (mr->tail != 2) {
+	    mr->tail++;
+	    *len = 1;
+	    return "\n";
+	}
+	mr->first = 0;
+	mr->tail = 1;
+	mr->separator = 1;
+	/* look at the first line, and put it back if it isn't a From_ line */
+	if ((line = mbox_fileline(mr, len)) != NULL) {
+	    if (*len >= 5 && !strncmp(line, "From ", 5))
+		return line;
+	    mr->start -= *len;
+	}
+	/* getfromdate() only knows the English names, not the locale's */
+	if (local_tm(mr->files[mr->cur].delivered, &tm))
+	    snprintf(sep, sizeof(sep),
+		     "From MAILER-DAEMON %s%s %2d %02d:%02d:%02d %d\n",
+		     days[tm.tm_wday], months[tm.tm_mon], tm.tm_mday,
+		     tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_year + 1900);
+	else
+	    strcpy(sep, "From MAILER-DAEMON Thu Jan  1 00:00:00 1970\n");
+	*len = 0;
+	return mbox_madeline(mr, sep, "", len);
+    }
+
+    mr->separator = 0;
+    while (!(line = mbox_fileline(mr, len))) {
+	if (!mbox_next_file(mr))
+	    return NULL;
+	if (mr->message)
+	    return mbox_nextline(mr, len);
+    }
+
+    mr->tail = line[*len - 1] != '\n' ? 0 : *len == 1 ? 2 : 1;
+    return line;
+}
+
+/*
+** Copy the next line into *buf, growing it (and *bufsize) as needed, and
+** zero terminate it. For callers that edit the line in place. Returns
+** *buf, or NULL at the end of the mailbox.
+*/
+
+char *mbox_getline(struct mbox_reader *mr, char **buf, size_t *bufsize,
+		   size_t *len)
+{
+    size_t n;
+    const char *line = mbox_nextline(mr, &n);
+
+    if (!line)
+	return NULL;
+    if (n >= *bufsize || !*buf) {
+	while (n >= *bufsize)
+	    *bufsize = *bufsize ? *bufsize * 2 : MAXLINE;
+	*buf = (char *)erealloc(*buf, *bufsize);
+    }
+    memcpy(*buf, line, n);
+    (*buf)[n] = '\0';
+    if (len)
+	*len = n;
+    return *buf;
+}
+
+/*
+** Tell if the line handed out last is in a message file after its From_
+** line, where a line starting with "From " is part of the message and
+** does not start the next one.
+*/
+
+int mbox_bodyline(struct mbox_reader *mr)
+{
+    return mr->message && !mr->separator;
+}
+
+/*
+** Release the reader. For mmap()ed files the stream is positioned after
+** the last line handed out, so it can still be used afterwards. The
+** files of a list are closed.
+*/
+
+void mbox_close(struct mbox_reader *mr)
+{
+    if (!mr)
+	return;
+    mbox_stop(mr);
+    if (mr->ahead) {
+	mbox_stop(mr->ahead);
+	fclose(mr->ahead->fp);
+	free(mr->ahead);
+    }
+    if (mr->owned)
+	fclose(mr->fp);
+    if (mr->files) {
+	int i;
+
+	for (i = 0; i < mr->nfiles; i++) {
+	    free(mr->files[i].path);
+	    if (mr->files[i].key)
+		free(mr->files[i].key);
+	}
+	free(mr->files);
+    }
+    if (mr->line)
+	free(mr->line);
+    free(mr);
+}
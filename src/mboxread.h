@@ -0,0 +1,33 @@
+/*
+** mboxread.c functions
+*/
+
+struct mbox_reader {
+    FILE *fp;
+    char *map;			/* the whole file when mmap()ed, else NULL */
+    size_t maplen;
+    char *buf;			/* refill buffer for pipes and stdin */
+    size_t bufsize;
+    size_t start;		/* first unread byte in map or buf */
+    size_t end;			/* end of valid data in map or buf */
+    int eof;
+    int owned;			/* fp was opened here, close it too */
+    struct mbox_file *files;	/* the files of a list */
+    int nfiles;
+    int cur;			/* the one being read */
+    struct mbox_reader *ahead;	/* the next one, already opened */
+    int message;		/* the current file holds a single message */
+    int first;			/* and its From_ line is still to come */
+    int separator;		/* the last line handed out was that From_ line */
+    int tail;			/* last line: 0 unfinished, 1 text, 2 empty */
+    char *line;			/* quoted or made up line handed out */
+    size_t linesize;
+};
+
+struct mbox_reader *mbox_open(FILE *);
+struct mbox_reader *mbox_open_list(struct hmlist *, char *);
+const char *mbox_nextline(struct mbox_reader *, size_t *);
+char *mbox_getline(struct mbox_reader *, char **, size_t *, size_t *);
+int mbox_bodyline(struct mbox_reader *);
+void mbox_close(struct mbox_reader *);
+void maildir_index_write(char *);
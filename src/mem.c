@@ -21,6 +21,10 @@
 
 #include "hypermail.h"
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+
 /* Just a tiny malloc() error checker! */
 
 void *emalloc(int i)
@@ -32,6 +36,187 @@ void *emalloc(int i)
     return p;
 }
 
+/* ...and its realloc() counterpart. */
+
+void *erealloc(void *ptr, int i)
+{
+    void *p;
+
+    if ((p = (void *)realloc(ptr, i)) == NULL)
+	progerr(lang[MSG_RAN_OUT_OF_MEMORY]);
+    return p;
+}
+
+/*
+** Arenas hand out memory from large chunks and give it back in one call:
+** either all of it with arena_free(), or everything allocated after an
+** arena_mark() with arena_release(). They are used for body lines, which
+** would otherwise cost two malloc()s each. The large chunks are mapped
+** straight from the system where that can be done, so that freeing them
+** gives the memory back rather than leaving holes in the malloc() heap.
+*/
+
+#define ARENA_FIRST 4096	/* chunks start small and double... */
+#define ARENA_MAX   (1024 * 1024)	/* ...up to this size */
+#define ARENA_ALIGN sizeof(double)
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+#define ARENA_MAP_MIN (256 * 1024)	/* chunks mmap()ed from this size on */
+#endif
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    long base;			/* arena offset of the first byte */
+    int size;			/* usable bytes after the header */
+    int used;
+    int mapped;			/* mmap()ed, not emalloc()ed */
+};
+
+struct arena {
+    struct arena_chunk *chunks;	/* the current chunk comes first */
+    int next_size;		/* size of the next regular chunk */
+};
+
+static struct {
+    long arenas;		/* arenas created */
+    long chunks;		/* chunks allocated */
+    long allocs;		/* arena_alloc() calls */
+    long bytes;			/* bytes handed out */
+    long released;		/* bytes given back by arena_release() */
+    long reserved;		/* chunk bytes currently held */
+    long peak;			/* max of reserved */
+} arena_stat;
+
+#define CHUNK_HDR ((int)((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) \
+			 & ~(ARENA_ALIGN - 1)))
+
+static struct arena_chunk *chunk_alloc(int size)
+{
+    struct arena_chunk *c;
+
+#ifdef ARENA_MAP_MIN
+    if (size >= ARENA_MAP_MIN) {
+	void *p = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != MAP_FAILED) {
+	    c = (struct arena_chunk *)p;
+	    c->mapped = TRUE;
+	    return c;
+	}
+    }
+#endif
+    c = (struct arena_chunk *)emalloc(size);
+    c->mapped = FALSE;
+    return c;
+}
+
+static void chunk_free(struct arena_chunk *c)
+{
+#ifdef ARENA_MAP_MIN
+    if (c->mapped) {
+	munmap((void *)c, (size_t)(CHUNK_HDR + c->size));
+	return;
+    }
+#endif
+    free(c);
+}
+
+struct arena *arena_new(void)
+{
+    struct arena *a = (struct arena *)emalloc(sizeof(struct arena));
+    a->chunks = NULL;
+    a->next_size = ARENA_FIRST;
+    arena_stat.arenas++;
+    return a;
+}
+
+void *arena_alloc(struct arena *a, int size)
+{
+    struct arena_chunk *c = a->chunks;
+    char *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (!c || c->size - c->used < size) {
+	int csize = a->next_size - CHUNK_HDR;
+
+	if (size > csize)
+	    csize = size;
+	else if (a->next_size < ARENA_MAX)
+	    a->next_size *= 2;
+	c = chunk_alloc(CHUNK_HDR + csize);
+	c->base = a->chunks ? a->chunks->base + a->chunks->used : 0;
+	c->size = csize;
+	c->used = 0;
+	c->next = a->chunks;
+	a->chunks = c;
+	arena_stat.chunks++;
+	arena_stat.reserved += CHUNK_HDR + csize;
+	if (arena_stat.reserved > arena_stat.peak)
+	    arena_stat.peak = arena_stat.reserved;
+    }
+    p = (char *)c + CHUNK_HDR + c->used;
+    c->used += size;
+    arena_stat.allocs++;
+    arena_stat.bytes += size;
+    return p;
+}
+
+char *arena_strsav(struct arena *a, const char *s)
+{
+    int len = strlen(s) + 1;
+    char *p = (char *)arena_alloc(a, len);
+    memcpy(p, s, len);
+    return p;
+}
+
+/* The current fill level, for a later arena_release(). */
+
+long arena_mark(struct arena *a)
+{
+    return a->chunks ? a->chunks->base + a->chunks->used : 0;
+}
+
+/* Free everything allocated since the arena_mark() that returned mark. */
+
+void arena_release(struct arena *a, long mark)
+{
+    struct arena_chunk *c;
+
+    while ((c = a->chunks) != NULL && c->base >= mark && c->base) {
+	a->chunks = c->next;
+	arena_stat.released += c->used;
+	arena_stat.reserved -= CHUNK_HDR + c->size;
+	chunk_free(c);
+    }
+    if (c && c->base + c->used > mark) {
+	arena_stat.released += c->base + c->used - mark;
+	c->used = (int)(mark - c->base);
+    }
+}
+
+void arena_free(struct arena *a)
+{
+    struct arena_chunk *c, *next;
+
+    if (!a)
+	return;
+    for (c = a->chunks; c != NULL; c = next) {
+	next = c->next;
+	arena_stat.reserved -= CHUNK_HDR + c->size;
+	chunk_free(c);
+    }
+    free(a);
+}
+
+void arena_report(void)
+{
+    printf("arenas: %ld created, %ld chunks, %ld allocations, "
+	   "%ld bytes used, %ld bytes released, %ld KB held, %ld KB peak\n",
+	   arena_stat.arenas, arena_stat.chunks, arena_stat.allocs,
+	   arena_stat.bytes, arena_stat.released, arena_stat.reserved / 1024,
+	   arena_stat.peak / 1024);
+}
+
 #ifndef HAVE_MEMSET
 
 void *memset(void *s, int c, size_t n)
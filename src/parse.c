@@ -25,6 +25,8 @@
 #include "hypermail.h"
 #include "setup.h"
 #include "struct.h"
+#include "mboxread.h"
+#include "hdrindex.h"
 #include "uudecode.h"
 #include "base64.h"
 #include "search.h"
@@ -394,11 +396,17 @@ void crossindex(void)
 	    if (set_linkquotes) {
 	        struct reply *rp;
 		int found_num = 0;
+#ifdef FASTREPLYCODE
+		/* the table is only cleared when a new replylist starts */
+		rp = replylist ? lookup_reply(status) : NULL;
+		found_num = (rp != NULL && rp->frommsgnum == num);
+#else
 		for (rp = replylist; rp != NULL; rp = rp->next)
 		    if(rp->msgnum == status && rp->frommsgnum == num) {
 		        found_num = 1;
 			break;
 		    }
+#endif
 		if (!found_num && !(maybereply || num <= status))
 #ifdef FASTREPLYCODE
 		    replylist = addreply2(replylist, email2, email, maybereply,
@@ -460,7 +468,6 @@ void crossindexthread2(int num)
 	    if (0) fprintf(stderr, "add thread.b %d %d %d\n", num, rp->data->msgnum, rp->msgnum);
 	    threadlist = addreply(threadlist, num, rp->data, 0,
 				  &threadlist_end);
-	    printedlist = markasprinted(printedthreadlist, rp->msgnum);
 	    crossindexthread2(rp->msgnum);
 	}
     }
@@ -475,7 +482,6 @@ void crossindexthread2(int num)
 	    rp->data->flags |= USED_THREAD;
 	    threadlist = addreply(threadlist, num, rp->data, 0,
 				  &threadlist_end);
-	    printedlist = markasprinted(printedthreadlist, rp->msgnum);
 	    crossindexthread2(rp->msgnum);
 	}
     }
@@ -489,17 +495,17 @@ void crossindexthread2(int num)
 ** messages are separated by a -1.
 */
 
-void crossindexthread1(struct header *hp)
+void crossindexthread1(struct headerlist *list)
 {
+    struct header *hp;
+    int pos = 0;
     int isreply;
 
 #ifndef FASTREPLYCODE
     struct reply *rp;
 #endif
 
-    if (hp) {
-	crossindexthread1(hp->left);
-
+    while ((hp = header_next(list, &pos)) != NULL) {
 #ifdef FASTREPLYCODE
 	isreply = hp->data->isreply;
 #else
@@ -516,16 +522,13 @@ void crossindexthread1(struct header *hp)
 	 * been dealt with, then add it to the thread list, followed by
 	 * any descendants and then the end of thread marker.
 	 */
-	if (!isreply && !wasprinted(printedthreadlist, hp->data->msgnum) &&
-	    !(hp->data->flags & USED_THREAD)) {
+	if (!isreply && !(hp->data->flags & USED_THREAD)) {
 	    hp->data->flags |= USED_THREAD;
 	    threadlist = addreply(threadlist, hp->data->msgnum, hp->data,
 				  0, &threadlist_end);
 	    crossindexthread2(hp->data->msgnum);
 	    threadlist = addreply(threadlist, -1, NULL, 0, &threadlist_end);
 	}
-
-	crossindexthread1(hp->right);
     }
 }
 
@@ -1293,16 +1296,33 @@ static bool rfc3676_handler (char *line, bool delsp_flag, int *quotelevel,
   return flowed;
 }
 
+/*
+** Copy a line just read from mr to the mailbox of the append option. A
+** "From " line inside a Maildir or MH message is quoted there, or it
+** would start a message of its own.
+*/
+
+static void append_line(struct mbox_reader *mr, FILE *fpo,
+			const char *line, size_t len)
+{
+    if ((mbox_bodyline(mr) && !strncmp(line, "From ", 5)
+	 && putc('>', fpo) == EOF)
+	|| fwrite(line, 1, len, fpo) < len)
+	progerr("Can't write to \"mbox\""); /* revisit me */
+}
+
 /*
 ** Decode this [virtual] Quoted-Printable line as defined by RFC2045.
 ** Written by Daniel.Stenberg@haxx.nu
 */
 
-static char * mdecodeQP(FILE *file, char *input, char **result, int *length,
-			FILE *fpo)
+static char * mdecodeQP(struct mbox_reader *mr, char *input, char **result,
+			int *length, FILE *fpo)
 {
     int outcount = 0;
-    char i_buffer[MAXLINE];
+    char *i_buffer = NULL;
+    size_t i_bufsize = 0;
+    size_t i_len;
     char *buffer;
     unsigned char inchar;
     char *output;
@@ -1331,14 +1351,11 @@ static char * mdecodeQP(FILE *file, char *input, char **result, int *length,
 	if ('=' == inchar) {
 	    int value;
 	    if ('\n' == *input) {
-		if (!fgets(i_buffer, MAXLINE, file))
+		if (!mbox_getline(mr, &i_buffer, &i_bufsize, &i_len))
 		    break;
 		buffer = i_buffer + set_ietf_mbox;
-		if (set_append) {
-		  if(fputs(buffer, fpo) < 0) {
-		    progerr("Can't write to \"mbox\""); /* revisit me */
-		  }
-		}
+		if (set_append)
+		    append_line(mr, fpo, i_buffer, i_len);
 		input = buffer;
 		PushString(&pbuf, buffer);
 		continue;
@@ -1361,6 +1378,8 @@ static char * mdecodeQP(FILE *file, char *input, char **result, int *length,
 
     *result = output;
     *length = outcount;
+    if (i_buffer)
+	free(i_buffer);
     RETURN_PUSH(pbuf);
 }
 
@@ -1453,14 +1472,44 @@ void emptydir(char *directory)
     }
 }
 
-static int do_uudecode(FILE *fp, char *line, char *line_buf,
+#ifdef O_BINARY
+#define OPENBITMASK O_WRONLY | O_CREAT | O_TRUNC | O_BINARY
+#else
+#define OPENBITMASK O_WRONLY | O_CREAT | O_TRUNC
+#endif
+
+/* decoded attachment data is written out in blocks of this size */
+#define ATTACHMENT_BUFSIZE (256 * 1024)
+
+/*
+** Create the file an attachment gets decoded into. The decoders hand
+** over one line at a time, so the stream gets a large buffer instead of
+** a write() per line.
+*/
+
+static FILE *open_attachment(char *binname)
+{
+    FILE *fp;
+    int fd = open(binname, OPENBITMASK, set_filemode);
+
+    if (fd == -1)
+	return NULL;
+    if ((fp = fdopen(fd, "wb")) == NULL) {
+	close(fd);
+	return NULL;
+    }
+    setvbuf(fp, NULL, _IOFBF, ATTACHMENT_BUFSIZE);
+    return fp;
+}
+
+static int do_uudecode(struct mbox_reader *mr, char *line, char *line_buf,
 		       struct Push *raw_text_buf, FILE *fpo)
 {
     struct Push pbuf;
     char *p2;
     INIT_PUSH(pbuf);
 
-    if (uudecode(fp, line, line, NULL, &pbuf))
+    if (uudecode(mr, line, line, NULL, &pbuf))
       /*
        * oh gee, we failed this is chaos 
        */
@@ -1505,6 +1554,33 @@ static void write_txt_file(struct emailinfo *emp, struct Push *raw_text_buf)
     INIT_PUSH(*raw_text_buf);
 }
 
+/*
+** The body lines of all messages parsemail() read. They stay until
+** release_bodies() is called, once the message pages are written.
+*/
+
+static struct arena *body_arena;
+
+/*
+** Give back the bodies of the messages parsemail() read, all at once.
+** Nothing reads them after the message pages are written; a message
+** looked up with hashnumlookup() afterwards gets an empty body.
+*/
+
+void release_bodies(int maxnum)
+{
+    struct emailinfo *ep;
+    int i;
+
+    if (!body_arena)
+	return;
+    for (i = 0; i < maxnum; i++)
+	if (hashnumlookup(i, &ep) && ep->bodylist->inarena)
+	    ep->bodylist = NULL;
+    arena_free(body_arena);
+    body_arena = NULL;
+}
+
 /*
 ** Parsing...the heart of Hypermail!
 ** This loads in the articles from stdin or a mailbox, adding the right
@@ -1521,6 +1597,8 @@ int parsemail(char *mbox,	/* file name */
 	      int startnum)
 {
     FILE *fp;
+    struct mbox_reader *mr;
+    long msg_mark;		/* where the current message starts in body_arena */
     struct Push raw_text_buf;
     FILE *fpo = NULL;
     char *date = NULL;
@@ -1530,7 +1608,12 @@ int parsemail(char *mbox,	/* file name */
     char *namep = NULL;
     char *emailp = NULL;
     char *line = NULL; 
-    char line_buf[MAXLINE], fromdate[DATESTRLEN] = "";
+    char *line_buf = NULL;	/* whole line, grown as needed */
+    size_t line_bufsize = 0;
+    size_t line_len = 0;
+    char *decode_buf = NULL;	/* base64/uuencode output for one line */
+    size_t decode_bufsize = 0;
+    char fromdate[DATESTRLEN] = "";
     char *cp;
     char *dp = NULL;
     int num, isinheader, hassubject, hasdate;
@@ -1627,7 +1710,7 @@ int parsemail(char *mbox,	/* file name */
     bool continue_previous_flow_flag = FALSE;
     bool delsp_flag = FALSE;
 
-    int binfile = -1;
+    FILE *binfile = NULL;
 
     char *charset = NULL;	/* this is the LOCAL charset used in the mail */
     char *charsetsave;      /* charset in MIME encoded text */
@@ -1654,6 +1737,8 @@ int parsemail(char *mbox,	/* file name */
 
     if (use_stdin || !mbox || !strcasecmp(mbox, "NONE"))
 	fp = stdin;
+    else if (mboxes && (mboxes->next || isdir(mbox)))
+	fp = NULL;		/* mailboxes or folders, opened by the reader */
     else if ((fp = fopen(mbox, "rb")) == NULL) {
         snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", 
                  lang[MSG_CANNOT_OPEN_MAIL_ARCHIVE], mbox);
@@ -1739,12 +1824,24 @@ int parsemail(char *mbox,	/* file name */
 	else {
 	    if ((mbox && !strcasecmp(mbox, "NONE")) || use_stdin)
 		printf("%s...\n", lang[MSG_LOADING_MAILBOX]);
+	    else if (!fp)
+		for (tlist = mboxes; tlist != NULL; tlist = tlist->next)
+		    printf("%s \"%s\"...\n", lang[MSG_LOADING_MAILBOX],
+			   tlist->val);
 	    else
 		printf("%s \"%s\"...\n", lang[MSG_LOADING_MAILBOX], mbox);
 	}
     }
 
-    for ( ; fgets(line_buf, MAXLINE, fp) != NULL; 
+    /* an incremental run only reads the folder messages not archived yet */
+    mr = fp ? mbox_open(fp)
+	    : mbox_open_list(mboxes, increment > 0 ? dir : NULL);
+    if (!body_arena)
+	body_arena = arena_new();
+    set_body_arena(body_arena);
+    msg_mark = arena_mark(body_arena);
+
+    for ( ; mbox_getline(mr, &line_buf, &line_bufsize, &line_len) != NULL; 
 	  set_txtsuffix ? PushString(&raw_text_buf, line_buf) : 0) {
 #if DEBUG_PARSE
         fprintf(stderr,"\n^IN: %s", line_buf);
@@ -1758,11 +1855,8 @@ int parsemail(char *mbox,	/* file name */
                 "origlp", (origlp) ? origlp->line : "",
                 "headp", (headp) ? headp->line : "");	
 #endif 
-	if(set_append) {
-	    if(fputs(line_buf, fpo) < 0) {
-	        progerr("Can't write to \"mbox\""); /* revisit me */
-	    }
-	}
+	if(set_append)
+	    append_line(mr, fpo, line_buf, line_len);
 	line = line_buf + set_ietf_mbox;
 
         if (skip_mime_epilogue) {
@@ -1782,7 +1876,7 @@ int parsemail(char *mbox,	/* file name */
 	    require_filter_full[pos] = TRUE;
 	}
 	if (isinheader) {
-	    if (!strncasecmp(line_buf, "From ", 5))
+	    if (!strncasecmp(line_buf, "From ", 5) && !mbox_bodyline(mr))
 		strcpymax(fromdate, dp = getfromdate(line), DATESTRLEN);
 	    /* check for MIME */
 	    else if (!strncasecmp(line, "MIME-Version:", 13))
@@ -1830,8 +1924,17 @@ int parsemail(char *mbox,	/* file name */
 		for (head = bp; head; head = head->next) {
 		    char head_name[128];
 		    if (head->header && !head->demimed) {
-		      head->line =
-			mdecodeRFC2047(head->line, strlen(head->line),charsetsave);
+		      if (head->inarena) {
+			/* mdecodeRFC2047() frees what it replaces */
+			char *decoded =
+			  mdecodeRFC2047(strsav(head->line), strlen(head->line),
+					 charsetsave);
+			head->line = arena_strsav(body_arena, decoded);
+			free(decoded);
+		      }
+		      else
+			head->line =
+			  mdecodeRFC2047(head->line, strlen(head->line),charsetsave);
 		      head->demimed = TRUE;
 		    }
 
@@ -2141,7 +2244,6 @@ int parsemail(char *mbox,	/* file name */
 			}
 
 			if (alternativeparser) {
-			    struct body *next;
 			    struct body *temp_bp = NULL;
                             
 			    /* We are parsing alternatives... */
@@ -2213,13 +2315,7 @@ int parsemail(char *mbox,	/* file name */
                             }
                             
 			    /* free any previous alternative */
-			    while (temp_bp) {
-				next = temp_bp->next;
-				if (temp_bp->line)
-				    free(temp_bp->line);
-				free(temp_bp);
-				temp_bp = next;
-			    }
+			    free_body(temp_bp);
 
 			    /* @@ not sure if I should add a diff flag to do this break */
 			    if (content == CONTENT_IGNORE)
@@ -2348,18 +2444,17 @@ int parsemail(char *mbox,	/* file name */
 				/* restart on a new list: */
 				tmpbp = tmplp = NULL;
 			
-				while (fgets(line_buf, MAXLINE, fp)) {
-				    if(set_append) {
-				        if(fputs(line_buf, fpo) < 0) {
-					    progerr("Can't write to \"mbox\""); /* revisit me */
-					}
-				    }
+				while (mbox_getline(mr, &line_buf, &line_bufsize,
+						    &line_len)) {
+				    if(set_append)
+					append_line(mr, fpo, line_buf, line_len);
 				    if (!strncmp(line_buf + set_ietf_mbox, "--", 2) &&
 					!strncmp(line_buf + set_ietf_mbox + 2, boundbuffer,
 						 strlen(boundbuffer))) {
 					break;
 				    }
-				    if (!strncasecmp(line_buf, "From ", 5)) {
+				    if (!strncasecmp(line_buf, "From ", 5)
+					&& !mbox_bodyline(mr)) {
 #if DEBUG_PARSE
 					printf("Error, new message found instead of boundary!\n");
 #endif
@@ -2483,7 +2578,7 @@ int parsemail(char *mbox,	/* file name */
 			}
 			else if (!strncasecmp(ptr, "x-uue", 5)) {
 			    decode = ENCODE_UUENCODE;
-			    if (!do_uudecode(fp, line, line_buf,
+			    if (!do_uudecode(mr, line, line_buf,
 					     &raw_text_buf, fpo))
 			        break;
 			}
@@ -2494,7 +2589,7 @@ int parsemail(char *mbox,	/* file name */
 			    /* is there any value for content-encoding or is it missing? */
 			    if (sscanf(ptr, "%63s", code) != EOF) {
 			      
-			      snprintf(line, sizeof(line_buf) - set_ietf_mbox,
+			      snprintf(line, line_bufsize - set_ietf_mbox,
 				       " ('%s' %s)\n", code, 
 				       lang[MSG_ENCODING_IS_NOT_SUPPORTED]);
 
@@ -2557,11 +2652,11 @@ int parsemail(char *mbox,	/* file name */
 	     * "a valid date field" in that line 100%.
 	     */
 	    if (!readone &&
-		!strncmp(line_buf, "From ", 5) &&
+		!strncmp(line_buf, "From ", 5) && !mbox_bodyline(mr) &&
 		(*(dp = getfromdate(line)) != '\0')) {
-		if (-1 != binfile) {
-		    close(binfile);
-		    binfile = -1;
+		if (binfile) {
+		    fclose(binfile);
+		    binfile = NULL;
 		}
 
                 /* as long as we don't handle UTF-8 throughout), use the prefered
@@ -2702,8 +2797,12 @@ msgid);
 		    require_filter[pos] = FALSE;
 		for (pos = 0; pos < require_filter_full_len; ++pos)
 		    require_filter_full[pos] = FALSE;
+		filter_next_message();
 		if (set_txtsuffix && emp && set_increment != -1)
 		    write_txt_file(emp, &raw_text_buf);
+		if (!emp || emp->bodylist != bp)
+		    arena_release(body_arena, msg_mark);  /* dropped */
+		msg_mark = arena_mark(body_arena);
 
 		if (hasdate)
 		    free(date);
@@ -2738,6 +2837,7 @@ msgid);
 		}
 
 		bp = NULL;
+		origbp = origlp = alternative_bp = alternative_lp = NULL;
 		bodyflags = 0;	/* reset state flags */
 
 		/* reset related RFC 3676 state flags */
@@ -2812,7 +2912,6 @@ msgid);
 #endif
 	    }
 	    else {		/* decode MIME complient gibberish */
-		char newbuffer[MAXLINE];
 		char *data;
 		int datalen = -1;	/* -1 means use strlen to get length */
 
@@ -2991,9 +3090,9 @@ msgid);
                             printf("New section: restoring charset %s and charsetsave %s\n", charset, charsetsave);
 #endif
                         }
-			if (-1 != binfile) {
-			    close(binfile);
-			    binfile = -1;
+			if (binfile) {
+			    fclose(binfile);
+			    binfile = NULL;
 			}
                         
 			continue;
@@ -3003,7 +3102,7 @@ msgid);
 		switch (decode) {
 		case ENCODE_QP:
 		    {
-			char *p2 = mdecodeQP(fp, line, &data, &datalen, fpo);
+			char *p2 = mdecodeQP(mr, line, &data, &datalen, fpo);
 			if (p2) {
 			    if (set_txtsuffix) {
 			        PushString(&raw_text_buf, line);
@@ -3015,12 +3114,16 @@ msgid);
 		    }
 		    break;
 		case ENCODE_BASE64:
-		    base64Decode(line, newbuffer, &datalen);
-		    data = newbuffer;
-		    break;
 		case ENCODE_UUENCODE:
-		    uudecode(NULL, line, newbuffer, &datalen, NULL);
-		    data = newbuffer;
+		    if (decode_bufsize < line_bufsize) {
+			decode_bufsize = line_bufsize;
+			decode_buf = (char *)erealloc(decode_buf, decode_bufsize);
+		    }
+		    if (decode == ENCODE_BASE64)
+			base64Decode(line, decode_buf, &datalen);
+		    else
+			uudecode(NULL, line, decode_buf, &datalen, NULL);
+		    data = decode_buf;
 		    break;
 		case ENCODE_NORMAL:
 		    data = line;
@@ -3210,20 +3313,13 @@ msgid);
                              * inline as they are encountered. The 
                              * directories must exist first...  
                              */
-
-#ifdef O_BINARY
-#define OPENBITMASK O_WRONLY | O_CREAT | O_TRUNC | O_BINARY
-#else
-#define OPENBITMASK O_WRONLY | O_CREAT | O_TRUNC
-#endif
 			    if (binname) {
-				binfile = open(binname, OPENBITMASK,
-					       set_filemode);
+				binfile = open_attachment(binname);
 
 #if DEBUG_PARSE
 				printf("%4d open attachment %s\n", num, binname);
 #endif
-				if (-1 != binfile) {
+				if (binfile) {
 				    chmod(binname, set_filemode);
 				    if (set_showprogress)
 					print_progress(num, lang
@@ -3400,7 +3496,7 @@ msgid);
 			    inline_force = FALSE;
 			    attachname[0] = '\0';
 
-			    if (binname && (binfile != -1))
+			    if (binname && binfile)
 				content = CONTENT_BINARY;
 			    else
 				content = CONTENT_UNKNOWN;
@@ -3410,11 +3506,11 @@ msgid);
 			}
 		    }
 #endif
-		    if (-1 != binfile) {
+		    if (binfile) {
 			if (datalen < 0)
 			    datalen = strlen(data);
 
-			write(binfile, data, datalen);
+			fwrite(data, 1, datalen, binfile);
 		    }
 		}
 
@@ -3423,6 +3519,8 @@ msgid);
 	    }
 	}
     }
+    if (binfile)
+	fclose(binfile);
     if(set_append && fclose(fpo)) {
 	progerr("Can't close \"mbox\"");
     }
@@ -3522,6 +3620,8 @@ msgid);
 	        write_txt_file(emp, &raw_text_buf);
 	    num++;
 	}
+	if (!emp || emp->bodylist != bp)
+	    arena_release(body_arena, msg_mark);
 
 	/* @@@ if we didn't add the message, we should consider erasing the attdir
 	   if it's there */
@@ -3627,8 +3727,16 @@ msgid);
     /* kpm - this is to prevent the closing of std and hypermail crashing
      * if the input is from stdin
      */
-    if (fp != stdin)
+    /* the bodies stay until release_bodies() */
+    set_body_arena(NULL);
+
+    mbox_close(mr);
+    if (fp && fp != stdin)
 	fclose(fp);
+    if (line_buf)
+	free(line_buf);
+    if (decode_buf)
+	free(decode_buf);
 
 #ifdef FASTREPLYCODE
     threadlist_by_msgnum = (struct reply **)emalloc((num + 1)*sizeof(struct reply *));
@@ -3642,7 +3750,6 @@ msgid);
 	max_msgnum = num - 1;
     crossindex();
     threadlist = NULL;
-    printedthreadlist = NULL;
     crossindexthread1(datelist);
 #if DEBUG_THREAD
     {
@@ -3697,9 +3804,11 @@ static void check_expiry(struct emailinfo *emp)
 	    emp->is_deleted = FILTERED_NEW;
 	    option = "delete_newer";
 	}
-	if (emp->is_deleted)
+	if (emp->is_deleted) {
+	    emp->flags |= DELETION_CHANGED;
 	    printf("message %d deleted under option %s. msgid: %s\n",
 		   emp->msgnum+1, option, emp->msgid);
+	}
     }
 }
 
@@ -3971,6 +4080,56 @@ int parse_old_html(int num, struct emailinfo *ep, int parse_body,
     return (cmp_msgid ? msgids_are_same : num_added);
 }
 
+/*
+** Load messages 0 to max_num from the header index instead of their
+** pages, with the same result as parse_old_html() on each of them.
+** Returns the number of mails read, or -1 if there is no usable index.
+*/
+
+static int loadoldheadersfromindex(char *dir, int max_num)
+{
+    struct hdrindex *idx;
+    struct hdrindex_entry entry;
+    int num;
+    int num_added = 0;
+
+    if ((idx = hdrindex_open(dir, max_num)) == NULL)
+	return -1;
+
+    for (num = 0; num <= max_num; num++) {
+	struct emailinfo *emp;
+	struct body *bp = NULL;
+	struct body *lp = NULL;
+	char *date;
+
+	if (!hdrindex_get(idx, num, &entry))
+	    continue;
+	bp = addbody(bp, &lp, "\0", 0);
+	date = entry.str[HDRINDEX_DATE];
+	emp = addhash(num, date ? date : NODATE,
+		      entry.str[HDRINDEX_NAME], entry.str[HDRINDEX_EMAIL],
+		      entry.str[HDRINDEX_MSGID], entry.str[HDRINDEX_SUBJECT],
+		      entry.str[HDRINDEX_INREPLY], entry.str[HDRINDEX_FROMDATE],
+		      entry.str[HDRINDEX_CHARSET], entry.str[HDRINDEX_ISODATE],
+		      entry.str[HDRINDEX_ISOFROMDATE], bp);
+	if (emp) {
+	    emp->exp_time = entry.exp_time;
+	    emp->is_deleted = entry.is_deleted;
+	    check_expiry(emp);
+	    if (insert_in_lists(emp, NULL, 0))
+		++num_added;
+	}
+
+	if (!(num % 10) && set_showprogress) {
+	    printf("\r%4d", num);
+	    fflush(stdout);
+	}
+    }
+
+    hdrindex_close(idx);
+    return num_added;
+}
+
 /*
 ** All this does is get all the relevant header information from the
 ** comment fields in existing archive files. Everything is loaded into
@@ -4075,6 +4234,11 @@ static int loadoldheadersfrommessages(char *dir, int num_from_gdbm)
     if (num_from_gdbm == -1)
         authorlist = subjectlist = datelist = NULL;
 
+    if (num_from_gdbm == -1 && HDRINDEX_ENABLED
+	&& (num_added = loadoldheadersfromindex(dir, max_num)) != -1)
+	return num_added;
+    num_added = 0;
+
 #ifdef WANTDUPMESSAGES
     if (set_showprogress)
 	printf("%s...\n", lang[MSG_READING_OLD_HEADERS]);
@@ -4128,11 +4292,12 @@ static int loadoldheadersfrommessages(char *dir, int num_from_gdbm)
 } /* end loadoldheadersfrommessages() */
 
 /*
-** Load message summary information from a GDBM index.
+** Load message summary information from the GDBM index of the archive
+** in set_dir, the one gdbm_session() opens.
 */
 #ifdef GDBM
 
-int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
+int loadoldheadersfromGDBMindex(int get_count_only)
 {
       char *indexname;
       GDBM_FILE gp;
@@ -4159,10 +4324,11 @@ int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
        *   isodate      v2.0
        */
 
-      trio_asprintf(&indexname, (dir[strlen(dir)-1] == '/') ? "%s%s" : "%s/%s",
-		    dir, GDBM_INDEX_NAME);
+      trio_asprintf(&indexname,
+		    (set_dir[strlen(set_dir)-1] == '/') ? "%s%s" : "%s/%s",
+		    set_dir, GDBM_INDEX_NAME);
 
-      if ((gp = gdbm_open(indexname, 0, GDBM_READER, 0, 0))) {
+      if ((gp = (GDBM_FILE)gdbm_session(FALSE))) {
 
 	/* we _can_ read the index */
 
@@ -4186,7 +4352,7 @@ int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
 	else
 	    max_num = atoi(content.dptr);
 	if (get_count_only) {
-	    gdbm_close(gp);
+	    free(indexname);
 	    return max_num;
 	}
 
@@ -4284,9 +4450,8 @@ int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
 
 	} /* end loop on messages */
 
-	gdbm_close(gp);
 	if (set_linkquotes)
-	    loadoldheadersfrommessages(dir, num);
+	    loadoldheadersfrommessages(set_dir, num);
       } /* end case of able to read gdbm index */
 
       else { 
@@ -4298,9 +4463,9 @@ int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
 
 	if (set_showprogress)
 	  printf(lang[MSG_CREATING_GDBM_INDEX]);
-	num = loadoldheadersfrommessages(dir, -1);
+	num = loadoldheadersfrommessages(set_dir, -1);
 	
-	if(!(gp = gdbm_open(indexname, 0, GDBM_NEWDB, 0600, 0))){
+	if(!(gp = (GDBM_FILE)gdbm_session_new())){
 
 	  /* Serious problem here: can't create! So, just muddle on. */
 
@@ -4314,7 +4479,6 @@ int loadoldheadersfromGDBMindex(char *dir, int get_count_only)
 	for (num = 0; hashnumlookup(num, &emp); num++) {
 	    togdbm((void *) gp, emp);
 	}
-	gdbm_close(gp);
 
       } /* end case of could not read gdbm index */
 
@@ -4339,7 +4503,7 @@ int loadoldheaders(char *dir)
     printf("%s...\n", lang[MSG_READING_OLD_HEADERS]);
 #ifdef GDBM
   if(set_usegdbm)
-    num = loadoldheadersfromGDBMindex(dir, 0);
+    num = loadoldheadersfromGDBMindex(0);
   else
 #endif
     num = loadoldheadersfrommessages(dir, -1);
@@ -4352,6 +4516,190 @@ int loadoldheaders(char *dir)
 } /* end loadoldheaders() */
 
 
+/*
+** Old pages patched by fixnextheader(), fixreplyheader() and
+** fixthreadheader(). Between patch_begin() and patch_flush() each page
+** is read once, all its fixes are applied to the copy in memory and it
+** is written back once. Outside of that every fix is written back at
+** once. Pages are replaced through a temporary file with replace_file().
+*/
+
+struct patchpage {
+    char *filename;
+    struct body *bp;
+    struct arena *arena;
+    int kept;			/* written by patch_flush() */
+    struct patchpage *next;	/* pages touched in this session */
+};
+
+static struct patchpage **patch_pages;	/* by msgnum, in a session */
+static struct patchpage *patch_touched;
+static struct reply **patch_threadprev;	/* threadlist entry before msgnum */
+static int patch_count;
+
+static void patch_write(struct patchpage *pg)
+{
+    char *tmpname;
+    struct body *bp;
+    FILE *fp;
+    int ok = TRUE;
+
+    trio_asprintf(&tmpname, "%s.tmp", pg->filename);
+    if ((fp = fopen(tmpname, "w")) != NULL) {
+	for (bp = pg->bp; bp != NULL; bp = bp->next)
+	    if (fputs(bp->line, fp) == EOF)
+		ok = FALSE;
+	if (fclose(fp))
+	    ok = FALSE;
+	if (!ok || replace_file(tmpname, pg->filename) == -1)
+	    unlink(tmpname);
+    }
+    free(tmpname);
+}
+
+static void patch_free(struct patchpage *pg)
+{
+    arena_free(pg->arena);
+    free(pg->filename);
+    free(pg);
+}
+
+/*
+** Get the page of email, reading it unless this session already has it.
+** Returns NULL if there is no such page.
+*/
+
+static struct patchpage *patch_load(struct emailinfo *email)
+{
+    struct patchpage *pg;
+    struct arena *prev_arena;
+    struct body *lp = NULL;
+    char line[MAXLINE];
+    FILE *fp;
+
+    if (patch_pages && email->msgnum < patch_count
+	&& (pg = patch_pages[email->msgnum]) != NULL)
+	return pg;
+
+    pg = (struct patchpage *)emalloc(sizeof(struct patchpage));
+    pg->filename = articlehtmlfilename(email);
+    if ((fp = fopen(pg->filename, "r")) == NULL) {
+	free(pg->filename);
+	free(pg);
+	return NULL;
+    }
+    pg->bp = NULL;
+    pg->kept = FALSE;
+    pg->arena = arena_new();	/* the whole page is freed at once */
+    prev_arena = set_body_arena(pg->arena);
+    while ((fgets(line, MAXLINE, fp)) != NULL)
+	pg->bp = addbody(pg->bp, &lp, line, 0);
+    set_body_arena(prev_arena);
+    fclose(fp);
+
+    if (patch_pages && email->msgnum < patch_count) {
+	patch_pages[email->msgnum] = pg;
+	pg->kept = TRUE;
+	pg->next = patch_touched;
+	patch_touched = pg;
+    }
+    return pg;
+}
+
+/*
+** Replace the lines of a page with the rewritten text in out, split up
+** the same way reading it back with fgets() would.
+*/
+
+static void patch_done(struct patchpage *pg, struct Push *out)
+{
+    struct arena *prev_arena;
+    struct body *lp = NULL;
+    char line[MAXLINE];
+    char *s = PUSH_STRING(*out);
+    size_t n;
+
+    arena_free(pg->arena);
+    pg->bp = NULL;
+    pg->arena = arena_new();
+    prev_arena = set_body_arena(pg->arena);
+    while (s && *s) {
+	for (n = 0; s[n] && n < MAXLINE - 1; )
+	    if (s[n++] == '\n')
+		break;
+	memcpy(line, s, n);
+	line[n] = '\0';
+	pg->bp = addbody(pg->bp, &lp, line, 0);
+	s += n;
+    }
+    set_body_arena(prev_arena);
+    free(PUSH_STRING(*out));
+
+    if (!pg->kept) {
+	patch_write(pg);
+	patch_free(pg);
+    }
+}
+
+static void patch_printf(struct Push *out, const char *format, ...)
+{
+    va_list args;
+    char *str;
+
+    va_start(args, format);
+    trio_vasprintf(&str, format, args);
+    va_end(args);
+    PushString(out, str);
+    free(str);
+}
+
+/*
+** Start collecting page fixes. The thread list must not change until
+** patch_flush().
+*/
+
+void patch_begin(void)
+{
+    struct reply *rp;
+    int num;
+
+    patch_count = max_msgnum + 1;
+    patch_pages = (struct patchpage **)emalloc(patch_count * sizeof(struct patchpage *));
+    patch_threadprev = (struct reply **)emalloc(patch_count * sizeof(struct reply *));
+    for (num = 0; num < patch_count; num++) {
+	patch_pages[num] = NULL;
+	patch_threadprev[num] = NULL;
+    }
+    patch_touched = NULL;
+    for (rp = threadlist; rp != NULL; rp = rp->next) {
+	if (rp->next != NULL && rp->next->data && rp->data && rp->msgnum != -1) {
+	    num = rp->next->data->msgnum;
+	    if (num >= 0 && num < patch_count && !patch_threadprev[num])
+		patch_threadprev[num] = rp;
+	}
+    }
+}
+
+/*
+** Write every page fixed since patch_begin().
+*/
+
+void patch_flush(void)
+{
+    struct patchpage *pg;
+
+    while ((pg = patch_touched) != NULL) {
+	patch_touched = pg->next;
+	patch_write(pg);
+	patch_free(pg);
+    }
+    free(patch_pages);
+    free(patch_threadprev);
+    patch_pages = NULL;
+    patch_threadprev = NULL;
+    patch_count = 0;
+}
+
 /*
 ** Adds a "Next:" link in the proper article, after the archive has been
 ** incrementally updated.
@@ -4359,35 +4707,25 @@ int loadoldheaders(char *dir)
 
 void fixnextheader(char *dir, int num, int direction)
 {
-    char *filename;
-    char line[MAXLINE];
     struct emailinfo *email;
 
-    struct body *bp, *cp, *dp = NULL, *lp = NULL;
+    struct patchpage *pg;
+    struct body *bp, *dp = NULL;
+    struct Push out;
     int ul;
-    FILE *fp;
     char *ptr;
     struct emailinfo *e3 = NULL;
 
     dp = NULL;
     ul = 0;
 
-    if ((e3 = neighborlookup(num, direction)) != NULL 
-	&& (email = neighborlookup(num-1, 1)) != NULL)
-	filename = articlehtmlfilename(e3);
-    else
+    if ((e3 = neighborlookup(num, direction)) == NULL 
+	|| (email = neighborlookup(num-1, 1)) == NULL)
 	return;
-    bp = NULL;
-    fp = fopen(filename, "r");
-    if (fp) {
-	while ((fgets(line, MAXLINE, fp)) != NULL)
-	    bp = addbody(bp, &lp, line, 0);
-    }
-    else
+    if ((pg = patch_load(e3)) == NULL)
 	return;
-    fclose(fp);
-
-    cp = bp;			/* save start of list to free later */
+    bp = pg->bp;
+    INIT_PUSH(out);
 
 #ifdef HAVE_ICONV
     char *numsubject,*numname;
@@ -4395,81 +4733,74 @@ void fixnextheader(char *dir, int num, int direction)
     numname=i18n_utf2numref(email->name,1);
 #endif
 
-    fp = fopen(filename, "w+");
-    if (fp) {
-	while (bp) {
-	    if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
-	      /* JK: just skip this line and the following which is just our
-	       empty marker. */
-	      bp = bp->next;
-	      bp = bp->next;
-	      continue;
-	    }
-	    fprintf(fp, "%s", bp->line);
+    while (bp) {
+	if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
+	  /* JK: just skip this line and the following which is just our
+	   empty marker. */
+	  bp = bp->next;
+	  bp = bp->next;
+	  continue;
+	}
+	PushString(&out, bp->line);
 
-	    if (!strncmp(bp->line, "<!-- unext=", 11)) {
+	if (!strncmp(bp->line, "<!-- unext=", 11)) {
 #ifdef HAVE_ICONV
-	      ptr = strsav(numsubject);
+	  ptr = strsav(numsubject);
 #else
-	      ptr = convchars(email->subject, email->charset);
+	  ptr = convchars(email->subject, email->charset);
 #endif
-	      fprintf(fp, "[ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
-		       msg_href (email, e3, FALSE), 
+	  patch_printf(&out, "[ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
+		   msg_href (email, e3, FALSE), 
 #ifdef HAVE_ICONV
-		      numname, ptr ? ptr : "", 
+		  numname, ptr ? ptr : "", 
 #else
-		      email->name, ptr ? ptr : "", 
+		  email->name, ptr ? ptr : "", 
 #endif
-		      lang[MSG_NEXT_MESSAGE]);
-	      if (ptr)
-		free(ptr);
-	    }
-	    else if (!strncmp(bp->line, "<!-- lnext=", 11)) {
+		  lang[MSG_NEXT_MESSAGE]);
+	  if (ptr)
+	    free(ptr);
+	}
+	else if (!strncmp(bp->line, "<!-- lnext=", 11)) {
 #ifdef HAVE_ICONV
-	      ptr = strsav(numsubject);
+	  ptr = strsav(numsubject);
 #else
-	      ptr = convchars(email->subject, email->charset);
+	  ptr = convchars(email->subject, email->charset);
 #endif
-	      fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_MESSAGE]);
-	      fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
-		      msg_href(email, e3, FALSE), lang[MSG_LTITLE_NEXT],
+	  patch_printf(&out, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_MESSAGE]);
+	  patch_printf(&out, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
+		  msg_href(email, e3, FALSE), lang[MSG_LTITLE_NEXT],
 #ifdef HAVE_ICONV
-		      numname, ptr ? ptr : "");
+		  numname, ptr ? ptr : "");
 #else
-		      email->name, ptr ? ptr : "");
+		  email->name, ptr ? ptr : "");
 #endif
-	      if (ptr)
-		free(ptr);
-	    }
-	    else if (!strncmp(bp->line, "<!-- next=", 10)) {
-	      dp = bp->next;
-	      if (!strncmp(dp->line, "<ul", 3)) {
-		fprintf(fp, "%s", dp->line);
-		ul = 1;
-	      }
-	      fprintf(fp, "<li><strong>%s:</strong> ",
-		      lang[MSG_NEXT_MESSAGE]);
-	      fprintf(fp, "%s%s: \"%s\"</a></li>\n", msg_href(email, e3, TRUE),
+	  if (ptr)
+	    free(ptr);
+	}
+	else if (!strncmp(bp->line, "<!-- next=", 10)) {
+	  dp = bp->next;
+	  if (!strncmp(dp->line, "<ul", 3)) {
+	    PushString(&out, dp->line);
+	    ul = 1;
+	  }
+	  patch_printf(&out, "<li><strong>%s:</strong> ",
+		  lang[MSG_NEXT_MESSAGE]);
+	  patch_printf(&out, "%s%s: \"%s\"</a></li>\n", msg_href(email, e3, TRUE),
 #ifdef HAVE_ICONV
-		      numname, numsubject);
+		  numname, numsubject);
 #else
-		      email->name, ptr = convchars(email->subject, email->charset));
-	      free(ptr);
+		  email->name, ptr = convchars(email->subject, email->charset));
+	  free(ptr);
 #endif	      
-	      if (ul) {
-		bp = dp;
-		ul = 0;
-	      }
+	  if (ul) {
+	    bp = dp;
+	    ul = 0;
+	  }
 	      
-	    }
-	    bp = bp->next;
 	}
+	bp = bp->next;
     }
-    fclose(fp);
-
-    /* can we clean up a bit please... */
-    free_body(cp);
-    free(filename);
+    patch_done(pg, &out);
 }
 
 /*
@@ -4479,15 +4810,12 @@ void fixnextheader(char *dir, int num, int direction)
 
 void fixreplyheader(char *dir, int num, int remove_maybes, int max_update)
 {
-    char *filename;
-    char line[MAXLINE];
-
     int subjmatch = 0;
     int replynum = -1;
 
-    struct body *bp, *cp, *status;
-    struct body *lp = NULL;
-    FILE *fp;
+    struct patchpage *pg;
+    struct body *bp, *status;
+    struct Push out;
     char *ptr;
 
     struct emailinfo *email;
@@ -4588,39 +4916,28 @@ void fixreplyheader(char *dir, int num, int remove_maybes, int max_update)
 
     if (email2 == NULL)
 	hashnumlookup(replynum, &email2);
-    filename = articlehtmlfilename(email2);
+    if ((pg = patch_load(email2)) == NULL)
+	return;
 
-    bp = NULL;
-    fp = fopen(filename, "r");
-    if (fp) {
-	while ((fgets(line, MAXLINE, fp)) != NULL) {
-	    if (set_linkquotes) {
-	        const char *ptr = strstr(line, old_nextinthread_pattern);
-		if (ptr)
-		    next_in_thread = atoi(ptr+strlen(old_nextinthread_pattern));
-		else {
-		    ptr = strstr(line, current_nextinthread_pattern);
-		    if (ptr)
-		        next_in_thread = atoi(ptr+strlen(current_nextinthread_pattern));
-		    else {
-		      ptr = strstr(line, old2_nextinthread_pattern);
-		      if (ptr) {
-		        next_in_thread = atoi(ptr+strlen(old2_nextinthread_pattern));
-			is_old_format = TRUE;
-		      }
-		    }
-		}
+    for (bp = pg->bp; set_linkquotes && bp != NULL; bp = bp->next) {
+	const char *ptr = strstr(bp->line, old_nextinthread_pattern);
+	if (ptr)
+	    next_in_thread = atoi(ptr+strlen(old_nextinthread_pattern));
+	else {
+	    ptr = strstr(bp->line, current_nextinthread_pattern);
+	    if (ptr)
+		next_in_thread = atoi(ptr+strlen(current_nextinthread_pattern));
+	    else {
+	      ptr = strstr(bp->line, old2_nextinthread_pattern);
+	      if (ptr) {
+		next_in_thread = atoi(ptr+strlen(old2_nextinthread_pattern));
+		is_old_format = TRUE;
+	      }
 	    }
-	    bp = addbody(bp, &lp, line, 0);
 	}
     }
-    else {
-	free(filename);
-	return;
-    }
-    fclose(fp);
-
-    cp = bp;			/* save start of list to free later */
+    bp = pg->bp;
+    INIT_PUSH(out);
 
 #ifdef HAVE_ICONV
     char *numsubject,*numname;
@@ -4628,127 +4945,120 @@ void fixreplyheader(char *dir, int num, int remove_maybes, int max_update)
     numname=i18n_utf2numref(email->name,1);
 #endif
 
-    fp = fopen(filename, "w+");
-    if (fp) {
-        bool list_started = FALSE; /* tells when we're starting a reply list for the
-				      first time */
-	while (bp) {
-	    if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
-	      /* JK: just skip this line and the following which is just our
-	       empty marker. */
-	      bp = bp->next;
-	      bp = bp->next;
-	      continue;
-	    }
-	    if (!strncmp(bp->line, " [ <a href=\"#replies\">", 22)) {
-	      list_started = TRUE; 
-	      fprintf (fp, "%s", bp->line);
-	      bp = bp->next;
-	      continue;
-	    }
-	    if (!strncmp(bp->line, "<!-- ureply", 11)) {
-	      if (list_started == FALSE)
-		fprintf (fp, " [ <a href=\"#replies\">%s</a> ]\n", 
-			 lang[MSG_REPLIES]);
-	      fprintf (fp, "%s", bp->line);
-	      bp = bp->next;
-	      continue;
-	    }
-	    if (!strncmp(bp->line, "<!-- lreply", 11)) {
-	        char *del_msg = (email2->is_deleted ? lang[MSG_DEL_SHORT] : "");
-		char *ptr1;
+    bool list_started = FALSE; /* tells when we're starting a reply list for the
+				  first time */
+    while (bp) {
+	if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
+	  /* JK: just skip this line and the following which is just our
+	   empty marker. */
+	  bp = bp->next;
+	  bp = bp->next;
+	  continue;
+	}
+	if (!strncmp(bp->line, " [ <a href=\"#replies\">", 22)) {
+	  list_started = TRUE; 
+	  PushString(&out, bp->line);
+	  bp = bp->next;
+	  continue;
+	}
+	if (!strncmp(bp->line, "<!-- ureply", 11)) {
+	  if (list_started == FALSE)
+	    patch_printf(&out, " [ <a href=\"#replies\">%s</a> ]\n", 
+		     lang[MSG_REPLIES]);
+	  PushString(&out, bp->line);
+	  bp = bp->next;
+	  continue;
+	}
+	if (!strncmp(bp->line, "<!-- lreply", 11)) {
+	    char *del_msg = (email2->is_deleted ? lang[MSG_DEL_SHORT] : "");
+	    char *ptr1;
 #ifdef HAVE_ICONV
-		ptr=strsav(numsubject);
+	    ptr=strsav(numsubject);
 #else
-		ptr = convchars(email->subject, email->charset);
+	    ptr = convchars(email->subject, email->charset);
 #endif
-		if (list_started == FALSE) {
-		  list_started = TRUE;
-		  trio_asprintf(&ptr1,
-				"<li><a name=\"replies\" id=\"replies\"></a>"
-				"<dfn>%s</dfn>: %s <a href=\"%s\" title=\"%s\">"
-				"%s: \"%s\"</a></li>\n",
-				lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
-				del_msg, msg_href(email, email2, FALSE), 
-				lang[MSG_LTITLE_REPLIES],
+	    if (list_started == FALSE) {
+	      list_started = TRUE;
+	      trio_asprintf(&ptr1,
+			    "<li><a name=\"replies\" id=\"replies\"></a>"
+			    "<dfn>%s</dfn>: %s <a href=\"%s\" title=\"%s\">"
+			    "%s: \"%s\"</a></li>\n",
+			    lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
+			    del_msg, msg_href(email, email2, FALSE), 
+			    lang[MSG_LTITLE_REPLIES],
 #ifdef HAVE_ICONV
-				numname, ptr);
+			    numname, ptr);
 #else
-				email->name, ptr);
+			    email->name, ptr);
 #endif
-		}
-		else
-		  trio_asprintf(&ptr1,
-				"<li><dfn>%s</dfn>: %s <a href=\"%s\" title=\"%s\">"
-				"%s: \"%s\"</a></li>\n",
-				lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
-				del_msg, msg_href(email, email2, FALSE), 
-				lang[MSG_LTITLE_REPLIES],
+	    }
+	    else
+	      trio_asprintf(&ptr1,
+			    "<li><dfn>%s</dfn>: %s <a href=\"%s\" title=\"%s\">"
+			    "%s: \"%s\"</a></li>\n",
+			    lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
+			    del_msg, msg_href(email, email2, FALSE), 
+			    lang[MSG_LTITLE_REPLIES],
 #ifdef HAVE_ICONV
-				numname, ptr);
+			    numname, ptr);
 #else
-				email->name, ptr);
+			    email->name, ptr);
 #endif
-		free(ptr);
+	    free(ptr);
 
-		if (!last_reply || strcmp(ptr1, last_reply))
-		    fputs(ptr1, fp);
-		free(ptr1);
-	    }
-	    else if (!strncmp(bp->line, "<!-- reply", 10)) {
-	      /* backwards compatiblity with the pre-WAI code */
-	        char *del_msg = (email2->is_deleted ? lang[MSG_DEL_SHORT] : "");
-		char *ptr1;
+	    if (!last_reply || strcmp(ptr1, last_reply))
+		PushString(&out, ptr1);
+	    free(ptr1);
+	}
+	else if (!strncmp(bp->line, "<!-- reply", 10)) {
+	  /* backwards compatiblity with the pre-WAI code */
+	    char *del_msg = (email2->is_deleted ? lang[MSG_DEL_SHORT] : "");
+	    char *ptr1;
 #ifdef HAVE_ICONV
-		ptr=strsav(email->subject);
+	    ptr=strsav(email->subject);
 #else
-		ptr = convchars(email->subject, email->charset);
+	    ptr = convchars(email->subject, email->charset);
 #endif
-		trio_asprintf(&ptr1,
-			      "<li><strong>%s:</strong>%s %s%s: \"%s\"</a></li>\n",
-			      lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
-			      del_msg, msg_href(email, email2, TRUE),
+	    trio_asprintf(&ptr1,
+			  "<li><strong>%s:</strong>%s %s%s: \"%s\"</a></li>\n",
+			  lang[subjmatch ? MSG_MAYBE_REPLY : MSG_REPLY],
+			  del_msg, msg_href(email, email2, TRUE),
 #ifdef HAVE_ICONV
-			      numname, ptr);
+			  numname, ptr);
 #else
-			      email->name, ptr);
+			  email->name, ptr);
 #endif
-		free(ptr);
-
-		if (!last_reply || strcmp(ptr1, last_reply))
-		    fputs(ptr1, fp);
-		free(ptr1);
-	    }
-	    if (next_in_thread - 1 == replynum
-		&& (strcasestr(bp->line, current_next_pattern)
-		    || strcasestr(bp->line, old2_next_pattern)
-		    || strstr(bp->line, old_next_pattern))) {
-	        bp = bp->next;
-		continue; /* line duplicates next in thread; suppress */
-	    }
+	    free(ptr);
 
-	    if (!remove_maybes
-		|| strncasecmp(bp->line, current_maybe_pattern, strlen(current_maybe_pattern))
-		|| strncasecmp(bp->line, current_link_maybe_pattern, 
-			       strlen(current_link_maybe_pattern))
-		|| strncasecmp(bp->line, old2_link_maybe_pattern, 
-			       strlen(old2_link_maybe_pattern))
-		|| strncasecmp(bp->line, old_maybe_pattern, strlen(old_maybe_pattern)))
-	        fprintf(fp, "%s", bp->line); /* not redundant or disproven */
-	    if (set_linkquotes && (strcasestr(bp->line, current_reply_pattern)
-				   || strcasestr(bp->line, current_link_reply_pattern)
-				   || strcasestr(bp->line, old2_reply_pattern)
-				   || strcasestr(bp->line, old2_link_reply_pattern)
-				   || strstr(bp->line, old_reply_pattern)))
-	        last_reply = bp->line;
+	    if (!last_reply || strcmp(ptr1, last_reply))
+		PushString(&out, ptr1);
+	    free(ptr1);
+	}
+	if (next_in_thread - 1 == replynum
+	    && (strcasestr(bp->line, current_next_pattern)
+		|| strcasestr(bp->line, old2_next_pattern)
+		|| strstr(bp->line, old_next_pattern))) {
 	    bp = bp->next;
+	    continue; /* line duplicates next in thread; suppress */
 	}
-    }
-    fclose(fp);
 
-    /* can we clean up a bit please... */
-    free_body(cp);
-    free(filename);
+	if (!remove_maybes
+	    || strncasecmp(bp->line, current_maybe_pattern, strlen(current_maybe_pattern))
+	    || strncasecmp(bp->line, current_link_maybe_pattern, 
+			   strlen(current_link_maybe_pattern))
+	    || strncasecmp(bp->line, old2_link_maybe_pattern, 
+			   strlen(old2_link_maybe_pattern))
+	    || strncasecmp(bp->line, old_maybe_pattern, strlen(old_maybe_pattern)))
+	    PushString(&out, bp->line); /* not redundant or disproven */
+	if (set_linkquotes && (strcasestr(bp->line, current_reply_pattern)
+			       || strcasestr(bp->line, current_link_reply_pattern)
+			       || strcasestr(bp->line, old2_reply_pattern)
+			       || strcasestr(bp->line, old2_link_reply_pattern)
+			       || strstr(bp->line, old_reply_pattern)))
+	    last_reply = bp->line;
+	bp = bp->next;
+    }
+    patch_done(pg, &out);
 }
 
 /*
@@ -4758,48 +5068,39 @@ void fixreplyheader(char *dir, int num, int remove_maybes, int max_update)
 
 void fixthreadheader(char *dir, int num, int max_update)
 {
-    char *filename;
-    char line[MAXLINE];
     char *name = NULL;
     char *subject = NULL;
-    FILE *fp;
+    struct patchpage *pg;
     struct reply *rp;
-    struct body *bp, *cp;
-    struct body *lp = NULL;
+    struct body *bp;
+    struct Push out;
     int threadnum = 0;
     char *ptr;
 
-    for (rp = threadlist; rp != NULL; rp = rp->next) {
-	if (rp->next != NULL &&
-	    (rp->next->data && rp->next->data->msgnum == num) &&
-	    (rp->data && rp->msgnum != -1)
-	    ) {
-
-	    threadnum = rp->msgnum;
-	    name = rp->next->data->name;
-	    subject = rp->next->data->subject;
-	    break;
+    if (patch_threadprev)
+	rp = (num >= 0 && num < patch_count) ? patch_threadprev[num] : NULL;
+    else {
+	for (rp = threadlist; rp != NULL; rp = rp->next) {
+	    if (rp->next != NULL &&
+		(rp->next->data && rp->next->data->msgnum == num) &&
+		(rp->data && rp->msgnum != -1)
+		)
+		break;
 	}
     }
+    if (rp != NULL) {
+	threadnum = rp->msgnum;
+	name = rp->next->data->name;
+	subject = rp->next->data->subject;
+    }
 
     if (rp == NULL || threadnum >= max_update)
 	return;
 
-    filename = articlehtmlfilename(rp->data);
-
-    bp = NULL;
-    if ((fp = fopen(filename, "r")) != NULL) {
-	while ((fgets(line, MAXLINE, fp)) != NULL)
-	    bp = addbody(bp, &lp, line, 0);
-    }
-    else {
-	free(filename);
+    if ((pg = patch_load(rp->data)) == NULL)
 	return;
-    }
-
-    fclose(fp);
-
-    cp = bp;			/* save start of list to free later */
+    bp = pg->bp;
+    INIT_PUSH(out);
 
 #ifdef HAVE_ICONV
     char *numsubject,*numname;
@@ -4808,79 +5109,73 @@ void fixthreadheader(char *dir, int num, int max_update)
     numname=i18n_utf2numref(name,1);
 #endif
 
-    if ((fp = fopen(filename, "w+")) != NULL) {
-	while (bp != NULL) {
-	   if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
-	      /* JK: just skip this line and the following which is just our
-	       empty marker. */
-	      bp = bp->next;
-	      bp = bp->next;
-	      continue;
-	    }
-	   /* @@ JK: don't I have the charset here? */
-	    fprintf(fp, "%s", bp->line);
-	    if (!strncmp(bp->line, "<!-- unextthr", 13)) {
-	      struct emailinfo *e3;
-	      if (hashnumlookup(num, &e3)) {
-		fprintf (fp, " [ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n",
-			 msg_href (e3, rp->data, FALSE), 
+    while (bp != NULL) {
+       if (!strncmp(bp->line, "<!-- emptylink=", 15)) {
+	  /* JK: just skip this line and the following which is just our
+	   empty marker. */
+	  bp = bp->next;
+	  bp = bp->next;
+	  continue;
+	}
+       /* @@ JK: don't I have the charset here? */
+	PushString(&out, bp->line);
+	if (!strncmp(bp->line, "<!-- unextthr", 13)) {
+	  struct emailinfo *e3;
+	  if (hashnumlookup(num, &e3)) {
+	    patch_printf(&out, " [ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n",
+		     msg_href (e3, rp->data, FALSE), 
 #ifdef HAVE_ICONV
-			 numname, numsubject,
+		     numname, numsubject,
 #else
-			 name, ptr = convchars(subject, NULL),
+		     name, ptr = convchars(subject, NULL),
 #endif
-			 lang[MSG_NEXT_IN_THREAD]);
-		if (ptr)
-		  free (ptr);
-		if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
-		  bp = bp->next; /* skip old copy of this line */
-	      }
-	    }
-	    else if (!strncmp(bp->line, "<!-- lnextthr", 13)) {
-	      struct emailinfo *e3;
-	      if (hashnumlookup(num, &e3)) {
-		fprintf(fp, "<li><dfn>%s</dfn>: ",
-			lang[MSG_NEXT_IN_THREAD]);
-		fprintf(fp, "<a href=\"%s\" title=\"\%s\">%s: \"%s\"</a></li>\n", 
-			msg_href(e3, rp->data, FALSE), lang[MSG_LTITLE_NEXT_IN_THREAD],
+		     lang[MSG_NEXT_IN_THREAD]);
+	    if (ptr)
+	      free (ptr);
+	    if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
+	      bp = bp->next; /* skip old copy of this line */
+	  }
+	}
+	else if (!strncmp(bp->line, "<!-- lnextthr", 13)) {
+	  struct emailinfo *e3;
+	  if (hashnumlookup(num, &e3)) {
+	    patch_printf(&out, "<li><dfn>%s</dfn>: ",
+		    lang[MSG_NEXT_IN_THREAD]);
+	    patch_printf(&out, "<a href=\"%s\" title=\"\%s\">%s: \"%s\"</a></li>\n", 
+		    msg_href(e3, rp->data, FALSE), lang[MSG_LTITLE_NEXT_IN_THREAD],
 #ifdef HAVE_ICONV
-		  numname, numsubject);
-                ptr=NULL;
+	      numname, numsubject);
+	    ptr=NULL;
 #else
-			name, ptr = convchars(subject, NULL));
+		    name, ptr = convchars(subject, NULL));
 #endif
-		if (ptr)
-		  free(ptr);
-		if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
-		  bp = bp->next; /* skip old copy of this line */
-	      }
-	    }
-	    else if (!strncmp(bp->line, "<!-- nextthr", 12)) {
-		struct emailinfo *e3;
-		if(hashnumlookup(num, &e3)) {
-		    fprintf(fp, "<li><strong>%s:</strong> ",
-			    lang[MSG_NEXT_IN_THREAD]);
-		    fprintf(fp, "%s", msg_href(e3, rp->data, TRUE));
-		    fprintf(fp, "%s: \"%s\"</a></li>\n",
+	    if (ptr)
+	      free(ptr);
+	    if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
+	      bp = bp->next; /* skip old copy of this line */
+	  }
+	}
+	else if (!strncmp(bp->line, "<!-- nextthr", 12)) {
+	    struct emailinfo *e3;
+	    if(hashnumlookup(num, &e3)) {
+		patch_printf(&out, "<li><strong>%s:</strong> ",
+			lang[MSG_NEXT_IN_THREAD]);
+		PushString(&out, msg_href(e3, rp->data, TRUE));
+		patch_printf(&out, "%s: \"%s\"</a></li>\n",
 #ifdef HAVE_ICONV
-			    numname, numsubject);
-                    ptr=NULL;
+			numname, numsubject);
+		ptr=NULL;
 #else
-			    name, ptr = convchars(subject, NULL));
+			name, ptr = convchars(subject, NULL));
 #endif
-		    free(ptr);
-		    if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
-		        bp = bp->next; /* skip old copy of this line */
-		}
+		free(ptr);
+		if (bp->next && strstr(bp->next->line, lang[MSG_NEXT_IN_THREAD]))
+		    bp = bp->next; /* skip old copy of this line */
 	    }
-	    bp = bp->next;
 	}
+	bp = bp->next;
     }
-    fclose(fp);
-
-    /* can we clean up a bit please... */
-    free_body(cp);
-    free(filename);
+    patch_done(pg, &out);
 }
 
 int count_deleted(int limit)
@@ -12,16 +12,19 @@ char *getid(char *);
 char *getsubject(char *);
 char *getreply(char *);
 void print_progress(int, char *, char *);
+void release_bodies(int);
 int parsemail(char *, int, int, int, char *, int, int);
 int parse_old_html(int, struct emailinfo *, int, int, struct reply **, int);
 int loadoldheaders(char *);
-int loadoldheadersfromGDBMindex(char *, int);
+int loadoldheadersfromGDBMindex(int);
 void crossindex(void);
-void crossindexthread1(struct header *);
+void crossindexthread1(struct headerlist *);
 void crossindexthread2(int);
 void fixnextheader(char *, int, int);
 void fixreplyheader(char *, int, int, int);
 void fixthreadheader(char *, int, int);
+void patch_begin(void);
+void patch_flush(void);
 int isre(char *, char **);
 char *findre(char *, char **);
 int textcontent(char *);
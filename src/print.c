@@ -32,6 +32,7 @@
 #include "finelink.h"
 
 #include "threadprint.h"
+#include "hdrindex.h"
 
 #include "proto.h"
 
@@ -53,6 +54,12 @@
 #include <string.h>
 #endif
 
+#if defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H)
+#include <sys/wait.h>
+#define PARALLEL_WRITE
+#define WRITE_BLOCK 32		/* messages handed to a writer at a time */
+#endif
+
 /* conditions that say when a message's body may be removed */
 #define REMOVE_MESSAGE(email) (email->is_deleted && set_delete_level != DELETE_LEAVES_TEXT \
 			       && !(email->is_deleted == 2 && set_delete_level == DELETE_LEAVES_EXPIRED_TEXT))
@@ -190,13 +197,13 @@ void fprint_menu(FILE *fp, mindex_t idx, char *archives, char *currentid, char *
 #if DEBUG_HTML
     printcomment(fp, "fprint_menu", "begin");
 #endif
-	fprintf(fp, "<div class=\"center\">\n<table border=\"2\" width=\"100%%\" class=\"links\">\n<tr>\n");
+	hm_fprintf(fp, "<div class=\"center\">\n<table border=\"2\" width=\"100%%\" class=\"links\">\n<tr>\n");
 
     if (set_mailcommand) {
 	if (set_hmail) {
 			ptr = makemailcommand(set_newmsg_command, set_hmail, currentid, cursub);
 			if (strcmp(ptr, "NONE") != 0)
-				fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", ptr ? ptr : "", lang[MSG_NEW_MESSAGE]);
+				hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", ptr ? ptr : "", lang[MSG_NEW_MESSAGE]);
 	    if (ptr)
 		free(ptr);
 
@@ -204,7 +211,7 @@ void fprint_menu(FILE *fp, mindex_t idx, char *archives, char *currentid, char *
 
 				ptr = makemailcommand(set_replymsg_command, set_hmail, currentid, cursub);
 				if (strcmp(ptr, "NONE") != 0)
-					fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", ptr ? ptr : "", lang[MSG_REPLY]);
+					hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", ptr ? ptr : "", lang[MSG_REPLY]);
 		if (ptr)
 		    free(ptr);
 	    }
@@ -212,26 +219,26 @@ void fprint_menu(FILE *fp, mindex_t idx, char *archives, char *currentid, char *
     }
 
     if (set_about && *set_about)
-		fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", set_about, lang[MSG_ABOUT_THIS_LIST]);
+		hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", set_about, lang[MSG_ABOUT_THIS_LIST]);
 
     if (set_show_index_links && set_show_index_links != (pos == PAGE_TOP ? 4 : 3)) {
         if (idx != NO_INDEX && !set_reverse) {
 	    if (pos == PAGE_TOP)
-				fprintf(fp, "<th><a href=\"#end\">%s</a></th>\n", lang[MSG_END_OF_MESSAGES]);
+				hm_fprintf(fp, "<th><a href=\"#end\">%s</a></th>\n", lang[MSG_END_OF_MESSAGES]);
 	    else
-				fprintf(fp, "<th><a name=\"end\" href=\"#\">%s</a></th>\n", lang[MSG_START_OF_MESSAGES]);
+				hm_fprintf(fp, "<th><a name=\"end\" href=\"#\">%s</a></th>\n", lang[MSG_START_OF_MESSAGES]);
 	}
 
 	for (i = 0; i <= AUTHOR_INDEX; ++i) {
 	    if (idx != i && show_index[dlev][i]) {
-				fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", index_name[dlev][i], lang[MSG_DATE_VIEW + i]);
+				hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", index_name[dlev][i], lang[MSG_DATE_VIEW + i]);
 		++count_l;
 	    }
 	}
 
 	if (show_index[dlev][ATTACHMENT_INDEX]) {
 	    if (idx != ATTACHMENT_INDEX) {
-				fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", index_name[dlev][ATTACHMENT_INDEX], lang[MSG_ATTACHMENT_VIEW]);
+				hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", index_name[dlev][ATTACHMENT_INDEX], lang[MSG_ATTACHMENT_VIEW]);
 		++count_l;
 	    }
 	}
@@ -239,20 +246,20 @@ void fprint_menu(FILE *fp, mindex_t idx, char *archives, char *currentid, char *
 	    int f_cols = (subdir->prior_subdir != NULL)
 	      + (subdir->next_subdir != NULL);
 			const char *colspan = 2 * f_cols <= count_l ? " colspan=\"2\"" : "";
-	    fprintf(fp, "</tr><tr>");
+	    hm_fprintf(fp, "</tr><tr>");
 	    if (subdir->prior_subdir)
-				fprintf(fp, "<th%s><a href=\"%s%s%s\">%s, %s</a></th>", colspan, subdir->rel_path_to_top, subdir->prior_subdir->subdir, index_name[dlev][idx], lang[MSG_PREV_DIRECTORY], lang[MSG_DATE_VIEW + idx]);
+				hm_fprintf(fp, "<th%s><a href=\"%s%s%s\">%s, %s</a></th>", colspan, subdir->rel_path_to_top, subdir->prior_subdir->subdir, index_name[dlev][idx], lang[MSG_PREV_DIRECTORY], lang[MSG_DATE_VIEW + idx]);
 	    if (subdir->next_subdir)
-				fprintf(fp, "<th%s><a href=\"%s%s%s\">%s, %s</a></th>", colspan, subdir->rel_path_to_top, subdir->next_subdir->subdir, index_name[dlev][idx], lang[MSG_NEXT_DIRECTORY], lang[MSG_DATE_VIEW + idx]);
+				hm_fprintf(fp, "<th%s><a href=\"%s%s%s\">%s, %s</a></th>", colspan, subdir->rel_path_to_top, subdir->next_subdir->subdir, index_name[dlev][idx], lang[MSG_NEXT_DIRECTORY], lang[MSG_DATE_VIEW + idx]);
 	    if (show_index[0][FOLDERS_INDEX])
-				fprintf(fp, "<th><a href=\"%s%s\">%s</a></th>", subdir->rel_path_to_top, index_name[0][FOLDERS_INDEX], lang[MSG_FOLDERS_INDEX]);
+				hm_fprintf(fp, "<th><a href=\"%s%s\">%s</a></th>", subdir->rel_path_to_top, index_name[0][FOLDERS_INDEX], lang[MSG_FOLDERS_INDEX]);
 	}
     }
 
     if (archives && *archives)
-		fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
+		hm_fprintf(fp, "<th><a href=\"%s\">%s</a></th>\n", archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
 
-    fprintf(fp, "</tr>\n</table>\n</div>\n");
+    hm_fprintf(fp, "</tr>\n</table>\n</div>\n");
 #if DEBUG_HTML
     printcomment(fp, "fprint_menu", "end");
 #endif
@@ -277,11 +284,11 @@ void fprint_menu0(FILE *fp, struct emailinfo *email, int pos)
 
   if (!(set_show_msg_links && set_show_msg_links != loc_cmp)
       || (set_show_index_links && set_show_index_links != loc_cmp)) {
-    fprintf(fp, "<ul class=\"links\">\n");
+    hm_fprintf(fp, "<ul class=\"links\">\n");
   }
 
   if (set_mailcommand && set_hmail) {
-    fprintf(fp, "<li><a name=\"%s\" id=\"%s\"></a><dfn>%s</dfn>:", 
+    hm_fprintf(fp, "<li><a name=\"%s\" id=\"%s\"></a><dfn>%s</dfn>:", 
 	    id,id,lang[MSG_MAIL_ACTIONS]);
     if ((email->msgid && email->msgid[0]) || (email->subject && email->subject[0])) {
 #ifdef HAVE_ICONV
@@ -289,7 +296,7 @@ void fprint_menu0(FILE *fp, struct emailinfo *email, int pos)
 #else
       ptr = makemailcommand(set_replymsg_command, set_hmail, email->msgid, email->subject);
 #endif
-      fprintf(fp, " [ <a href=\"%s\">%s</a> ]", ptr ? ptr : "", lang[MSG_MA_REPLY]);
+      hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", ptr ? ptr : "", lang[MSG_MA_REPLY]);
       if (ptr)
 	free(ptr);
     }
@@ -298,49 +305,49 @@ void fprint_menu0(FILE *fp, struct emailinfo *email, int pos)
 #else
     ptr = makemailcommand(set_newmsg_command, set_hmail, email->msgid, email->subject);
 #endif
-    fprintf(fp, " [ <a href=\"%s\">%s</a> ]", ptr ? ptr : "", lang[MSG_MA_NEW_MESSAGE]);
+    hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", ptr ? ptr : "", lang[MSG_MA_NEW_MESSAGE]);
     if (ptr)
       free(ptr);
-    fprintf (fp, "</li>\n");
+    hm_fprintf (fp, "</li>\n");
   }
 
   if (set_show_index_links && set_show_index_links != loc_cmp) {
-    fprintf (fp, "<li>");
+    hm_fprintf (fp, "<li>");
     /* add the anchor if we didn't do so in the above block */
     if (!(set_mailcommand && set_hmail))
-      fprintf (fp, "<a name=\"%s\" id=\"%s\"></a>",id,id);
-    fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_CONTEMPORARY_MSGS_SORTED]);
+      hm_fprintf (fp, "<a name=\"%s\" id=\"%s\"></a>",id,id);
+    hm_fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_CONTEMPORARY_MSGS_SORTED]);
     if (show_index[dlev][DATE_INDEX])
-      fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
+      hm_fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
 	      index_name[dlev][DATE_INDEX], set_fragment_prefix, num, 
 	      lang[MSG_LTITLE_BY_DATE], lang[MSG_BY_DATE]);
     if (show_index[dlev][THREAD_INDEX])
-      fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]",
+      hm_fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]",
 	      index_name[dlev][THREAD_INDEX], set_fragment_prefix, num, 
 	      lang[MSG_LTITLE_BY_THREAD], lang[MSG_BY_THREAD]);
     if (show_index[dlev][SUBJECT_INDEX])
-      fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
+      hm_fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
 	      index_name[dlev][SUBJECT_INDEX], set_fragment_prefix, num, 
 	      lang[MSG_LTITLE_BY_SUBJECT], lang[MSG_BY_SUBJECT]);
     if (show_index[dlev][AUTHOR_INDEX])
-      fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
+      hm_fprintf(fp, " [ <a href=\"%s#%s%d\" title=\"%s\">%s</a> ]", 
 	      index_name[dlev][AUTHOR_INDEX], set_fragment_prefix, num, 
 	      lang[MSG_LTITLE_BY_AUTHOR], lang[MSG_BY_AUTHOR]);
     if (show_index[dlev][ATTACHMENT_INDEX])
-      fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]", 
+      hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]", 
 	      index_name[dlev][ATTACHMENT_INDEX], 
 	      lang[MSG_LTITLE_BY_ATTACHMENT], lang[MSG_BY_ATTACHMENT]);
-    fprintf (fp, "</li>\n");
+    hm_fprintf (fp, "</li>\n");
     if (ihtmlhelpupfile)
-      fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelpupfile);
+      hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelpupfile);
   }
   
   if (set_custom_archives && *set_custom_archives)
-    fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], set_custom_archives);
+    hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], set_custom_archives);
 
   if (!(set_show_msg_links && set_show_msg_links != loc_cmp)
       || (set_show_index_links && set_show_index_links != loc_cmp)) {
-    fprintf (fp,"</ul>\n");
+    hm_fprintf (fp,"</ul>\n");
   }
 
 #ifdef HAVE_ICONV
@@ -357,19 +364,19 @@ void fprint_summary(FILE *fp, int pos, long first_d, long last_d, int num)
 #if DEBUG_HTML
     printcomment(fp, "fprint_summary", "begin");
 #endif
-    fprintf(fp, "<div class=\"center\">\n");
-    fprintf(fp, "<table>\n");
+    hm_fprintf(fp, "<div class=\"center\">\n");
+    hm_fprintf(fp, "<table>\n");
 
     if (pos == PAGE_TOP) {
-		fprintf(fp, "<tr>\n<th colspan=\"4\">%d %s</th>\n</tr>\n", num, lang[MSG_MESSAGES]);
-		fprintf(fp, "<tr>\n  <th>%s:</th><td><em>%s</em></td>\n", lang[MSG_STARTING], getdatestr(first_d));
-		fprintf(fp, "  <th>%s:</th><td><em>%s</em></td>\n</tr>\n", lang[MSG_ENDING], getdatestr(last_d));
+		hm_fprintf(fp, "<tr>\n<th colspan=\"4\">%d %s</th>\n</tr>\n", num, lang[MSG_MESSAGES]);
+		hm_fprintf(fp, "<tr>\n  <th>%s:</th><td><em>%s</em></td>\n", lang[MSG_STARTING], getdatestr(first_d));
+		hm_fprintf(fp, "  <th>%s:</th><td><em>%s</em></td>\n</tr>\n", lang[MSG_ENDING], getdatestr(last_d));
     }
     else { /* bottom of page */
-		fprintf(fp, "<tr><th><a name=\"end\">%s: </a></th><td><em>%s</em></td>\n", lang[MSG_LAST_MESSAGE_DATE], getdatestr(last_d));
-		fprintf(fp, "<th>%s: </th><td><em>%s</em></td>\n", lang[MSG_ARCHIVED_ON], getlocaltime());
+		hm_fprintf(fp, "<tr><th><a name=\"end\">%s: </a></th><td><em>%s</em></td>\n", lang[MSG_LAST_MESSAGE_DATE], getdatestr(last_d));
+		hm_fprintf(fp, "<th>%s: </th><td><em>%s</em></td>\n", lang[MSG_ARCHIVED_ON], getlocaltime());
     }
-    fprintf(fp, "</table>\n</div>\n");
+    hm_fprintf(fp, "</table>\n</div>\n");
 #if DEBUG_HTML
     printcomment(fp, "fprint_summary", "end");
 #endif
@@ -399,8 +406,8 @@ void print_index_header_links (FILE *fp, mindex_t called_from, long startdatenum
 #endif
 
 
-    fprintf(fp, "<map title=\"%s\" id=\"navbar\" name=\"navbar\">\n", lang[MSG_NAVBAR]);
-    fprintf(fp, "<ul>\n");
+    hm_fprintf(fp, "<map title=\"%s\" id=\"navbar\" name=\"navbar\">\n", lang[MSG_NAVBAR]);
+    hm_fprintf(fp, "<ul>\n");
     /*
      * Printout the Dates for the Starting and Ending messages 
      * in the archive, along with a count of the messages.
@@ -410,116 +417,116 @@ void print_index_header_links (FILE *fp, mindex_t called_from, long startdatenum
 	|| (called_from != DATE_INDEX && show_index[dlev][DATE_INDEX]) 
 	|| (called_from != THREAD_INDEX && show_index[dlev][THREAD_INDEX]) 
 	|| (called_from != SUBJECT_INDEX && show_index[dlev][SUBJECT_INDEX])) {
-      fprintf(fp, "<li><dfn><a href=\"#first\" title=\"jump to messages list\" "
+      hm_fprintf(fp, "<li><dfn><a href=\"#first\" title=\"jump to messages list\" "
 	      "tabindex=\"1\">%d %s</a></dfn>:"
 	      " <dfn>%s</dfn> %s,",
 	      amountmsgs, lang[MSG_ARTICLES],
 	      lang[MSG_STARTING], getdatestr(startdatenum));
-      fprintf(fp, " <dfn>%s</dfn> %s</li>\n",
+      hm_fprintf(fp, " <dfn>%s</dfn> %s</li>\n",
 	      lang[MSG_ENDING], getdatestr(enddatenum));
 
       if (!set_reverse && (called_from != AUTHOR_INDEX && called_from != SUBJECT_INDEX))
-	fprintf (fp, "<li><dfn>%s</dfn>: <a href=\"#end\">%s</a></li>\n", lang[MSG_THIS_PERIOD],
+	hm_fprintf (fp, "<li><dfn>%s</dfn>: <a href=\"#end\">%s</a></li>\n", lang[MSG_THIS_PERIOD],
 		 lang[MSG_MOST_RECENT_MESSAGES]);
 
-      fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_SORT_BY]);
+      hm_fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_SORT_BY]);
     }
 
     /* print the links to the other indexes */
     if (show_index[dlev][THREAD_INDEX]) {
       if (called_from != THREAD_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"t\" rel=\"alternate\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"t\" rel=\"alternate\">%s</a> ]\n", 
 		index_name[dlev][THREAD_INDEX], lang[MSG_LTITLE_BY_THREAD], lang[MSG_THREAD]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_THREAD]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_THREAD]);
     }
 
     if (show_index[dlev][AUTHOR_INDEX]) {
       if (called_from != AUTHOR_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"a\" rel=\"alternate\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"a\" rel=\"alternate\">%s</a> ]\n", 
 		index_name[dlev][AUTHOR_INDEX], lang[MSG_LTITLE_BY_AUTHOR], lang[MSG_AUTHOR]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_AUTHOR]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_AUTHOR]);
     }
 
     if (show_index[dlev][DATE_INDEX]) {
       if (called_from != DATE_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"d\" rel=\"alternate\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"d\" rel=\"alternate\">%s</a> ]\n", 
 		index_name[dlev][DATE_INDEX], lang[MSG_LTITLE_BY_DATE], lang[MSG_DATE]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_DATE]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_DATE]);
     }
 
     if (show_index[dlev][SUBJECT_INDEX]) {
       if (called_from != SUBJECT_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"s\" rel=\"alternate\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"s\" rel=\"alternate\">%s</a> ]\n", 
 		index_name[dlev][SUBJECT_INDEX],  lang[MSG_LTITLE_BY_SUBJECT], lang[MSG_SUBJECT]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_SUBJECT]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_SUBJECT]);
     }
 
     if (set_attachmentsindex) {
       if (called_from != ATTACHMENT_INDEX) {
-      fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"a\" rel=\"alternate\">%s</a> ]\n", 
+      hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\" accesskey=\"a\" rel=\"alternate\">%s</a> ]\n", 
 	      index_name[dlev][ATTACHMENT_INDEX],  lang[MSG_LTITLE_BY_ATTACHMENT],
 	      lang[MSG_ATTACHMENT]);
       }
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_ATTACHMENT]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_ATTACHMENT]);
     }
-    fprintf (fp, "</li>\n");
+    hm_fprintf (fp, "</li>\n");
 
     /* print the mail actions */
     if (set_mailcommand && set_hmail) {
       ptr = makemailcommand("mailto:$TO", set_hmail, "", "");
-      fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"%s\" accesskey=\"n\">%s</a> ]</li>\n",
+      hm_fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"%s\" accesskey=\"n\">%s</a> ]</li>\n",
 	       lang[MSG_MAIL_ACTIONS], ptr ? ptr : "", lang[MSG_MA_NEW_MESSAGE]);
       if (ptr)
 	free (ptr);
     }
 
     if (subdir) {
-      fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_OTHER_PERIODS]);
+      hm_fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_OTHER_PERIODS]);
       if (subdir->prior_subdir)
-	fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", 
+	hm_fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", 
 		subdir->rel_path_to_top, subdir->prior_subdir->subdir, 
 		index_name[dlev][called_from], 
 		lang[MSG_LTITLE_PREVPERIOD], lang[MSG_PREVPERIOD], 
 		lang[MSG_DATE_VIEW + called_from]);
       if (subdir->next_subdir)
-	fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", subdir->rel_path_to_top, 
+	hm_fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", subdir->rel_path_to_top, 
 		subdir->next_subdir->subdir, index_name[dlev][called_from], 
 		lang[MSG_LTITLE_NEXTPERIOD], lang[MSG_NEXTPERIOD], 
 		lang[MSG_DATE_VIEW + called_from]);
       if (show_index[0][FOLDERS_INDEX])
-	fprintf(fp, "[ <a href=\"%s%s\" title=\"%s\">%s</a> ]", subdir->rel_path_to_top, 
+	hm_fprintf(fp, "[ <a href=\"%s%s\" title=\"%s\">%s</a> ]", subdir->rel_path_to_top, 
 		index_name[0][FOLDERS_INDEX], lang[MSG_LTITLE_FOLDERS_INDEX], 
 		lang[MSG_FOLDERS_INDEX]);
-      fprintf (fp, "</li>\n");
+      hm_fprintf (fp, "</li>\n");
     }
     
     /* the following are the custom options */
     if (ihtmlhelpupfile)
-      fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelpupfile);     
+      hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelpupfile);     
 
     if ((set_about && *set_about) 
 	|| (set_archives && *set_archives))
       {
-	fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_NEARBY]);
+	hm_fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_NEARBY]);
 	if (set_about && *set_about)
-	  fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_about, lang[MSG_ABOUT_THIS_ARCHIVE]);
+	  hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_about, lang[MSG_ABOUT_THIS_ARCHIVE]);
 	
 	if (set_archives && *set_archives)
-	  fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
-	fprintf (fp, "</li>\n");
+	  hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
+	hm_fprintf (fp, "</li>\n");
 
       }
 
     if (set_custom_archives && *set_custom_archives)
-      fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], 
+      hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], 
 	      set_custom_archives);
 
-    fprintf (fp, "</ul>\n</map>\n");
+    hm_fprintf (fp, "</ul>\n</map>\n");
 
     /*
      * Printout the Dates for the Starting and Ending messages 
@@ -548,15 +555,15 @@ void print_index_footer_links(FILE *fp, mindex_t called_from, long enddatenum, i
     printcomment(fp, "index_footer_links", "begin");
 #endif
 
-    fprintf (fp, "<div class=\"foot\">\n");
-    fprintf (fp, "<map title=\"%s\" id=\"navbarfoot\" name=\"navbarfoot\">\n", lang[MSG_NAVBAR]);
-    fprintf (fp, "<ul>\n");
+    hm_fprintf (fp, "<div class=\"foot\">\n");
+    hm_fprintf (fp, "<map title=\"%s\" id=\"navbarfoot\" name=\"navbarfoot\">\n", lang[MSG_NAVBAR]);
+    hm_fprintf (fp, "<ul>\n");
     
     if ((called_from != AUTHOR_INDEX && show_index[dlev][AUTHOR_INDEX]) 
 	|| (called_from != DATE_INDEX && show_index[dlev][DATE_INDEX]) 
 	|| (called_from != THREAD_INDEX && show_index[dlev][THREAD_INDEX]) 
 	|| (called_from != SUBJECT_INDEX && show_index[dlev][SUBJECT_INDEX]))
-      fprintf(fp, "<li><dfn><a href=\"#first\">%d %s</a> "
+      hm_fprintf(fp, "<li><dfn><a href=\"#first\">%d %s</a> "
 	      "%s</dfn>:\n",
 	      amountmsgs, lang[MSG_ARTICLES],
 	      lang[MSG_SORT_BY]);
@@ -564,95 +571,95 @@ void print_index_footer_links(FILE *fp, mindex_t called_from, long enddatenum, i
         /* print the links to the other indexes */
     if (show_index[dlev][THREAD_INDEX]) {
       if (called_from != THREAD_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
 		index_name[dlev][THREAD_INDEX], lang[MSG_LTITLE_BY_THREAD], lang[MSG_THREAD]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_THREAD]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_THREAD]);
     }
 
     if (show_index[dlev][AUTHOR_INDEX]) {
       if (called_from != AUTHOR_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
 		index_name[dlev][AUTHOR_INDEX], lang[MSG_LTITLE_BY_AUTHOR], lang[MSG_AUTHOR]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_AUTHOR]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_AUTHOR]);
     }
 
     if (show_index[dlev][DATE_INDEX]) {
       if (called_from != DATE_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
 		index_name[dlev][DATE_INDEX], lang[MSG_LTITLE_BY_DATE], lang[MSG_DATE]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_DATE]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_DATE]);
     }
 
     if (show_index[dlev][SUBJECT_INDEX]) {
       if (called_from != SUBJECT_INDEX)
-	fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
+	hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
 		index_name[dlev][SUBJECT_INDEX], lang[MSG_LTITLE_BY_SUBJECT], lang[MSG_SUBJECT]);
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_SUBJECT]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_SUBJECT]);
     }
 
     if (set_attachmentsindex) {
       if (called_from != ATTACHMENT_INDEX) {
-      fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
+      hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s\">%s</a> ]\n", 
 	      index_name[dlev][ATTACHMENT_INDEX], lang[MSG_LTITLE_BY_ATTACHMENT], 
 	      lang[MSG_ATTACHMENT]);
       }
       else
-	fprintf(fp, " [ %s ]\n", lang[MSG_ATTACHMENT]);
+	hm_fprintf(fp, " [ %s ]\n", lang[MSG_ATTACHMENT]);
     }
-    fprintf (fp, "</li>\n");
+    hm_fprintf (fp, "</li>\n");
 
     /* print the mail actions */
     if (set_mailcommand && set_hmail) {
       ptr = makemailcommand("mailto:$TO", set_hmail, "", "");
-      fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"%s\">%s</a> ]</li>\n",
+      hm_fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"%s\">%s</a> ]</li>\n",
 	       lang[MSG_MAIL_ACTIONS], ptr ? ptr : "", lang[MSG_MA_NEW_MESSAGE]);
       if (ptr)
 	free (ptr);
     }
 
     if (subdir) {
-      fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_OTHER_PERIODS]);
+      hm_fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_OTHER_PERIODS]);
       if (subdir->prior_subdir)
-	fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", 
+	hm_fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", 
 		subdir->rel_path_to_top, subdir->prior_subdir->subdir, 
 		index_name[dlev][called_from], 
 		lang[MSG_LTITLE_PREVPERIOD], lang[MSG_PREVPERIOD], 
 		lang[MSG_DATE_VIEW + called_from]);
       if (subdir->next_subdir)
-	fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", subdir->rel_path_to_top, 
+	hm_fprintf(fp, "[ <a href=\"%s%s%s\" title=\"%s\">%s, %s</a> ] ", subdir->rel_path_to_top, 
 		subdir->next_subdir->subdir, index_name[dlev][called_from], 
 		lang[MSG_LTITLE_NEXTPERIOD], lang[MSG_NEXTPERIOD], 
 		lang[MSG_DATE_VIEW + called_from]);
       if (show_index[0][FOLDERS_INDEX])
-	fprintf(fp, "[ <a href=\"%s%s\" title=\"%s\">%s</a> ]", subdir->rel_path_to_top, 
+	hm_fprintf(fp, "[ <a href=\"%s%s\" title=\"%s\">%s</a> ]", subdir->rel_path_to_top, 
 		index_name[0][FOLDERS_INDEX], lang[MSG_LTITLE_FOLDERS_INDEX], 
 		lang[MSG_FOLDERS_INDEX]);
-      fprintf (fp, "</li>\n");
+      hm_fprintf (fp, "</li>\n");
     }
     
     if (ihtmlhelplowfile)
-      fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelplowfile);     
+      hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>", lang[MSG_HELP], ihtmlhelplowfile);     
 
     if ((set_about && *set_about) 
 	|| (set_archives && *set_archives))
       {
-	fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_NEARBY]);
+	hm_fprintf (fp, "<li><dfn>%s</dfn>:", lang[MSG_NEARBY]);
 	if (set_about && *set_about)
-	  fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_about, lang[MSG_ABOUT_THIS_ARCHIVE]);
+	  hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_about, lang[MSG_ABOUT_THIS_ARCHIVE]);
 	if (set_archives && *set_archives)
-	  fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
-	fprintf (fp, "</li>\n");
+	  hm_fprintf(fp, " [ <a href=\"%s\">%s</a> ]", set_archives, lang[MSG_OTHER_MAIL_ARCHIVES]);
+	hm_fprintf (fp, "</li>\n");
       }
 
     if (set_custom_archives && *set_custom_archives)
-      fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], 
+      hm_fprintf(fp, "<li><dfn>%s</dfn>: %s</li>\n", lang[MSG_OTHER_MAIL_ARCHIVES], 
 	      set_custom_archives);
     
-    fprintf (fp, "</ul>\n</map>\n");
+    hm_fprintf (fp, "</ul>\n</map>\n");
 
 #if DEBUG_HTML
     printcomment(fp, "index_footer_links", "end");
@@ -665,24 +672,24 @@ void print_haof_indices(FILE *fp, struct emailsubdir *subdir)
 {
     int dlev = (subdir != NULL);
 
-    fprintf(fp, "    <indices>\n");
+    hm_fprintf(fp, "    <indices>\n");
 
     if (show_index[dlev][DATE_INDEX])
-		fprintf(fp, "       <dateindex>%s</dateindex>\n", index_name[dlev][DATE_INDEX]);
+		hm_fprintf(fp, "       <dateindex>%s</dateindex>\n", index_name[dlev][DATE_INDEX]);
 
     if (show_index[dlev][SUBJECT_INDEX])
-		fprintf(fp, "       <subjectindex>%s</subjectindex>\n", index_name[dlev][SUBJECT_INDEX]);
+		hm_fprintf(fp, "       <subjectindex>%s</subjectindex>\n", index_name[dlev][SUBJECT_INDEX]);
 
     if (show_index[dlev][THREAD_INDEX])
-		fprintf(fp, "       <threadindex>%s</threadindex>\n", index_name[dlev][THREAD_INDEX]);
+		hm_fprintf(fp, "       <threadindex>%s</threadindex>\n", index_name[dlev][THREAD_INDEX]);
 
     if (show_index[dlev][AUTHOR_INDEX])
-		fprintf(fp, "       <authorindex>%s</authorindex>\n", index_name[dlev][AUTHOR_INDEX]);
+		hm_fprintf(fp, "       <authorindex>%s</authorindex>\n", index_name[dlev][AUTHOR_INDEX]);
 
     if (show_index[dlev][ATTACHMENT_INDEX])
-		fprintf(fp, "       <attachmentindex>%s</attachmentindex>\n", index_name[dlev][ATTACHMENT_INDEX]);
+		hm_fprintf(fp, "       <attachmentindex>%s</attachmentindex>\n", index_name[dlev][ATTACHMENT_INDEX]);
 
-    fprintf(fp, "    </indices>\n\n");
+    hm_fprintf(fp, "    </indices>\n\n");
 }
 
 /*
@@ -720,7 +727,7 @@ void printcomment(FILE *fp, char *label, char *value)
 	    ext_value = PUSH_STRING(retbuf);
 	}
 	
-	fprintf(fp, "<!-- %s=\"%s\" -->\n", ext_label, ext_value);
+	hm_fprintf(fp, "<!-- %s=\"%s\" -->\n", ext_label, ext_value);
 	if (ext_label != label)
 	    free(ext_label);
 	if (ext_value != value)
@@ -766,12 +773,38 @@ void printhtml(FILE *fp, char *line)
 
 }
 
+/*
+** The date, subject and author lists split up by folder, so that the
+** index pages of a folder only walk its own messages. They are there
+** while write_toplevel_indices() runs.
+*/
+
+static struct headerlist *folder_lists[3];
+
+static struct headerlist *folder_list(struct headerlist *list,
+				      struct emailinfo *subdir_email)
+{
+    int k = (list == datelist) ? 0 : (list == subjectlist) ? 1
+	    : (list == authorlist) ? 2 : -1;
+
+    if (k == -1 || !folder_lists[k] || !subdir_email || !subdir_email->subdir)
+	return list;
+    return folder_lists[k] + subdir_email->subdir->index;
+}
+
+static int folder_slot(struct emailinfo *em, void *arg)
+{
+    return em->subdir ? em->subdir->index : -1;
+}
+
 /*
 ** Pretty-prints the dates in the index files.
 */
-void printdates(FILE *fp, struct header *hp, int year, int month, struct emailinfo *subdir_email,
+void printdates(FILE *fp, struct headerlist *list, int year, int month, struct emailinfo *subdir_email,
 		char *prev_date_str)
 {
+  struct header *hp;
+  int pos = 0;
   char *subject=NULL,*name=NULL;
   const char *startline;
   const char *break_str;
@@ -781,11 +814,9 @@ void printdates(FILE *fp, struct header *hp, int year, int month, struct emailin
   static char date_str[DATESTRLEN+40]; /* made static for smaller stack */
   static char *first_attributes = "<a  accesskey=\"j\" name=\"first\" id=\"first\"></a>";
 
-  if (hp != NULL) {
+  while ((hp = header_next(list, &pos)) != NULL) {
     struct emailinfo *em=hp->data;
-    printdates(fp, hp->left, year, month, subdir_email, prev_date_str);
-    if ((year == -1 || year_of_datenum(em->date) == year)
-	&& (month == -1 || month_of_datenum(em->date) == month)
+    if (in_period(em, year, month)
 	&& !em->is_deleted
 	&& (!subdir_email || subdir_email->subdir == em->subdir)) {
 
@@ -811,14 +842,14 @@ void printdates(FILE *fp, struct header *hp, int year, int month, struct emailin
 	tmp = getdateindexdatestr(hp->data->date);
 	if (strcmp (prev_date_str, tmp)) {
 	  if (*prev_date_str)  { /* close the previous date item */
-	    fprintf (fp, "</ul></li>\n");
+	    hm_fprintf (fp, "</ul></li>\n");
 	    is_first = FALSE;
 	  }
 	  else
 	    is_first = TRUE;
 	  snprintf(date_str, sizeof(date_str), "<li>%s<dfn>%s</dfn><ul>\n", 
 		  (is_first) ? first_attributes : "", tmp);
-	  fprintf (fp, "%s", date_str);
+	  hm_fprintf (fp, "%s", date_str);
 	  strcpy (prev_date_str, tmp);
 	}
 	date_str[0] = 0;
@@ -829,7 +860,7 @@ void printdates(FILE *fp, struct header *hp, int year, int month, struct emailin
 	subj_end_tag = "";
       }
 
-      fprintf(fp,"%s<a href=\"%s\">%s%s%s</a>%s<a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a>%s%s%s\n",
+      hm_fprintf(fp,"%s<a href=\"%s\">%s%s%s</a>%s<a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a>%s%s%s\n",
 	      startline, msg_href(em, subdir_email, FALSE), 
 	      subj_tag, subject, subj_end_tag, break_str, 
 	      set_fragment_prefix, em->msgnum, set_fragment_prefix, em->msgnum, 
@@ -839,7 +870,6 @@ void printdates(FILE *fp, struct header *hp, int year, int month, struct emailin
       free(subject);
       free(name);
     }
-    printdates(fp, hp->right, year, month, subdir_email, prev_date_str);
   }
 }
 
@@ -847,8 +877,10 @@ void printdates(FILE *fp, struct header *hp, int year, int month, struct emailin
 ** Pretty-prints the files with attachments in the index files.
 ** Returns the number of attachments that were printed.
 */
-int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email, bool *is_first)
+int printattachments(FILE *fp, struct headerlist *list, struct emailinfo *subdir_email, bool *is_first)
 {
+    struct header *hp;
+    int pos = 0;
     char *subject=NULL,*name=NULL;
     char *attdir;
     char *msgnum;
@@ -857,9 +889,8 @@ int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email
 
     const char *rel_path_to_top = (subdir_email ? subdir_email->subdir->rel_path_to_top : "");
 
-    if (hp != NULL) {
+    while ((hp = header_next(list, &pos)) != NULL) {
 	struct emailinfo *em = hp->data;
-	nb_attach = printattachments(fp, hp->left, subdir_email, is_first);
 	if ((!subdir_email || subdir_email->subdir == em->subdir)
 	    && !em->is_deleted) {
             
@@ -875,10 +906,10 @@ int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email
 		/* consider that if there's an attachment directory, there are attachments */
 		nb_attach++;
 		if (set_indextable) {
-		  fprintf(fp, "<tr><td>%s%s</a></td><td><a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a></td>" "<td>%s</td></tr>\n", msg_href(em, subdir_email, TRUE), subject, set_fragment_prefix, em->msgnum, set_fragment_prefix, em->msgnum, name, getindexdatestr(em->date));
+		  hm_fprintf(fp, "<tr><td>%s%s</a></td><td><a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a></td>" "<td>%s</td></tr>\n", msg_href(em, subdir_email, TRUE), subject, set_fragment_prefix, em->msgnum, set_fragment_prefix, em->msgnum, name, getindexdatestr(em->date));
 		}
 		else {
-		  fprintf(fp, "<li>%s%s<dfn>%s</dfn></a>&nbsp;" 
+		  hm_fprintf(fp, "<li>%s%s<dfn>%s</dfn></a>&nbsp;" 
 			  "<a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a>&nbsp;<em>(%s)</em>\n", 
 			  (*is_first) ? first_attributes : "",
 			  msg_href(em, subdir_email, TRUE), subject, 
@@ -907,7 +938,7 @@ int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email
 			nb_attach++;
 			if (first_time && !set_indextable) {
 			    first_time = 0;
-			    fprintf(fp, "<ol>\n");
+			    hm_fprintf(fp, "<ol>\n");
 			}
 			trio_asprintf(&filename, "%s%c%s", attdir, PATH_SEPARATOR, entry->d_name);
 			if (!stat(filename, &fileinfo))
@@ -916,13 +947,13 @@ int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email
 			trio_asprintf(&filename, DIR_PREFIXER "%s%c%s", message_name(em), PATH_SEPARATOR, entry->d_name);
 			stripped_filename = strchr(entry->d_name, '-');
 			if (stripped_filename)
-				fprintf(fp, fmt2, rel_path_to_top, filename, stripped_filename + 1, file_size, lang[MSG_BYTES]);
+				hm_fprintf(fp, fmt2, rel_path_to_top, filename, stripped_filename + 1, file_size, lang[MSG_BYTES]);
 			else if(strcmp(entry->d_name, ".meta"))
-				fprintf(fp, fmt2, rel_path_to_top, filename, entry->d_name, file_size, lang[MSG_BYTES]);
+				hm_fprintf(fp, fmt2, rel_path_to_top, filename, entry->d_name, file_size, lang[MSG_BYTES]);
 			free(filename);
 		    }
 		    if (!first_time && !set_indextable) {
-		        fprintf(fp, "</ol></li>\n");
+		        hm_fprintf(fp, "</ol></li>\n");
 		    }
 		    closedir(dir);
 		}
@@ -935,7 +966,6 @@ int printattachments(FILE *fp, struct header *hp, struct emailinfo *subdir_email
                 free(name);
             }
 	}
-	nb_attach += printattachments(fp, hp->right, subdir_email, is_first);
     }
     return nb_attach;
 }
@@ -1138,8 +1168,8 @@ void printheaders (FILE *fp, struct emailinfo *email)
 	d_index = MSG_EXPIRED;
       if (email->is_deleted == 4 || email->is_deleted == 8)
 	d_index = MSG_FILTERED_OUT;
-      fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
-      fprintf(fp, "<span id=\"deleted\">(%s)</span>\n", lang[d_index]);
+      hm_fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
+      hm_fprintf(fp, "<span id=\"deleted\">(%s)</span>\n", lang[d_index]);
       return;
     }
     
@@ -1158,7 +1188,7 @@ void printheaders (FILE *fp, struct emailinfo *email)
 	  /* we print the header, escaping it as needed */
 
 	  header_content = bp->line + strlen (head) + 2;
-	  fprintf (fp, "<span id=\"%s\"><dfn>%s</dfn>: ",
+	  hm_fprintf (fp, "<span id=\"%s\"><dfn>%s</dfn>: ",
 		   head_lower, head);
 
 
@@ -1180,7 +1210,7 @@ void printheaders (FILE *fp, struct emailinfo *email)
 	    ConvURLs(fp, header_content, id, subject, email->charset);
 #endif
 	  }
-	  fprintf (fp, "</span><br />\n");
+	  hm_fprintf (fp, "</span><br />\n");
 	}
 	
 	/* go to the next header or stop if we reached the end of the headers 
@@ -1246,35 +1276,35 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
       switch(d_index) {
       case MSG_DELETED:
 	if(set_htmlmessage_deleted_spam){
-	  fprintf(fp,"%s\n",set_htmlmessage_deleted_spam);
+	  hm_fprintf(fp,"%s\n",set_htmlmessage_deleted_spam);
 	  break;
 	}
       case MSG_DELETED_OTHER:
 	if(set_htmlmessage_deleted_other){
-	  fprintf(fp,"%s\n",set_htmlmessage_deleted_other);
+	  hm_fprintf(fp,"%s\n",set_htmlmessage_deleted_other);
 	  break;
 	}
       default:
-	fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
-	fprintf(fp, "<p>%s</p>\n", lang[d_index]);
+	hm_fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
+	hm_fprintf(fp, "<p>%s</p>\n", lang[d_index]);
       }
       return;
     }
     
     if (email->annotation_content == ANNOTATION_CONTENT_EDITED) {
       if (set_htmlmessage_edited)
-	fprintf(fp,"%s\n",set_htmlmessage_edited);
+	hm_fprintf(fp,"%s\n",set_htmlmessage_edited);
       else
-	fprintf(fp, "<p>%s</p>\n", lang[MSG_EDITED]);
+	hm_fprintf(fp, "<p>%s</p>\n", lang[MSG_EDITED]);
     }
 
     if (!set_showhtml) {
-	fprintf(fp, "<pre id=\"body\">\n");
+	hm_fprintf(fp, "<pre id=\"body\">\n");
 	pre = TRUE;
     }
 
     /* tag the start of the message body */
-    fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
+    hm_fprintf(fp, "<a name=\"start\" accesskey=\"j\" id=\"start\"></a>");
 
     if (set_showhtml == 2)
       init_txt2html();
@@ -1288,7 +1318,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	if (bp->html) {
 	  /* already in HTML, don't touch */
   	  if (pre) {
-	    fprintf(fp, "</pre>\n");
+	    hm_fprintf(fp, "</pre>\n");
 	    pre = FALSE;
 	  }
 	  printhtml(fp, bp->line);
@@ -1302,7 +1332,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	    if (!inheader) {
               /* JK: I'm not sure why, but I had a !set_showhtml here */
 	      if (!set_showhtml && !pre && set_showheaders) {
-		fprintf(fp, "<pre>\n");
+		hm_fprintf(fp, "<pre>\n");
 		pre = TRUE;
 	      }
 	      inheader = TRUE;
@@ -1323,14 +1353,14 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	    insig = 0;
 	    if (set_showhtml) {
 	      if (pre) {
-		fprintf(fp, "</pre>\n");
+		hm_fprintf(fp, "</pre>\n");
 		pre = FALSE;
 	      }
-	      fprintf(fp, "<br />\n");
+	      hm_fprintf(fp, "<br />\n");
 	    }
 	    else {
 	      if (!pre) {
-		fprintf(fp, "<pre>\n");
+		hm_fprintf(fp, "<pre>\n");
 		pre = TRUE;
 	      }
 	    }
@@ -1350,7 +1380,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	}
 
         if (bp->header && set_showheaders && !pre) {
-	  fprintf(fp, "<pre>\n");
+	  hm_fprintf(fp, "<pre>\n");
 	  pre = TRUE;
 	}
  
@@ -1365,7 +1395,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	  if (is_sig_start(bp->line)) {
 	    insig = 1;
 	    if (!pre) {
-	      fprintf(fp, "<pre>\n");
+	      hm_fprintf(fp, "<pre>\n");
 	      pre = TRUE;
 	    }
 	  }
@@ -1377,7 +1407,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	       Akis Karnouskos <akis@ceid.upatras.gr>     */
 	    {
 	      if (!pre)
-		fprintf(fp, "<br />");
+		hm_fprintf(fp, "<br />");
 	    }
 	  else {
 	    if (insig) {
@@ -1391,11 +1421,11 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 		}
 	      }
 	      else {
-		fprintf(fp, "<%s class=\"%s\">", set_iquotes ? "em" : "span", find_quote_class(bp->line));
+		hm_fprintf(fp, "<%s class=\"%s\">", set_iquotes ? "em" : "span", find_quote_class(bp->line));
 
 		ConvURLs(fp, bp->line, id, subject, email->charset);
 		
-		fprintf(fp, "%s<br />\n", (set_iquotes) ? "</em>" : "</span>");
+		hm_fprintf(fp, "%s<br />\n", (set_iquotes) ? "</em>" : "</span>");
 	      }
 	    }
 	    else if ((bp->line)[0] != '\0' && !bp->header) {
@@ -1422,9 +1452,9 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
 	       */
 	      
 	      if ((set_showbr && !bp->header) || ((bp->next != NULL) && !isalnum(bp->next->line[0])))
-		fprintf(fp, "<br />");
+		hm_fprintf(fp, "<br />");
 	      if (!bp->header) {
-		fprintf(fp, "\n");
+		hm_fprintf(fp, "\n");
 	      }
 	    }
 	    
@@ -1448,7 +1478,7 @@ void printbody(FILE *fp, struct emailinfo *email, int maybe_reply, int is_reply)
     }
 
     if (pre)
-      fprintf(fp, "</pre>\n");
+      hm_fprintf(fp, "</pre>\n");
     else if (set_showhtml == 2)
       end_txt2html(fp);
 }
@@ -1457,9 +1487,9 @@ char *print_leading_whitespace(FILE *fp, char *sp)
 {
     while (*sp && (*sp == ' ' || *sp == '\t')) {
         if (*sp == '\t')
-	    fprintf(fp, "&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;");
+	    hm_fprintf(fp, "&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;");
 	else
-	    fprintf(fp, "&nbsp;");
+	    hm_fprintf(fp, "&nbsp;");
 	sp++;
     }
     return sp;
@@ -1472,7 +1502,7 @@ void print_headers(FILE *fp, struct emailinfo *email, int in_thread_file)
    * General form: <span><dfn>from:<dfn>: name <email></span><br /> 
    */
 
-  fprintf(fp, "<address class=\"headers\">\n");
+  hm_fprintf(fp, "<address class=\"headers\">\n");
 
 #ifdef HAVE_ICONV
   size_t tmplen;
@@ -1486,11 +1516,11 @@ void print_headers(FILE *fp, struct emailinfo *email, int in_thread_file)
 #endif
   
   /* the from header */
-  fprintf (fp, "<span id=\"from\">\n");
-  fprintf (fp, "<dfn>%s</dfn>: ", lang[MSG_FROM]);
+  hm_fprintf (fp, "<span id=\"from\">\n");
+  hm_fprintf (fp, "<dfn>%s</dfn>: ", lang[MSG_FROM]);
   if (REMOVE_MESSAGE(email)) {
     /* don't show the email address and name if we have deleted the message */
-    fprintf(fp, "&lt;%s&gt;", lang[MSG_SENDER_DELETED]);
+    hm_fprintf(fp, "&lt;%s&gt;", lang[MSG_SENDER_DELETED]);
   } 
   else if (!strcmp(email->name, email->emailaddr)) {
     if (use_mailcommand) {
@@ -1501,13 +1531,13 @@ void print_headers(FILE *fp, struct emailinfo *email, int in_thread_file)
 #else
 				  email->msgid, email->subject);
 #endif
-      fprintf(fp, "&lt;<a href=\"%s\">%s</a>&gt;", ptr ? ptr : "",
+      hm_fprintf(fp, "&lt;<a href=\"%s\">%s</a>&gt;", ptr ? ptr : "",
 	      obfuscate_email_address(email->emailaddr));
       if (ptr)
 	free(ptr);
     }
     else
-      fprintf(fp, "%s", tmpname);
+      hm_fprintf(fp, "%s", tmpname);
   }
   else {
       if (use_mailcommand && strcmp(email->emailaddr, "(no email)") != 0) {
@@ -1518,31 +1548,31 @@ void print_headers(FILE *fp, struct emailinfo *email, int in_thread_file)
 #else
 				    email->msgid, email->subject);
 #endif
-	fprintf(fp, "%s &lt;<a href=\"%s\">%s</a>&gt;", tmpname, ptr ? ptr : "",
+	hm_fprintf(fp, "%s &lt;<a href=\"%s\">%s</a>&gt;", tmpname, ptr ? ptr : "",
 		obfuscate_email_address(email->emailaddr));
       if (ptr)
 	free(ptr);
     }
     else {
-      fprintf(fp, "%s &lt;<em>%s</em>&gt;", tmpname, 
+      hm_fprintf(fp, "%s &lt;<em>%s</em>&gt;", tmpname, 
 	      (strcmp(email->emailaddr, "(no email)") != 0) ? email->emailaddr : "no email");
     }
   }
-  fprintf (fp, "\n</span><br />\n");
+  hm_fprintf (fp, "\n</span><br />\n");
   
   /* subject */
   if (in_thread_file)
 #ifdef HAVE_ICONV
-    fprintf(fp, "<span id=\"subject\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_SUBJECT], tmpsubject);
+    hm_fprintf(fp, "<span id=\"subject\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_SUBJECT], tmpsubject);
 #else
-    fprintf(fp, "<span id=\"subject\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_SUBJECT], tmpsubject=convchars(email->subject,email->charset));
+    hm_fprintf(fp, "<span id=\"subject\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_SUBJECT], tmpsubject=convchars(email->subject,email->charset));
 #endif
   /* date */
-  fprintf(fp, "<span id=\"date\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_CDATE], email->datestr);
+  hm_fprintf(fp, "<span id=\"date\"><dfn>%s</dfn>: %s</span><br />\n", lang[MSG_CDATE], email->datestr);
 
   printheaders (fp, email);
 
-  fprintf(fp, "</address>\n");
+  hm_fprintf(fp, "</address>\n");
 
     if(tmpsubject)
      free(tmpsubject);
@@ -1582,28 +1612,28 @@ print_replies(FILE *fp, struct emailinfo *email, int num, int in_thread_file)
 	    char *del_msg = (email2->is_deleted ? lang[MSG_DEL_SHORT] : "");
 	    if (!list_started) {
 	        list_started = TRUE;
-		fprintf (fp, "<li><a name=\"replies\" id=\"replies\"></a>\n");
+		hm_fprintf (fp, "<li><a name=\"replies\" id=\"replies\"></a>\n");
 	    }
 	    else
-	        fprintf (fp, "<li>");
+	        hm_fprintf (fp, "<li>");
 
 	    if (rp->maybereply)
-		fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_MAYBE_REPLY]);
+		hm_fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_MAYBE_REPLY]);
 	    else
-	        fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_REPLY]);
-	    fprintf(fp, "%s <a href=\"%s\" title=\"%s\">", del_msg, 
+	        hm_fprintf(fp, "<dfn>%s</dfn>:", lang[MSG_REPLY]);
+	    hm_fprintf(fp, "%s <a href=\"%s\" title=\"%s\">", del_msg, 
 		    href01(email, email2, in_thread_file, FALSE),
 		    lang[MSG_LTITLE_REPLIES]);
 #ifdef HAVE_ICONV
 	    char *tmpptr;
 	    ptr = i18n_utf2numref(email2->subject,1);
 	    tmpptr = i18n_utf2numref(email2->name,1);
-	    fprintf(fp, "%s: \"%s\"</a></li>\n", tmpptr, ptr);
+	    hm_fprintf(fp, "%s: \"%s\"</a></li>\n", tmpptr, ptr);
 	    if (tmpptr)
 	      free(tmpptr);
 #else
 	    ptr = convchars(email2->subject, email2->charset);
-	    fprintf(fp, "%s: \"%s\"</a></li>\n", email2->name, ptr);
+	    hm_fprintf(fp, "%s: \"%s\"</a></li>\n", email2->name, ptr);
 #endif
 	    if (ptr)
 		free(ptr);
@@ -1632,13 +1662,13 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 	      ptr = "navbar";
 	    else
 	      ptr = "navbarfoot";
-	    fprintf(fp, "<map id=\"%s\" name=\"%s\">\n", ptr, ptr);
+	    hm_fprintf(fp, "<map id=\"%s\" name=\"%s\">\n", ptr, ptr);
 	    if (pos == PAGE_TOP)
-	    fprintf(fp, "<ul class=\"links\">\n");
+	    hm_fprintf(fp, "<ul class=\"links\">\n");
 
-	    fprintf(fp, "<li>\n");
-	    fprintf(fp, "<dfn>%s</dfn>:\n", lang[MSG_THIS_MESSAGE]);
-	    fprintf(fp, "[ <a href=\"#start\" name=\"options1\" id=\"options1\" tabindex=\"1\">"
+	    hm_fprintf(fp, "<li>\n");
+	    hm_fprintf(fp, "<dfn>%s</dfn>:\n", lang[MSG_THIS_MESSAGE]);
+	    hm_fprintf(fp, "[ <a href=\"#start\" name=\"options1\" id=\"options1\" tabindex=\"1\">"
 		    "%s</a> ]\n", lang[MSG_MSG_BODY]);
 	    if (set_mailcommand && set_hmail) {
 	      if ((email->msgid && email->msgid[0]) || (email->subject && email->subject[0])) {
@@ -1653,7 +1683,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 		ptr = makemailcommand(set_replymsg_command, set_hmail, email->msgid, 
 				      email->subject);
 #endif
-		fprintf(fp, " [ <a href=\"%s\" accesskey=\"r\" title=\"%s\">%s</a> ]\n",
+		hm_fprintf(fp, " [ <a href=\"%s\" accesskey=\"r\" title=\"%s\">%s</a> ]\n",
 			ptr, lang[MSG_MA_REPLY], lang[MSG_RESPOND]);
 		if (ptr)
 		  free(ptr);
@@ -1663,19 +1693,19 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 	    case 0:
 	      break;
 	    case 1:
-	      fprintf(fp, " [ %s (<a href=\"#options2\">top</a>, <a href=\"#options3\">bottom</a>) ]\n", lang[MSG_MORE_OPTIONS]);
+	      hm_fprintf(fp, " [ %s (<a href=\"#options2\">top</a>, <a href=\"#options3\">bottom</a>) ]\n", lang[MSG_MORE_OPTIONS]);
 	      break;
 	    case 3:
-	      fprintf(fp, " [ <a href=\"#options2\">%s</a> ]\n", lang[MSG_MORE_OPTIONS]);
+	      hm_fprintf(fp, " [ <a href=\"#options2\">%s</a> ]\n", lang[MSG_MORE_OPTIONS]);
 	      break;
 	    case 4:
-	      fprintf(fp, " [ <a href=\"#options3\">%s</a> ]\n", lang[MSG_MORE_OPTIONS]);
+	      hm_fprintf(fp, " [ <a href=\"#options3\">%s</a> ]\n", lang[MSG_MORE_OPTIONS]);
 	      break;
 	    }
-	    fprintf(fp, "</li>\n");
+	    hm_fprintf(fp, "</li>\n");
 	    
-	    fprintf(fp, "<li>\n");
-	    fprintf(fp, "<dfn>%s</dfn>:\n", lang[MSG_RELATED_MESSAGES]);
+	    hm_fprintf(fp, "<li>\n");
+	    hm_fprintf(fp, "<dfn>%s</dfn>:\n", lang[MSG_RELATED_MESSAGES]);
 
 
 	    /*
@@ -1692,7 +1722,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 	      ptr = convchars(email2->subject, email2->charset);
 	      tmpptr= convchars(email2->name,email2->charset);
 #endif
-	      fprintf(fp, "[ <a href=\"%s\" accesskey=\"d\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
+	      hm_fprintf(fp, "[ <a href=\"%s\" accesskey=\"d\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
 		      msg_href (email2, email, FALSE), 
 		      tmpptr, ptr ? ptr : "", 
 		      lang[MSG_NEXT_MESSAGE]);
@@ -1722,7 +1752,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 	      ptr = convchars(email2->subject, email2->charset);
 	      tmpptr=convchars(email2->name,email2->charset);
 #endif
-	      fprintf(fp, "[ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
+	      hm_fprintf(fp, "[ <a href=\"%s\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
 		      msg_relpath(email2, email), 
 		      tmpptr, ptr ? ptr : "", 
 		      lang[MSG_PREVIOUS_MESSAGE]);
@@ -1751,7 +1781,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 		ptr = convchars(email2->subject, email2->charset);
 		tmpptr=convchars(email2->name,email2->charset);
 #endif
-		fprintf(fp, "[ <a href=\"%s\" title=\"%s%s: &quot;%s&quot;\">%s</a> ]\n", 
+		hm_fprintf(fp, "[ <a href=\"%s\" title=\"%s%s: &quot;%s&quot;\">%s</a> ]\n", 
 			 href01(email, email2, in_thread_file, FALSE), 
 			del_msg, tmpptr, ptr ? ptr : "", 
 			(subjmatch) ? lang[MSG_MAYBE_IN_REPLY_TO] : lang[MSG_IN_REPLY_TO]);
@@ -1766,7 +1796,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 		tmpptr = makeinreplytocommand(set_inreplyto_command, email->subject, email->inreplyto);
 		if (tmpptr) {		
 		  /* use an msgid resolver */
-		  fprintf(fp, "[ <a href=\"%s\"  title=\"%s\">%s</a> ]\n", 
+		  hm_fprintf(fp, "[ <a href=\"%s\"  title=\"%s\">%s</a> ]\n", 
 			  tmpptr,
 			  lang[MSG_UNKNOWN_IN_REPLY_TO],
 			  lang[MSG_IN_REPLY_TO]);
@@ -1788,7 +1818,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 	      ptr = convchars(email_next_in_thread->subject, email_next_in_thread->charset);
 	      tmpptr=convchars(email_next_in_thread->name,email_next_in_thread->charset);
 #endif
-	      fprintf(fp, "[ <a href=\"%s\" accesskey=\"t\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
+	      hm_fprintf(fp, "[ <a href=\"%s\" accesskey=\"t\" title=\"%s: &quot;%s&quot;\">%s</a> ]\n", 
 		      href01(email, email_next_in_thread, in_thread_file, FALSE),
 		      tmpptr, ptr, 
 		      lang[MSG_NEXT_IN_THREAD]);
@@ -1816,7 +1846,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 		  for (rp = replylist; rp != NULL; rp = rp->next) {
 		    if (rp->frommsgnum == num && hashnumlookup(rp->msgnum, &email2)) {
 #endif
-		      fprintf (fp, " [ <a href=\"#replies\">%s</a> ]\n", 
+		      hm_fprintf (fp, " [ <a href=\"#replies\">%s</a> ]\n", 
 			       lang[MSG_REPLIES]);
 		      break;
 		    }
@@ -1825,7 +1855,7 @@ int print_links_up(FILE *fp, struct emailinfo *email, int pos, int in_thread_fil
 		}
 
 		/* close the list */
-		fprintf (fp,"</li>\n</ul>\n</map>\n");
+		hm_fprintf (fp,"</li>\n</ul>\n</map>\n");
 	      }
 	      return is_reply;
 }
@@ -1845,13 +1875,13 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	 */
 
 	if (set_show_msg_links && set_show_msg_links != loc_cmp) {
-	  fprintf(fp, "<ul class=\"links\">\n");
+	  hm_fprintf(fp, "<ul class=\"links\">\n");
 
 	  /* 
 	  ** format for items: <li><dfn>Next</dfn>: <a href="0047.html" 
 	  title="wai thing">subject of message</a></li>\n */
 	     
-	  fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"#start\">%s</a> ]</li>\n", 
+	  hm_fprintf (fp, "<li><dfn>%s</dfn>: [ <a href=\"#start\">%s</a> ]</li>\n", 
 		   lang[MSG_THIS_MESSAGE], lang[MSG_MSG_BODY]);
 	  
 	  printcomment(fp, "lnext", "start");
@@ -1868,8 +1898,8 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	    ptr = convchars(email2->subject, email2->charset);
 	    ptr2 = convchars(email2->name, email2->charset);
 #endif
-	    fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_MESSAGE]);
-	    fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
+	    hm_fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_MESSAGE]);
+	    hm_fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
 		    msg_href(email2, email, FALSE), lang[MSG_LTITLE_NEXT],
 		    ptr2 ? ptr2 : "", ptr ? ptr : "");
 	    if (ptr)
@@ -1896,8 +1926,8 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	    ptr = convchars(email2->subject, email2->charset);
 	    ptr2 = convchars(email2->name, email2->charset);
 #endif
-	    fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_PREVIOUS_MESSAGE]);
-	    fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
+	    hm_fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_PREVIOUS_MESSAGE]);
+	    hm_fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
 		    msg_href(email2, email, FALSE), lang[MSG_LTITLE_PREVIOUS],
 		    ptr2 ? ptr2 : "", ptr);
 	    if (ptr)
@@ -1924,10 +1954,10 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	    ptr2 = convchars(email2->name, email2->charset);
 #endif
 	    if (subjmatch)
-	      fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_MAYBE_IN_REPLY_TO]);
+	      hm_fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_MAYBE_IN_REPLY_TO]);
 	    else
-	      fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_IN_REPLY_TO]);
-	    fprintf(fp, "%s <a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
+	      hm_fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_IN_REPLY_TO]);
+	    hm_fprintf(fp, "%s <a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
 		    del_msg, href01(email, email2, in_thread_file, FALSE), 
 		    lang[MSG_LTITLE_IN_REPLY_TO], ptr2, ptr);
 	    if (ptr)
@@ -1941,8 +1971,8 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	    tmpptr = makeinreplytocommand(set_inreplyto_command, email->subject, email->inreplyto);
 	    if (tmpptr) {		
 	      /* use an msgid resolver */
-	      fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_IN_REPLY_TO]);
-	      fprintf(fp, " [ <a href=\"%s\" title=\"%s : %s\">%s</a> ]</li>\n", 
+	      hm_fprintf(fp, "<li><dfn>%s</dfn>:", lang[MSG_IN_REPLY_TO]);
+	      hm_fprintf(fp, " [ <a href=\"%s\" title=\"%s : %s\">%s</a> ]</li>\n", 
 		      tmpptr,
 		      lang[MSG_LTITLE_IN_REPLY_TO],
 		      lang[MSG_UNKNOWN_IN_REPLY_TO],
@@ -1964,8 +1994,8 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	  ptr = convchars(email_next_in_thread->subject, email_next_in_thread->charset);
 	  ptr2 = convchars(email_next_in_thread->name, email_next_in_thread->charset);
 #endif
-	  fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_IN_THREAD]);
-	  fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
+	  hm_fprintf(fp, "<li><dfn>%s</dfn>: ", lang[MSG_NEXT_IN_THREAD]);
+	  hm_fprintf(fp, "<a href=\"%s\" title=\"%s\">%s: \"%s\"</a></li>\n", 
 		  href01(email, email_next_in_thread, in_thread_file, FALSE), 
 		  lang[MSG_LTITLE_NEXT_IN_THREAD], 
 		  ptr2, ptr);
@@ -1984,7 +2014,7 @@ int print_links(FILE *fp, struct emailinfo *email, int pos, int in_thread_file)
 	    print_replies(fp, email, num, in_thread_file);
 
 	    /* close the list */
-	    fprintf(fp, "</ul>\n");
+	    hm_fprintf(fp, "</ul>\n");
 	}
 	}
 	return is_reply;
@@ -2012,18 +2042,89 @@ static int has_new_replies(struct emailinfo *email)
 }
 
 #ifdef GDBM
+
+/*
+** The gdbm index is opened once, for reading until something has to be
+** written to it, and the same handle serves every reader and writer of
+** the run after that, so its stores sit in gdbm's cache until
+** gdbm_session_close() writes them out.
+*/
+
+static GDBM_FILE session_gp;
+static int session_tried;	/* 1 once opened for reading, 2 for writing */
+
+static void gdbm_session_name(char *indexname, size_t size)
+{
+    snprintf(indexname, size, (set_dir[strlen(set_dir) - 1] == '/')
+	     ? "%s%s" : "%s/%s", set_dir, GDBM_INDEX_NAME);
+}
+
+/*
+** Returns the open index, opening it on first use. Unless create is
+** set, the index is only opened for reading, and one that isn't there
+** yet is not created and NULL is returned, as is the case when it can't
+** be opened. An index opened for reading is opened again for writing
+** the first time create is set.
+*/
+
+void *gdbm_session(int create)
+{
+    char indexname[MAXFILELEN];
+
+    if (!set_usegdbm || session_tried > create)
+	return session_gp;
+    gdbm_session_name(indexname, sizeof(indexname));
+    if (!create && !isfile(indexname))
+	return NULL;
+    if (session_gp)
+	gdbm_close(session_gp);
+    session_tried = create ? 2 : 1;
+    session_gp = gdbm_open(indexname, 0, create ? GDBM_WRCREAT : GDBM_READER,
+			   0664, 0);
+    return session_gp;
+}
+
+/*
+** Starts the index over as an empty one, for when it had to be
+** rebuilt from the message files.
+*/
+
+void *gdbm_session_new(void)
+{
+    char indexname[MAXFILELEN];
+
+    if (session_gp)
+	gdbm_close(session_gp);
+    gdbm_session_name(indexname, sizeof(indexname));
+    session_gp = gdbm_open(indexname, 0, GDBM_NEWDB, 0600, 0);
+    session_tried = 2;
+    return session_gp;
+}
+
+void gdbm_session_close(void)
+{
+    if (session_gp) {
+	gdbm_close(session_gp);
+	session_gp = NULL;
+    }
+    session_tried = 0;
+}
+
+/*
+** Returns the index for writing message summaries, or NULL.
+*/
+
 static GDBM_FILE gdbm_init(void);
 static GDBM_FILE gdbm_init()
 {
     char indexname[MAXFILELEN];
-    static GDBM_FILE gp = NULL;
+    GDBM_FILE gp = NULL;
     if (set_usegdbm) {
-	snprintf(indexname, sizeof(indexname), (set_dir[strlen(set_dir) - 1] == '/')
-			 ? "%s%s" : "%s/%s", set_dir, GDBM_INDEX_NAME);
+	gdbm_session_name(indexname, sizeof(indexname));
 
       /* open the database, creating it if necessary */
 	    
-	if (!(gp = gdbm_open(indexname, 0, GDBM_WRCREAT, 0664, 0))) {
+	if (!(gp = (GDBM_FILE)gdbm_session(TRUE))) {
 
 	    if (set_folder_by_date && set_increment && !is_empty_archive()) {
 	        snprintf(errmsg, sizeof(errmsg), "Cannot open or create file \"%s\". Unable to " "do\nincremental updates with the folder_by_date " "option without using that file.", indexname);
@@ -2117,13 +2218,201 @@ void update_deletions(int num_old)
 }
 
 /*
-** Printing...the other main part of this program!
-** This writes out the articles, beginning with the number startnum.
+** Open a message or index page for writing. The page is written to
+** "<filename>.tmp" and moved into place by page_fclose(), so a reader
+** never sees a half written page. Pages are mostly written one at a
+** time, so they share one large stdio buffer, and a page of a usual
+** size gets to the file in a single write(). A page opened while
+** another one holds the buffer gets the stdio default.
 */
 
-void writearticles(int startnum, int maxnum)
+#define PAGE_BUFSIZE (256 * 1024)
+
+static char *page_buffer;
+static FILE *page_buffer_owner;
+static long pages_written;
+static long pages_unchanged;
+
+FILE *page_fopen(char *filename)
+{
+    char *tmpname;
+    FILE *fp;
+
+    trio_asprintf(&tmpname, "%s.tmp", filename);
+    if ((fp = fopen(tmpname, "w")) != NULL && !page_buffer_owner) {
+	if (!page_buffer)
+	    page_buffer = (char *)emalloc(PAGE_BUFSIZE);
+	setvbuf(fp, page_buffer, _IOFBF, PAGE_BUFSIZE);
+	page_buffer_owner = fp;
+    }
+    free(tmpname);
+    return fp;
+}
+
+/*
+** Read all of file name into memory, zero terminated. Returns NULL if it
+** can not be read.
+*/
+
+static char *read_page(char *name, size_t *len)
+{
+    FILE *fp;
+    struct stat st;
+    char *buf;
+
+    if ((fp = fopen(name, "rb")) == NULL)
+	return NULL;
+    if (fstat(fileno(fp), &st) || !S_ISREG(st.st_mode)) {
+	fclose(fp);
+	return NULL;
+    }
+    buf = (char *)emalloc((size_t)st.st_size + 1);
+    *len = fread(buf, 1, (size_t)st.st_size, fp);
+    buf[*len] = '\0';
+    if (ferror(fp) || *len != (size_t)st.st_size) {
+	free(buf);
+	buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+static int stamp_letter(int c)
+{
+    return isalpha(c) || (c & 0x80);
+}
+
+/*
+** Returns the length of the generation date stamp at the start of p, as
+** written by an earlier run: it has to be laid out like stamp, with its
+** names, numbers and blanks in the same places and the rest as it is.
+** Returns 0 if p does not start with such a stamp.
+*/
+
+static size_t old_stamp(const char *stamp, const char *p)
+{
+    const char *start = p;
+    unsigned char c;
+
+    while ((c = *stamp) != '\0') {
+	if (stamp_letter(c) || isdigit(c) || c == ' ') {
+	    int (*class)(int) = stamp_letter(c) ? stamp_letter
+		: isdigit(c) ? isdigit : isblank;
+
+	    if (!class((unsigned char)*p))
+		return 0;
+	    while (class((unsigned char)*stamp))
+		stamp++;
+	    while (class((unsigned char)*p))
+		p++;
+	}
+	else if (*p++ != *stamp++)
+	    return 0;
+    }
+    return p - start;
+}
+
+/*
+** Returns TRUE if the files a, written by this run, and b hold the same
+** page. Each generation date stamp in a may stand for a well-formed stamp
+** of an earlier run in b, as it changes on every run; everything else
+** has to be the same.
+*/
+
+static int same_page(char *a, char *b)
+{
+    char *stamp = getlocaltime();
+    size_t slen = strlen(stamp);
+    char *buf_a, *buf_b;
+    char *pa, *pb, *end_b;
+    char *s;
+    size_t len_a, len_b, n;
+    int same = FALSE;
+
+    if ((buf_a = read_page(a, &len_a)) == NULL)
+	return FALSE;
+    if ((buf_b = read_page(b, &len_b)) == NULL) {
+	free(buf_a);
+	return FALSE;
+    }
+    pa = buf_a;
+    pb = buf_b;
+    end_b = buf_b + len_b;
+    for (;;) {
+	s = slen ? strstr(pa, stamp) : NULL;
+	n = s ? (size_t)(s - pa) : (size_t)(buf_a + len_a - pa);
+	if ((size_t)(end_b - pb) < n || memcmp(pa, pb, n))
+	    break;
+	pa += n;
+	pb += n;
+	if (!s) {
+	    same = pb == end_b;
+	    break;
+	}
+	if ((n = old_stamp(stamp, pb)) == 0)
+	    break;
+	pa += slen;
+	pb += n;
+    }
+    free(buf_a);
+    free(buf_b);
+    return same;
+}
+
+/*
+** Close a page opened with page_fopen(). If filename already holds the
+** same page it is left alone, so its timestamp and any mirror of it
+** stay as they were, unless rewrite_unchanged is set. Otherwise the
+** new page replaces it with replace_file().
+*/
+
+void page_fclose(FILE *fp, char *filename)
 {
-    int num, skip, newfile;
+    char *tmpname;
+    struct stat st;
+
+    if (fp == page_buffer_owner)
+	page_buffer_owner = NULL;
+    trio_asprintf(&tmpname, "%s.tmp", filename);
+    if (fclose(fp) == EOF) {
+	unlink(tmpname);
+	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
+	progerr(errmsg);
+    }
+    if (!set_rewrite_unchanged && stat(filename, &st) == 0
+	&& same_page(tmpname, filename)) {
+	unlink(tmpname);
+	free(tmpname);
+	++pages_unchanged;
+	return;
+    }
+    if (replace_file(tmpname, filename) == -1) {
+	unlink(tmpname);
+	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
+	progerr(errmsg);
+    }
+    free(tmpname);
+    ++pages_written;
+}
+
+/*
+** Tell how many pages this run wrote, and how many it found unchanged.
+*/
+
+void page_report(void)
+{
+    printf("%ld pages written, %ld unchanged\n", pages_written, pages_unchanged);
+}
+
+/*
+** Write the article page for message number num, if there is one and
+** it needs (re)writing. gp is the open gdbm file, or NULL. Returns
+** TRUE if the page was written.
+*/
+
+static int writearticle(int num, void *gp)
+{
+    int newfile;
     int is_reply = 0;
     int maybe_reply = 0; /* const, why is this here? pcm 2002-08-30 */
     struct emailinfo *email;
@@ -2133,272 +2422,388 @@ void writearticles(int startnum, int maxnum)
     struct reply *rp;
     FILE *fp;
     char *ptr = NULL;
+    char *filename;
+    int written = FALSE;
 #ifdef HAVE_ICONV
     char *localsubject=NULL,*localname=NULL;
     size_t convlen=0;
 #endif
 
-
-#ifdef GDBM
-
-    /* A gdbm hack for avoiding opening all the message files to
-     * get the header comments; see parse.c for details thereof. */
-
-    GDBM_FILE gp = gdbm_init();
-#endif
-
-    num = startnum;
-
-    if (set_showprogress)
-	printf("%s \"%s\"...    ", lang[MSG_WRITING_ARTICLES], set_dir);
-
-    while (num < maxnum) {
-
-	char *filename;
-	if ((bp = hashnumlookup(num, &email)) == NULL) {
-	    ++num;
-	    continue;
-	}
-	filename = articlehtmlfilename(email);
+    if ((bp = hashnumlookup(num, &email)) == NULL)
+	return FALSE;
+    filename = articlehtmlfilename(email);
 
 #ifdef HAVE_ICONV
-	if(email->subject)
-	  localsubject= i18n_convstring(email->subject,"UTF-8",email->charset,&convlen);
-	if(email->name)
-	  localname= i18n_convstring(email->name,"UTF-8",email->charset,&convlen);
+    if(email->subject)
+      localsubject= i18n_convstring(email->subject,"UTF-8",email->charset,&convlen);
+    if(email->name)
+      localname= i18n_convstring(email->name,"UTF-8",email->charset,&convlen);
 #endif
 
-	/*
-	 * Determine to overwrite files or not
-	 */
+    /*
+     * Determine to overwrite files or not
+     */
 
-	if (isfile(filename))
-	    newfile = 0;
-	else
-	    newfile = 1;
+    if (isfile(filename))
+	newfile = 0;
+    else
+	newfile = 1;
 
-	is_reply = 0;
-	set_new_reply_to(-1, -1);
+    is_reply = 0;
+    set_new_reply_to(-1, -1);
 
-	skip = 0;
-	if (email->is_deleted && set_delete_level == DELETE_REMOVES_FILES) {
-	    if (!newfile) {
-		unlink(filename);
-	    }
-#ifdef GDBM
-	    else if (gp) {
-		togdbm((void *)gp, email);
-	    }
-#endif
-	    ++num;
-	    free(filename);
-	    continue;
-	}
-	else if (!newfile && !set_overwrite && !has_new_replies(email)
-		 && !(email->is_deleted && set_delete_msgnum)) {
-	    skip = 1;		/* is this really necessary with continue ??? */
-	    num++;
-	    free(filename);
-	    continue;
+    if (email->is_deleted && set_delete_level == DELETE_REMOVES_FILES) {
+	if (!newfile) {
+	    unlink(filename);
 	}
-	else {
-	  if ((fp = fopen(filename, "w")) == NULL) { /* AUDIT biege:where? */
-	        snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
-		progerr(errmsg);
-	  }
-	  if (set_report_new_file) {
-	      printf("%s\n", filename);
-	  }
+#ifdef GDBM
+	else if (gp) {
+	    togdbm(gp, email);
 	}
+#endif
+	free(filename);
+	goto done;
+    }
+    else if (!newfile && !set_overwrite && !has_new_replies(email)
+	     && !(email->is_deleted && set_delete_msgnum)) {
+	free(filename);
+	goto done;
+    }
+    else {
+      if ((fp = page_fopen(filename)) == NULL) { /* AUDIT biege:where? */
+	    snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
+	    progerr(errmsg);
+      }
+      if (set_report_new_file) {
+	  printf("%s\n", filename);
+      }
+    }
 
-	email_next_in_thread = nextinthread(email->msgnum);
+    email_next_in_thread = nextinthread(email->msgnum);
 
 
-	/*
-	 * Create the comment fields necessary for incremental updating
-	 */
+    /*
+     * Create the comment fields necessary for incremental updating
+     */
 #ifdef HAVE_ICONV
-	print_msg_header(fp, set_label, localsubject, set_dir, localname, email->emailaddr, 
-			 email->msgid, email->charset, email->date, filename, 
-			 REMOVE_MESSAGE(email), email->annotation_robot);
+    print_msg_header(fp, set_label, localsubject, set_dir, localname, email->emailaddr, 
+		     email->msgid, email->charset, email->date, filename, 
+		     REMOVE_MESSAGE(email), email->annotation_robot);
 #else
-	print_msg_header(fp, set_label, email->subject, set_dir, email->name, email->emailaddr, 
-			 email->msgid, email->charset, email->date, filename, 
-			 REMOVE_MESSAGE(email), email->annotation_robot);
+    print_msg_header(fp, set_label, email->subject, set_dir, email->name, email->emailaddr, 
+		     email->msgid, email->charset, email->date, filename, 
+		     REMOVE_MESSAGE(email), email->annotation_robot);
 #endif
-	fprintf (fp, "<div class=\"head\">\n");
+    hm_fprintf (fp, "<div class=\"head\">\n");
 
-	/* print the navigation bar to upper levels */
-	if (ihtmlnavbar2upfile)
-	  fprintf(fp, "<map title=\"%s\" id=\"upper\">\n%s</map>\n", 
-		  lang[MSG_NAVBAR2UPPERLEVELS], ihtmlnavbar2upfile);
+    /* print the navigation bar to upper levels */
+    if (ihtmlnavbar2upfile)
+      hm_fprintf(fp, "<map title=\"%s\" id=\"upper\">\n%s</map>\n", 
+	      lang[MSG_NAVBAR2UPPERLEVELS], ihtmlnavbar2upfile);
 
-	/* reset the value of ptr before we actually start using it,
-	   just in case one of the ternary operations here below
-	   doesn't allocate any memory */
-	ptr = NULL;
+    /* reset the value of ptr before we actually start using it,
+       just in case one of the ternary operations here below
+       doesn't allocate any memory */
+    ptr = NULL;
 
-	/* write the title */
+    /* write the title */
 #ifdef HAVE_ICONV
-	fprintf(fp, "<h1>%s</h1>\n", (REMOVE_MESSAGE(email)) ? lang[MSG_SUBJECT_DELETED] :
-		(ptr = convchars(localsubject, email->charset)));
+    hm_fprintf(fp, "<h1>%s</h1>\n", (REMOVE_MESSAGE(email)) ? lang[MSG_SUBJECT_DELETED] :
+	    (ptr = convchars(localsubject, email->charset)));
 #else
-	fprintf(fp, "<h1>%s</h1>\n", (REMOVE_MESSAGE(email)) ? lang[MSG_SUBJECT_DELETED] :
-		(ptr = convchars(email->subject, email->charset)));
+    hm_fprintf(fp, "<h1>%s</h1>\n", (REMOVE_MESSAGE(email)) ? lang[MSG_SUBJECT_DELETED] :
+	    (ptr = convchars(email->subject, email->charset)));
 #endif
-	if (ptr)
-	  free(ptr);
+    if (ptr)
+      free(ptr);
 
-	printcomment(fp, "received", email->fromdatestr);
-	printcomment(fp, "isoreceived", secs_to_iso(email->fromdate));
-	printcomment(fp, "sent", email->datestr);
-	printcomment(fp, "isosent", secs_to_iso(email->date));
+    printcomment(fp, "received", email->fromdatestr);
+    printcomment(fp, "isoreceived", secs_to_iso(email->fromdate));
+    printcomment(fp, "sent", email->datestr);
+    printcomment(fp, "isosent", secs_to_iso(email->date));
 #ifdef HAVE_ICONV
-	printcomment(fp, "name", localname);
+    printcomment(fp, "name", localname);
 #else
-	printcomment(fp, "name", email->name);
+    printcomment(fp, "name", email->name);
 #endif
-	printcomment(fp, "email", obfuscate_email_address(email->emailaddr));
+    printcomment(fp, "email", obfuscate_email_address(email->emailaddr));
 #ifdef HAVE_ICONV
-	ptr = convcharsnospamprotect(localsubject, email->charset);
+    ptr = convcharsnospamprotect(localsubject, email->charset);
 #else
-	ptr = convcharsnospamprotect(email->subject, email->charset);
+    ptr = convcharsnospamprotect(email->subject, email->charset);
 #endif
- 	printcomment(fp, "subject", ptr);
-	if (ptr)
-	    free(ptr);
-	printcomment(fp, "id", email->msgid);
-	printcomment(fp, "charset", email->charset);
- 	printcomment(fp, "inreplyto", ptr = convcharsnospamprotect(email->inreplyto, email->charset));
-	if (ptr)
-	    free(ptr);
-	if (email->is_deleted) {
-	    char num_buf[32];
-	    sprintf(num_buf, "%d", email->is_deleted);
-	    printcomment(fp, "isdeleted", num_buf);
-	}
-	printcomment(fp, "expires", email->exp_time == -1 ? "-1" : secs_to_iso(email->exp_time));
+    printcomment(fp, "subject", ptr);
+    if (ptr)
+	free(ptr);
+    printcomment(fp, "id", email->msgid);
+    printcomment(fp, "charset", email->charset);
+    printcomment(fp, "inreplyto", ptr = convcharsnospamprotect(email->inreplyto, email->charset));
+    if (ptr)
+	free(ptr);
+    if (email->is_deleted) {
+	char num_buf[32];
+	sprintf(num_buf, "%d", email->is_deleted);
+	printcomment(fp, "isdeleted", num_buf);
+    }
+    printcomment(fp, "expires", email->exp_time == -1 ? "-1" : secs_to_iso(email->exp_time));
 #ifdef GDBM
-	if (gp) {
-		togdbm((void *)gp, email);
-	}
+    if (gp) {
+	    togdbm(gp, email);
+    }
 #endif
-	/*
-	 * This is here because it looks better here. The table looks
-	 * better before the Author info. This stuff should be in 
-	 * printfile() so it could be laid out as the user wants...
-	 */
+    /*
+     * This is here because it looks better here. The table looks
+     * better before the Author info. This stuff should be in 
+     * printfile() so it could be laid out as the user wants...
+     */
 
 
-	is_reply = print_links_up(fp, email, PAGE_TOP, FALSE);
+    is_reply = print_links_up(fp, email, PAGE_TOP, FALSE);
 
-	if ((set_show_index_links == 1 || set_show_index_links == 3) && !set_usetable)
-	    fprint_menu0(fp, email, PAGE_TOP);
-	if ((set_show_msg_links && set_show_msg_links != 4) || !set_usetable)
-	  {
-	    fprintf(fp, "</div>\n");
-	  }
+    if ((set_show_index_links == 1 || set_show_index_links == 3) && !set_usetable)
+	fprint_menu0(fp, email, PAGE_TOP);
+    if ((set_show_msg_links && set_show_msg_links != 4) || !set_usetable)
+      {
+	hm_fprintf(fp, "</div>\n");
+      }
 
-	/*
-	 * Finally...print the body!
-	 */
+    /*
+     * Finally...print the body!
+     */
 
-	printcomment(fp, "body", "start");
-	fprintf (fp, "<div class=\"mail\">\n");
-	print_headers(fp, email, FALSE);
-	printbody(fp, email, maybe_reply, is_reply);
-	fprintf (fp, "<span id=\"received\"><dfn>%s</dfn> %s</span>\n", 
-		 lang[MSG_RECEIVED_ON],  getdatestr(email->fromdate));
-	fprintf (fp, "</div>\n");
-	printcomment(fp, "body", "end");
+    printcomment(fp, "body", "start");
+    hm_fprintf (fp, "<div class=\"mail\">\n");
+    print_headers(fp, email, FALSE);
+    printbody(fp, email, maybe_reply, is_reply);
+    hm_fprintf (fp, "<span id=\"received\"><dfn>%s</dfn> %s</span>\n", 
+	     lang[MSG_RECEIVED_ON],  getdatestr(email->fromdate));
+    hm_fprintf (fp, "</div>\n");
+    printcomment(fp, "body", "end");
 
-	/*
-	 * Should we print out the message links ?
-	 */
+    /*
+     * Should we print out the message links ?
+     */
 
-	fprintf (fp, "<div class=\"foot\">\n");
-	fprintf (fp, "<map id=\"navbarfoot\" name=\"navbarfoot\" title=\"%s\">\n", 
-		 lang[MSG_RELATED_MESSAGES]);
-	
-	print_links(fp, email, PAGE_BOTTOM, FALSE);
+    hm_fprintf (fp, "<div class=\"foot\">\n");
+    hm_fprintf (fp, "<map id=\"navbarfoot\" name=\"navbarfoot\" title=\"%s\">\n", 
+	     lang[MSG_RELATED_MESSAGES]);
+    
+    print_links(fp, email, PAGE_BOTTOM, FALSE);
 
-	fprint_menu0(fp, email, PAGE_BOTTOM);
+    fprint_menu0(fp, email, PAGE_BOTTOM);
 
-	fprintf(fp, "</map>\n");
-	fprintf(fp, "</div>\n");
-	
-	if (set_txtsuffix) {
-	  fprintf(fp, "<p><a rel=\"nofollow\" href=\"%.4d.%s\">%s</a>", email->msgnum, set_txtsuffix, lang[MSG_TXT_VERSION]);
-	}
-	
-	printfooter(fp, mhtmlfooterfile, set_label, set_dir, email->subject, filename, FALSE);
-	
-	fclose(fp);
-	
-	if (get_new_reply_to() != -1) {
-	  /* will only be true if set_linkquotes is */
-	  struct emailinfo *e3, *e4;
-	  int was_correct = 0;
-	  replace_maybe_replies(filename, email, get_new_reply_to());
-	  for (rp = replylist; rp != NULL; rp = rp->next) {
-	    /* get rid of old guesses for where this links */
-	    if (rp->msgnum == num) {
+    hm_fprintf(fp, "</map>\n");
+    hm_fprintf(fp, "</div>\n");
+    
+    if (set_txtsuffix) {
+      hm_fprintf(fp, "<p><a rel=\"nofollow\" href=\"%.4d.%s\">%s</a>", email->msgnum, set_txtsuffix, lang[MSG_TXT_VERSION]);
+    }
+    
+    printfooter(fp, mhtmlfooterfile, set_label, set_dir, email->subject, filename, FALSE);
+    
+    page_fclose(fp, filename);
+    
+    if (get_new_reply_to() != -1) {
+      /* will only be true if set_linkquotes is */
+      struct emailinfo *e3, *e4;
+      int was_correct = 0;
+      replace_maybe_replies(filename, email, get_new_reply_to());
+      for (rp = replylist; rp != NULL; rp = rp->next) {
+	/* get rid of old guesses for where this links */
+	if (rp->msgnum == num) {
 #ifdef FASTREPLYCODE
-	      struct reply *rp3;
-	      was_correct = (rp->frommsgnum == get_new_reply_to());
-	      if (was_correct)
-		break;
-	      hashnumlookup(get_new_reply_to(), &e4);
-	      hashnumlookup(rp->frommsgnum, &e3);
-	      for (rp3 = e3->replylist; rp3 != NULL && rp3->next != NULL; rp3 = rp3->next) {
-		if (rp3->next->msgnum == num) {
-		  rp3->next = rp3->next->next; /* remove */
-		}
-	      }
-	      e4->replylist = addreply(e4->replylist, e4->msgnum, email, 0, NULL);
-#endif
-	      rp->frommsgnum = get_new_reply_to();
-	      rp->maybereply = 0;
-	      break; /* revisit me */
+	  struct reply *rp3;
+	  was_correct = (rp->frommsgnum == get_new_reply_to());
+	  if (was_correct)
+	    break;
+	  hashnumlookup(get_new_reply_to(), &e4);
+	  hashnumlookup(rp->frommsgnum, &e3);
+	  for (rp3 = e3->replylist; rp3 != NULL && rp3->next != NULL; rp3 = rp3->next) {
+	    if (rp3->next->msgnum == num) {
+	      rp3->next = rp3->next->next; /* remove */
 	    }
 	  }
-	  if (!rp) {
-	    if (hashnumlookup(num, &e3)) {
+	  e4->replylist = addreply(e4->replylist, e4->msgnum, email, 0, NULL);
+#endif
+	  rp->frommsgnum = get_new_reply_to();
+	  rp->maybereply = 0;
+	  break; /* revisit me */
+	}
+      }
+      if (!rp) {
+	if (hashnumlookup(num, &e3)) {
 #ifdef FASTREPLYCODE
-	      hashnumlookup(get_new_reply_to(), &e4);
-	      if(0)
-		fprintf(stderr, "update reply %2d %2d \n", get_new_reply_to(), num);
-	      replylist = addreply2(replylist, e4, e3, 0, &replylist_end);
+	  hashnumlookup(get_new_reply_to(), &e4);
+	  if(0)
+	    fprintf(stderr, "update reply %2d %2d \n", get_new_reply_to(), num);
+	  replylist = addreply2(replylist, e4, e3, 0, &replylist_end);
 #else
-	      replylist = addreply(replylist, get_new_reply_to(), e3, 0, &replylist_end);
+	  replylist = addreply(replylist, get_new_reply_to(), e3, 0, &replylist_end);
 #endif
+	}
+      }
+      if (!was_correct)
+	fixreplyheader(set_dir, num, TRUE, num);
+    }
+
+    free(filename);
+    written = TRUE;
+
+  done:
+#ifdef HAVE_ICONV
+    if (localsubject)
+      free(localsubject);
+    if (localname)
+      free(localname);
+#endif
+    return written;
+} /* end writearticle() */
+
+#ifdef PARALLEL_WRITE
+
+/*
+** Run work(item, arg) for items 0 to nitems - 1 in set_jobs worker
+** processes, item i going to worker i % set_jobs, and wait for them
+** all. The workers send back their page counts for page_report(). If a
+** fork fails the remaining shares are done here instead. Whatever the
+** parent has buffered is flushed first and the workers end with _exit(),
+** so that no buffer is written twice, e.g. a page the parent has open.
+*/
+
+static void fork_jobs(int nitems, void (*work)(int, void *), void *arg)
+{
+    pid_t *pids = (pid_t *)emalloc(set_jobs * sizeof(pid_t));
+    int forked = 0, job, item;
+    int failed = 0;
+    long counts[2];
+    int fd[2];
+
+    fflush(NULL);
+
+    if (pipe(fd) == -1)
+	fd[0] = fd[1] = -1;
+    else {
+	for (; forked < set_jobs; forked++) {
+	    pid_t pid = fork();
+
+	    if (pid == -1)
+		break;
+	    if (pid == 0) {
+		i_locked_it = 0;	/* the lock belongs to the parent */
+		close(fd[0]);
+		pages_written = pages_unchanged = 0;
+		for (item = forked; item < nitems; item += set_jobs)
+		    work(item, arg);
+		counts[0] = pages_written;
+		counts[1] = pages_unchanged;
+		fflush(stdout);
+		_exit(write(fd[1], counts, sizeof(counts)) != sizeof(counts));
 	    }
-	  }
-	  if (!was_correct)
-	    fixreplyheader(set_dir, num, TRUE, num);
+	    pids[forked] = pid;
 	}
-	
-	if (newfile && chmod(filename, set_filemode) == -1) {
-	    snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	    progerr(errmsg);
+	close(fd[1]);
+    }
+
+    for (job = forked; job < set_jobs; job++)
+	for (item = job; item < nitems; item += set_jobs)
+	    work(item, arg);
+
+    for (job = 0; job < forked; job++) {
+	int status;
+
+	if (waitpid(pids[job], &status, 0) == -1
+	    || !WIFEXITED(status) || WEXITSTATUS(status))
+	    failed = 1;
+    }
+    if (fd[0] != -1) {
+	while (read(fd[0], counts, sizeof(counts)) == sizeof(counts)) {
+	    pages_written += counts[0];
+	    pages_unchanged += counts[1];
 	}
+	close(fd[0]);
+    }
+    free(pids);
+
+    if (failed) {
+	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".",
+		 lang[MSG_COULD_NOT_WRITE], set_dir);
+	progerr(errmsg);
+    }
+}
+
+struct write_range {
+    int startnum;
+    int maxnum;
+};
+
+static void write_block(int block, void *arg)
+{
+    struct write_range *range = (struct write_range *)arg;
+    int num = range->startnum + block * WRITE_BLOCK;
+    int end = num + WRITE_BLOCK;
+
+    if (end > range->maxnum)
+	end = range->maxnum;
+    for (; num < end; num++)
+	writearticle(num, NULL);
+}
+
+/*
+** Hand the messages out in blocks of WRITE_BLOCK messages. The pages
+** of different messages don't depend on each other unless linkquotes
+** is on, so the result is the same as writing them in order.
+*/
+
+static void fork_writearticles(int startnum, int maxnum)
+{
+    struct write_range range;
+
+    range.startnum = startnum;
+    range.maxnum = maxnum;
+    fork_jobs((maxnum - startnum + WRITE_BLOCK - 1) / WRITE_BLOCK,
+	      write_block, &range);
+}
+
+#endif
+
+/*
+** Printing...the other main part of this program!
+** This writes out the articles, beginning with the number startnum.
+*/
+
+void writearticles(int startnum, int maxnum)
+{
+    int num;
+#ifdef GDBM
+
+    /* A gdbm hack for avoiding opening all the message files to
+     * get the header comments; see parse.c for details thereof. */
+
+    GDBM_FILE gp = gdbm_init();
+#else
+    void *gp = NULL;
+#endif
+
+    /* the header index won't match the pages any more */
+    hdrindex_remove(set_dir);
+
+    if (set_showprogress)
+	printf("%s \"%s\"...    ", lang[MSG_WRITING_ARTICLES], set_dir);
 
-	if (maxnum && !(num % 5) && set_showprogress) {
+#ifdef PARALLEL_WRITE
+    /* linkquotes patches earlier pages and the reply list as it goes */
+    if (set_jobs > 1 && !set_linkquotes && !gp
+	&& maxnum - startnum > WRITE_BLOCK)
+	fork_writearticles(startnum, maxnum);
+    else
+#endif
+    for (num = startnum; num < maxnum; num++) {
+	if (writearticle(num, (void *)gp)
+	    && maxnum && !(num % 5) && set_showprogress) {
 	  printf("\b\b\b\b%03.0f%c", ((float)num / (float)maxnum) * 100, '%');
 	  fflush(stdout);
 	}
-	free(filename);
-	
-	num++;
-
-#ifdef HAVE_ICONV
-	if (localsubject)
-	  free(localsubject);
-	if (localname)
-	  free(localname);
-#endif
     }
-    
 #ifdef GDBM
     if (gp) {
         datum key;
@@ -2411,7 +2816,6 @@ void writearticles(int startnum, int maxnum)
 	content.dsize = strlen(num_buf) + 1;
 	content.dptr = num_buf;
 	gdbm_store((GDBM_FILE) gp, key, content, GDBM_REPLACE);
-	gdbm_close(gp);
     }
 #endif
 
@@ -2426,7 +2830,6 @@ void writearticles(int startnum, int maxnum)
 
 void writedates(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
     char prev_date_str[DATESTRLEN + 40];
@@ -2436,12 +2839,7 @@ void writedates(int amountmsgs, struct emailinfo *email)
 
     filename = htmlfilename(datename, email, "");
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-    if ((fp = fopen(filename, "w")) == NULL) { /* AUDIT biege: where? */
+    if ((fp = page_fopen(filename)) == NULL) { /* AUDIT biege: where? */
 	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -2459,29 +2857,29 @@ void writedates(int amountmsgs, struct emailinfo *email)
      */
     print_index_header_links(fp, DATE_INDEX, start_date_num, end_date_num,
 			     amountmsgs, email ? email->subdir : NULL);
-    fprintf (fp, "</div>\n");
+    hm_fprintf (fp, "</div>\n");
 
     /*
      * Print out the actual message index lists. Here's the beef.
      */
     if (set_indextable)
-	fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong>%s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
+	hm_fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong>%s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
     else {
-        fprintf (fp, "<div class=\"messages-list\">\n");
-	fprintf(fp, "<ul>\n");
+        hm_fprintf (fp, "<div class=\"messages-list\">\n");
+	hm_fprintf(fp, "<ul>\n");
     }
     prev_date_str[0] = '\0';
-    printdates(fp, datelist, -1, -1, email, prev_date_str);
+    printdates(fp, folder_list(datelist, email), -1, -1, email, prev_date_str);
 
     if (set_indextable)
-      fprintf(fp, "</table>\n</div>\n");
+      hm_fprintf(fp, "</table>\n</div>\n");
     else
       {
 	if (*prev_date_str)  /* close the previous date item */
-	  fprintf (fp, "</ul></li>\n");
-	fprintf(fp, "</ul>\n");
+	  hm_fprintf (fp, "</ul></li>\n");
+	hm_fprintf(fp, "</ul>\n");
 	printlaststats (fp, end_date_num);
-	fprintf (fp, "</div>\n");
+	hm_fprintf (fp, "</div>\n");
       }
 
     /* 
@@ -2495,13 +2893,8 @@ void writedates(int amountmsgs, struct emailinfo *email)
      */
     printfooter(fp, ihtmlfooterfile, set_label, set_dir, lang[MSG_BY_DATE], datename, TRUE);
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    /* AUDIT biege: depending on the direc. it better to use fchmod(). */
-    if (newfile && chmod(filename, set_filemode) == -1) {
-	snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -2514,7 +2907,6 @@ void writedates(int amountmsgs, struct emailinfo *email)
 
 void writeattachments(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
     char *attname = index_name[email && email->subdir != NULL][ATTACHMENT_INDEX];
@@ -2524,12 +2916,7 @@ void writeattachments(int amountmsgs, struct emailinfo *email)
 
     filename = htmlfilename(attname, email, "");
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-    if ((fp = fopen(filename, "w")) == NULL) {	/* AUDIT biege: where? */
+    if ((fp = page_fopen(filename)) == NULL) {	/* AUDIT biege: where? */
 	 snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -2547,24 +2934,24 @@ void writeattachments(int amountmsgs, struct emailinfo *email)
      */
     print_index_header_links(fp, ATTACHMENT_INDEX, start_date_num, end_date_num,
 			     amountmsgs, email ? email->subdir : NULL);
-    fprintf (fp, "</div>\n");
+    hm_fprintf (fp, "</div>\n");
 
     /*
      * Print out the actual message index lists. Here's the beef.
      */
 
     if (set_indextable) {
-	fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong>%s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
-	printattachments(fp, datelist, email, &is_first);
-	fprintf(fp, "</table>\n</div>\n");
+	hm_fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong>%s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
+	printattachments(fp, folder_list(datelist, email), email, &is_first);
+	hm_fprintf(fp, "</table>\n</div>\n");
     }
     else {
-        fprintf (fp, "<div class=\"messages-list\">\n");
-	fprintf(fp, "<ul>\n");
-	if (printattachments(fp, datelist, email, &is_first) == 0)
-	   fprintf(fp, "<li style=\"display: none\">Nothing received yet!</li>\n");
-	fprintf(fp, "</ul>\n");
-	fprintf(fp, "</div>\n");
+        hm_fprintf (fp, "<div class=\"messages-list\">\n");
+	hm_fprintf(fp, "<ul>\n");
+	if (printattachments(fp, folder_list(datelist, email), email, &is_first) == 0)
+	   hm_fprintf(fp, "<li style=\"display: none\">Nothing received yet!</li>\n");
+	hm_fprintf(fp, "</ul>\n");
+	hm_fprintf(fp, "</div>\n");
     }
 
     /* 
@@ -2579,12 +2966,8 @@ void writeattachments(int amountmsgs, struct emailinfo *email)
      */
     printfooter(fp, ihtmlfooterfile, set_label, set_dir, lang[MSG_BY_DATE], attname, TRUE);
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    if (newfile && chmod(filename, set_filemode) == -1) {
-		snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -2597,31 +2980,15 @@ void writeattachments(int amountmsgs, struct emailinfo *email)
 
 void writethreads(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
     char *thrdname = index_name[email && email->subdir != NULL][THREAD_INDEX];
     time_t start_date_num = email && email->subdir ? email->subdir->first_email->date : firstdatenum;
     time_t end_date_num = email && email->subdir ? email->subdir->last_email->date : lastdatenum;
 
-    struct printed *pp;
-
-    while (printedlist) {	/* cleanup needed ?? */
-	pp = printedlist;
-	printedlist = printedlist->next;
-	free(pp);
-    }
-
-    printedlist = NULL;
-
     filename = htmlfilename(thrdname, email, "");
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-    if ((fp = fopen(filename, "w")) == NULL) {	/* AUDIT biege: where? */
+    if ((fp = page_fopen(filename)) == NULL) {	/* AUDIT biege: where? */
 	snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -2636,19 +3003,19 @@ void writethreads(int amountmsgs, struct emailinfo *email)
      */
     print_index_header_links(fp, THREAD_INDEX, start_date_num, end_date_num,
 			     amountmsgs, email ? email->subdir : NULL);
-    fprintf (fp, "</div>\n");
+    hm_fprintf (fp, "</div>\n");
 
     if (set_indextable) {
-	fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
+	hm_fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
 	print_all_threads(fp, -1, -1, email);
-	fprintf(fp, "</table>\n</div>\n");
+	hm_fprintf(fp, "</table>\n</div>\n");
     }
     else {
-        fprintf (fp, "<div class=\"messages-list\">\n");
-	fprintf(fp, "<ul>\n");
+        hm_fprintf (fp, "<div class=\"messages-list\">\n");
+	hm_fprintf(fp, "<ul>\n");
 	print_all_threads(fp, -1, -1, email);
-	fprintf(fp, "</ul>\n");
-	fprintf (fp, "</div>");
+	hm_fprintf(fp, "</ul>\n");
+	hm_fprintf (fp, "</div>");
     }
 
     /* 
@@ -2660,12 +3027,8 @@ void writethreads(int amountmsgs, struct emailinfo *email)
     
     printfooter(fp, ihtmlfooterfile, set_label, set_dir, lang[MSG_BY_THREAD], thrdname, TRUE);
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    if (newfile && chmod(filename, set_filemode) == -1) {
-		snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -2676,9 +3039,11 @@ void writethreads(int amountmsgs, struct emailinfo *email)
 ** Print the subject index pointers alphabetically.
 */
 
-void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
+void printsubjects(FILE *fp, struct headerlist *list, char **oldsubject,
 		   int year, int month, struct emailinfo *subdir_email)
 {
+  struct header *hp;
+  int pos = 0;
   char *subject=NULL, *name=NULL;
   const char *startline;
   const char *break_str;
@@ -2686,10 +3051,8 @@ void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
   static char date_str[DATESTRLEN+40]; /* made static for smaller stack */
   static char *first_attributes = "<a  accesskey=\"j\" name=\"first\" id=\"first\"></a>";
 
-  if (hp != NULL) {
-    printsubjects(fp, hp->left, oldsubject, year, month, subdir_email);
-    if ((year == -1 || year_of_datenum(hp->data->date) == year)
-	&& (month == -1 || month_of_datenum(hp->data->date) == month)
+  while ((hp = header_next(list, &pos)) != NULL) {
+    if (in_period(hp->data, year, month)
 	&& !hp->data->is_deleted
 	&& (!subdir_email || subdir_email->subdir == hp->data->subdir)) {
 
@@ -2703,22 +3066,22 @@ void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
 
 	if (strcasecmp(hp->data->unre_subject, *oldsubject)) {
 	    if (set_indextable) {
-		fprintf(fp,
+		hm_fprintf(fp,
 			"<tr><td colspan=\"3\"><strong>%s</strong></td></tr>\n",
 			subject);
 	    }
 	    else {
 	      bool is_first;
 	        if (*oldsubject && *oldsubject[0] != '\0')  { /* close the previous open list */
-		  fprintf(fp, "</ul></li>\n");
+		  hm_fprintf(fp, "</ul></li>\n");
 		  is_first = FALSE;
 		} 
 		else
 		  is_first = TRUE;
 
-		fprintf(fp, "<li>%s<dfn>%s</dfn>\n", 
+		hm_fprintf(fp, "<li>%s<dfn>%s</dfn>\n", 
 			(is_first) ? first_attributes : "", subject);
-		fprintf(fp, "<ul>\n");
+		hm_fprintf(fp, "<ul>\n");
 	    }
 	}
 	if(set_indextable) {
@@ -2733,7 +3096,7 @@ void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
 	    snprintf(date_str, sizeof(date_str), "<em>(%s)</em>", getindexdatestr(hp->data->date));
 	    endline = "</li>";
 	}
-	fprintf(fp,
+	hm_fprintf(fp,
 		"%s%s%s</a>%s <a name=\"%s%d\" id=\"%s%d\">%s</a>%s\n", startline,
 		msg_href(hp->data, subdir_email, TRUE), 
                 name, break_str,        
@@ -2744,7 +3107,6 @@ void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
 	free(subject);
 	free(name);
     }
-    printsubjects(fp, hp->right, oldsubject, year, month, subdir_email);
   }
 }
 
@@ -2754,7 +3116,6 @@ void printsubjects(FILE *fp, struct header *hp, char **oldsubject,
 
 void writesubjects(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
     char *subjname = index_name[email && email->subdir != NULL][SUBJECT_INDEX];
@@ -2763,12 +3124,7 @@ void writesubjects(int amountmsgs, struct emailinfo *email)
 
     filename = htmlfilename(subjname, email, "");
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-	if ((fp = fopen(filename, "w")) == NULL) { /* AUDIT biege: where? */
+	if ((fp = page_fopen(filename)) == NULL) { /* AUDIT biege: where? */
 	    snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -2783,26 +3139,26 @@ void writesubjects(int amountmsgs, struct emailinfo *email)
 	 */
 	print_index_header_links(fp, SUBJECT_INDEX, start_date_num, end_date_num,
 				 amountmsgs, email ? email->subdir : NULL);
-	fprintf (fp, "</div>\n");
+	hm_fprintf (fp, "</div>\n");
 	
     if (set_indextable) {
-	fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
+	hm_fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CSUBJECT], lang[MSG_CAUTHOR], lang[MSG_CDATE]);
     }
     else {
-        fprintf (fp, "<div class=\"messages-list\">\n");
-	fprintf(fp, "<ul>\n");
+        hm_fprintf (fp, "<div class=\"messages-list\">\n");
+	hm_fprintf(fp, "<ul>\n");
     }
     {
 	char *oldsubject = "";	/* dummy to start with */
-	printsubjects(fp, subjectlist, &oldsubject, -1, -1, email);
+	printsubjects(fp, folder_list(subjectlist, email), &oldsubject, -1, -1, email);
     }
     if (set_indextable) {
-	fprintf(fp, "</table>\n</div>\n");
+	hm_fprintf(fp, "</table>\n</div>\n");
     }
     else {
-	fprintf(fp, "</ul></li>\n");
-	fprintf(fp, "</ul>\n");
-	fprintf (fp, "</div>");
+	hm_fprintf(fp, "</ul></li>\n");
+	hm_fprintf(fp, "</ul>\n");
+	hm_fprintf (fp, "</div>");
     }
 
     /* 
@@ -2815,12 +3171,8 @@ void writesubjects(int amountmsgs, struct emailinfo *email)
 
     printfooter(fp, ihtmlfooterfile, set_label, set_dir, lang[MSG_BY_SUBJECT], subjname, TRUE);
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    if (newfile && chmod(filename, set_filemode) == -1) {
-		snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -2831,9 +3183,11 @@ void writesubjects(int amountmsgs, struct emailinfo *email)
 ** Prints the author index links sorted alphabetically.
 */
 
-void printauthors(FILE *fp, struct header *hp, char **oldname,
+void printauthors(FILE *fp, struct headerlist *list, char **oldname,
 		  int year, int month, struct emailinfo *subdir_email)
 {
+  struct header *hp;
+  int pos = 0;
   char *subj, *tmpname;
   const char *startline;
   const char *break_str;
@@ -2841,10 +3195,8 @@ void printauthors(FILE *fp, struct header *hp, char **oldname,
   static char date_str[DATESTRLEN+40]; /* made static for smaller stack */
   static char *first_attributes = "<a  accesskey=\"j\" name=\"first\" id=\"first\"></a>";
 
-  if (hp != NULL) {
-    printauthors(fp, hp->left, oldname, year, month, subdir_email);
-    if ((year == -1 || year_of_datenum(hp->data->date) == year)
-	&& (month == -1 || month_of_datenum(hp->data->date) == month)
+  while ((hp = header_next(list, &pos)) != NULL) {
+    if (in_period(hp->data, year, month)
 	&& !hp->data->is_deleted
 	&& (!subdir_email || subdir_email->subdir == hp->data->subdir)) {
 
@@ -2858,23 +3210,23 @@ void printauthors(FILE *fp, struct header *hp, char **oldname,
       if (strcasecmp(hp->data->name, *oldname)) {
 
 	if(set_indextable)
-	  fprintf(fp,
+	  hm_fprintf(fp,
 		  "<tr><td colspan=\"3\"><strong>%s</strong></td></tr>",
 		  tmpname);
 	else {
 	  bool is_first;
 
 	  if (*oldname && *oldname[0] != '\0') { /* close the previous open list */
-	    fprintf(fp, "</ul></li>\n");
+	    hm_fprintf(fp, "</ul></li>\n");
 	    is_first = FALSE;
 	  }
 	  else
 	    is_first = TRUE;
 
-	  fprintf(fp, "<li>%s<dfn>%s</dfn>\n", 
+	  hm_fprintf(fp, "<li>%s<dfn>%s</dfn>\n", 
 		  (is_first) ? first_attributes : "",
 		  tmpname);
-	  fprintf(fp, "<ul>\n");
+	  hm_fprintf(fp, "<ul>\n");
 	}
       }
       if(set_indextable) {
@@ -2889,7 +3241,7 @@ void printauthors(FILE *fp, struct header *hp, char **oldname,
 	snprintf(date_str, sizeof(date_str), "<em>(%s)</em>", getindexdatestr(hp->data->date));
 	endline = "</li>";
       }
-      fprintf(fp,"%s%s%s</a>%s<a name=\"%s%d\" id=\"%s%d\">%s</a>%s\n",
+      hm_fprintf(fp,"%s%s%s</a>%s<a name=\"%s%d\" id=\"%s%d\">%s</a>%s\n",
 	      startline, msg_href(hp->data, subdir_email, TRUE), subj, break_str,
 	      set_fragment_prefix, hp->data->msgnum, set_fragment_prefix, hp->data->msgnum, 
 	      date_str, endline);
@@ -2900,7 +3252,6 @@ void printauthors(FILE *fp, struct header *hp, char **oldname,
 
       *oldname = hp->data->name;	/* avoid copying */
     }
-    printauthors(fp, hp->right, oldname, year, month, subdir_email);
   }
 }
 
@@ -2910,7 +3261,6 @@ void printauthors(FILE *fp, struct header *hp, char **oldname,
 
 void writeauthors(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
     char *authname = index_name[email && email->subdir != NULL][AUTHOR_INDEX];
@@ -2919,12 +3269,7 @@ void writeauthors(int amountmsgs, struct emailinfo *email)
 
     filename = htmlfilename(authname, email, "");
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-	if ((fp = fopen(filename, "w")) == NULL) { /* AUDIT biege: where? */
+	if ((fp = page_fopen(filename)) == NULL) { /* AUDIT biege: where? */
 	     snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -2939,26 +3284,26 @@ void writeauthors(int amountmsgs, struct emailinfo *email)
      */
     print_index_header_links(fp, AUTHOR_INDEX, start_date_num, end_date_num,
 			     amountmsgs, email ? email->subdir : NULL);
-    fprintf (fp, "</div>\n");
+    hm_fprintf (fp, "</div>\n");
 
     if (set_indextable) {
-		fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CAUTHOR], lang[MSG_CSUBJECT], lang[MSG_CDATE]);
+		hm_fprintf(fp, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[MSG_CAUTHOR], lang[MSG_CSUBJECT], lang[MSG_CDATE]);
     }
     else {
-        fprintf(fp, "<div class=\"messages-list\">\n");
-	fprintf(fp, "<ul>\n");
+        hm_fprintf(fp, "<div class=\"messages-list\">\n");
+	hm_fprintf(fp, "<ul>\n");
     }
     {
 	char *prevauthor = "";
-	printauthors(fp, authorlist, &prevauthor, -1, -1, email);
+	printauthors(fp, folder_list(authorlist, email), &prevauthor, -1, -1, email);
     }
     if (set_indextable) {
-	fprintf(fp, "</table>\n</div>\n");
+	hm_fprintf(fp, "</table>\n</div>\n");
     }
     else {
-        fprintf(fp, "</ul></li>\n");
-	fprintf(fp, "</ul>\n");
-	fprintf(fp, "</div>\n");
+        hm_fprintf(fp, "</ul></li>\n");
+	hm_fprintf(fp, "</ul>\n");
+	hm_fprintf(fp, "</div>\n");
     }
 
     /* 
@@ -2972,12 +3317,8 @@ void writeauthors(int amountmsgs, struct emailinfo *email)
 
     printfooter(fp, ihtmlfooterfile, set_label, set_dir, lang[MSG_BY_AUTHOR], authname, TRUE);
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    if (newfile && chmod(filename, set_filemode) == -1) {
-	snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -2987,15 +3328,15 @@ void writeauthors(int amountmsgs, struct emailinfo *email)
 /*
 ** Pretty-prints the items for the haof
 */
-void printhaofitems(FILE *fp, struct header *hp, int year, int month, struct emailinfo *subdir_email)
+void printhaofitems(FILE *fp, struct headerlist *list, int year, int month, struct emailinfo *subdir_email)
 {
+  struct header *hp;
+  int pos = 0;
   char *subj, *from_name, *from_emailaddr;
 
-  if (hp != NULL) {
+  while ((hp = header_next(list, &pos)) != NULL) {
     struct emailinfo *em = hp->data;
-    printhaofitems(fp, hp->left, year, month, subdir_email);
-    if ((year == -1 || year_of_datenum(em->date) == year)
-	&& (month == -1 || month_of_datenum(em->date) == month)
+    if (in_period(em, year, month)
         && !em->is_deleted && (!subdir_email || subdir_email->subdir == em->subdir)) {
 
 #ifdef HAVE_ICONV
@@ -3008,13 +3349,12 @@ void printhaofitems(FILE *fp, struct header *hp, int year, int month, struct ema
       from_emailaddr = convchars(em->emailaddr, em->charset);
 #endif
 
-      fprintf(fp, "      <mail>\n" "        <subject>%s</subject>\n" "        <date>%s</date>\n" "        <fromname>%s</fromname>\n" "        <fromemail>%s</fromemail>\n" "        <message-id>%s</message-id>\n" "        <file>\"%s\"</file>\n" "      </mail>\n\n", subj, getdatestr(em->date), from_name, from_emailaddr, em->msgid, msg_relpath(em, subdir_email));
+      hm_fprintf(fp, "      <mail>\n" "        <subject>%s</subject>\n" "        <date>%s</date>\n" "        <fromname>%s</fromname>\n" "        <fromemail>%s</fromemail>\n" "        <message-id>%s</message-id>\n" "        <file>\"%s\"</file>\n" "      </mail>\n\n", subj, getdatestr(em->date), from_name, from_emailaddr, em->msgid, msg_relpath(em, subdir_email));
 
       free(subj);
       free(from_name);
       free(from_emailaddr);
     }
-    printhaofitems(fp, hp->right, year, month, subdir_email);
   }
 }
 
@@ -3024,18 +3364,12 @@ void printhaofitems(FILE *fp, struct header *hp, int year, int month, struct ema
 
 void writehaof(int amountmsgs, struct emailinfo *email)
 {
-    int newfile;
     char *filename;
     FILE *fp;
 
     filename = haofname(email);
 
-    if (isfile(filename))
-	newfile = 0;
-    else
-	newfile = 1;
-
-	if ((fp = fopen(filename, "w")) == NULL) { /* AUDIT biege: where? */
+	if ((fp = page_fopen(filename)) == NULL) { /* AUDIT biege: where? */
 	    snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
@@ -3044,27 +3378,23 @@ void writehaof(int amountmsgs, struct emailinfo *email)
 	printf("%s \"%s\"...", lang[MSG_WRITING_HAOF], filename);
 
 #ifdef HAVE_ICONV
-	fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\n");
+	hm_fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\n");
 #else
-	fprintf(fp, "<?xml version=\"1.0\" encoding=\"ISO-8859-15\"?>\n\n");
+	hm_fprintf(fp, "<?xml version=\"1.0\" encoding=\"ISO-8859-15\"?>\n\n");
 #endif
-	fprintf(fp, "  <!DOCTYPE haof PUBLIC " "\"-//Bernhard Reiter//DTD HOAF 0.2//EN\"\n" "\"http://ffii.org/~breiter/probe/haof-0.2.dtd\">\n\n");
-	fprintf(fp, "  <haof version=\"0.2\">\n\n");
-	fprintf(fp, "      <archiver name=\"hypermail\" version=\"" VERSION ".pl" PATCHLEVEL "\" />\n\n");
+	hm_fprintf(fp, "  <!DOCTYPE haof PUBLIC " "\"-//Bernhard Reiter//DTD HOAF 0.2//EN\"\n" "\"http://ffii.org/~breiter/probe/haof-0.2.dtd\">\n\n");
+	hm_fprintf(fp, "  <haof version=\"0.2\">\n\n");
+	hm_fprintf(fp, "      <archiver name=\"hypermail\" version=\"" VERSION ".pl" PATCHLEVEL "\" />\n\n");
 
     print_haof_indices(fp, email ? email->subdir : NULL);
 	    
-    fprintf(fp, "  <mails>\n");
-    printhaofitems(fp, datelist, -1, -1, email);
-    fprintf(fp, "  </mails>\n");
-    fprintf(fp, "  </haof>\n");
+    hm_fprintf(fp, "  <mails>\n");
+    printhaofitems(fp, folder_list(datelist, email), -1, -1, email);
+    hm_fprintf(fp, "  </mails>\n");
+    hm_fprintf(fp, "  </haof>\n");
 
-    fclose(fp);
+    page_fclose(fp, filename);
 
-    if (newfile && chmod(filename, set_filemode) == -1) {
-	snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename, set_filemode);
-	progerr(errmsg);
-    }
     free(filename);
 
     if (set_showprogress)
@@ -3074,23 +3404,207 @@ void writehaof(int amountmsgs, struct emailinfo *email)
 
 
 
-static int count_messages(struct header *hp, int year, int mo, long *first_date, long *last_date)
+/*
+** The year * 12 + month of the date of each message, by message number.
+** The period indices ask for it once per message and period; working it
+** out with localtime() each time made them crawl on long archives.
+*/
+
+static int *period_by_msgnum;
+static int period_by_msgnum_size;
+
+int message_period(struct emailinfo *em)
+{
+    int num = em->msgnum;
+
+    if (num < 0)
+	return year_of_datenum(em->date) * 12 + month_of_datenum(em->date);
+    if (num >= period_by_msgnum_size) {
+	int size = period_by_msgnum_size ? period_by_msgnum_size : 1024;
+	while (size <= num)
+	    size *= 2;
+	period_by_msgnum = (int *)erealloc(period_by_msgnum, size * sizeof(int));
+	memset(period_by_msgnum + period_by_msgnum_size, -1,
+	       (size - period_by_msgnum_size) * sizeof(int));
+	period_by_msgnum_size = size;
+    }
+    if (period_by_msgnum[num] == -1)
+	period_by_msgnum[num] = year_of_datenum(em->date) * 12
+				+ month_of_datenum(em->date);
+    return period_by_msgnum[num];
+}
+
+/*
+** TRUE if the message gets listed in the given year and month, either
+** of which may be -1 for any.
+*/
+
+int in_period(struct emailinfo *em, int year, int month)
+{
+    int period;
+
+    if (year == -1 && month == -1)
+	return TRUE;
+    period = message_period(em);
+    return (year == -1 || period / 12 == year)
+	&& (month == -1 || period % 12 == month);
+}
+
+/*
+** Months touched by an incremental run, one flag per month from the year
+** of firstdatenum on. NULL when every index page has to be written.
+*/
+
+static char *touched_months;
+static int touched_first_year;
+static int touched_nyears;
+
+static void touch_period(struct emailinfo *ep)
+{
+    int period = message_period(ep);
+    int y = period / 12 - touched_first_year;
+
+    if (ep->subdir)
+	ep->subdir->touched = TRUE;
+    if (y >= 0 && y < touched_nyears)
+	touched_months[y * 12 + period % 12] = TRUE;
+}
+
+/*
+** Work out which folders and months the messages from num_old on
+** change, so that only their index pages get rewritten. A period is
+** touched when it holds a new message, a message deleted or expired by
+** this run, or another message of the same thread, since a thread is
+** listed in full under the folder of its first message. Folders next
+** to a new folder get their prior/next period links rewritten too.
+*/
+
+void mark_touched_periods(int num_old)
+{
+    struct reply *start;
+    struct reply *rp;
+    struct hashemail *hlist;
+    struct emailsubdir *sd;
+    struct emailinfo *ep;
+    int i;
+
+    if (num_old <= 0 || set_thread_file_depth || set_files_by_thread)
+	return;
+    touched_first_year = year_of_datenum(firstdatenum);
+    touched_nyears = year_of_datenum(lastdatenum) - touched_first_year + 1;
+    if (touched_nyears < 1)
+	touched_nyears = 1;
+    if (touched_months)
+	free(touched_months);
+    touched_months = (char *)emalloc(touched_nyears * 12);
+    memset(touched_months, 0, touched_nyears * 12);
+
+    for (start = threadlist; start != NULL; start = rp ? rp->next : NULL) {
+	int hit = FALSE;
+	for (rp = start; rp != NULL && rp->msgnum != -1; rp = rp->next)
+	    if (rp->data && (rp->data->msgnum >= num_old
+			     || (rp->data->flags & DELETION_CHANGED)))
+		hit = TRUE;
+	if (hit) {
+	    struct reply *rp2;
+	    for (rp2 = start; rp2 != rp; rp2 = rp2->next)
+		if (rp2->data)
+		    touch_period(rp2->data);
+	}
+    }
+    for (i = num_old; i <= max_msgnum; ++i)
+	if (hashnumlookup(i, &ep))
+	    touch_period(ep);
+    for (hlist = deletedlist; hlist != NULL; hlist = hlist->next)
+	if (hlist->data->flags & DELETION_CHANGED)
+	    touch_period(hlist->data);
+
+    for (sd = folders; sd != NULL; sd = sd->next_subdir) {
+	if (sd->first_email && sd->first_email->msgnum >= num_old) {
+	    sd->touched = TRUE;
+	    if (sd->prior_subdir)
+		sd->prior_subdir->touched = TRUE;
+	    if (sd->next_subdir)
+		sd->next_subdir->touched = TRUE;
+	}
+    }
+}
+
+/*
+** TRUE if the index page filename of the given month, holding count
+** messages, can be left as it is on disk.
+*/
+
+static int keep_month_page(int year, int mo, int count, char *filename)
+{
+    int y = year - touched_first_year;
+
+    if (!touched_months || y < 0 || y >= touched_nyears)
+	return FALSE;
+    if (mo != -1) {
+	if (touched_months[y * 12 + mo])
+	    return FALSE;
+    }
+    else {
+	for (mo = 0; mo < 12; ++mo)
+	    if (touched_months[y * 12 + mo])
+		return FALSE;
+    }
+    return (isfile(filename) != 0) == (count > 0);
+}
+
+/*
+** TRUE if the index page of the given kind for the folder sd can be
+** left as it is on disk.
+*/
+
+static int keep_folder_page(struct emailsubdir *sd, char *name)
+{
+    char *filename;
+    int exists;
+
+    if (!touched_months || sd->touched || !sd->first_email)
+	return FALSE;
+    filename = htmlfilename(name, sd->first_email, "");
+    exists = isfile(filename);
+    free(filename);
+    return exists;
+}
+
+static int count_messages(struct headerlist *list, long *first_date, long *last_date)
 {
-    if (hp != NULL) {
+    struct header *hp;
+    int pos = 0;
+    int cnt = 0;
+
+    while ((hp = header_next(list, &pos)) != NULL) {
 	struct emailinfo *em = hp->data;
-	int cnt = count_messages(hp->left, year, mo, first_date, last_date);
-	if ((year == -1 || year_of_datenum(em->date) == year)
-	    && (mo == -1 || month_of_datenum(em->date) == mo)
-	    && !em->is_deleted) {
+	if (!em->is_deleted) {
 	    ++cnt;
 	    if (em->date < *first_date)
 	        *first_date = em->date;
 	    if (em->date > *last_date)
 	        *last_date = em->date;
 	}
-	return cnt + count_messages(hp->right, year, mo, first_date, last_date);
     }
-    return 0;
+    return cnt;
+}
+
+/*
+** Which of the lists printmonths() walks a message goes into: one per
+** month or year from the year of firstdatenum on. Messages dated outside
+** of those years aren't listed at all.
+*/
+
+static int period_slot(struct emailinfo *em, void *arg)
+{
+    int *years = (int *)arg;	/* first year, number of years */
+    int period = message_period(em);
+    int y = period / 12 - years[0];
+
+    if (y < 0 || y >= years[1])
+	return -1;
+    return set_monthly_index ? y * 12 + period % 12 : y;
 }
 
 static void printmonths(FILE *fp, char *summary_filename, int amountmsgs)
@@ -3100,11 +3614,21 @@ static void printmonths(FILE *fp, char *summary_filename, int amountmsgs)
     int y, j, m;
     char *save_name[NO_INDEX];
     char *subject = lang[set_monthly_index ? MSG_MONTHLY_INDEX : MSG_YEARLY_INDEX];
+    struct headerlist *by_date, *by_subject, *by_author;
+    int years[2];
+    int nslots;
+
+    years[0] = first_year;
+    years[1] = last_year >= first_year ? last_year - first_year + 1 : 1;
+    nslots = years[1] * (set_monthly_index ? 12 : 1);
+    by_date = header_split(datelist, nslots, period_slot, years);
+    by_subject = header_split(subjectlist, nslots, period_slot, years);
+    by_author = header_split(authorlist, nslots, period_slot, years);
 
     for (j = 0; j <= AUTHOR_INDEX; ++j)
 	save_name[j] = index_name[0][j];
     print_index_header(fp, set_label, set_dir, subject, summary_filename);
-    fprintf(fp, "<table>\n");
+    hm_fprintf(fp, "<table>\n");
     for (y = first_year; y <= last_year; ++y) {
 		for (m = (set_monthly_index ? 0 : -1); m < (set_monthly_index ? 12 : 0); ++m) {
 	    char month_str[80];
@@ -3114,10 +3638,11 @@ static void printmonths(FILE *fp, char *summary_filename, int amountmsgs)
 	    char period_bufs[NO_INDEX][MAXFILELEN];
 	    long first_date = lastdatenum;
 	    long last_date = firstdatenum;
+	    int slot = (y - first_year) * (set_monthly_index ? 12 : 1) + (m == -1 ? 0 : m);
 	    int count;
-	    if (!datelist->data)
+	    if (!datelist->count)
 	        continue;
-	    count = count_messages(datelist, y, m, &first_date, &last_date);
+	    count = count_messages(by_date + slot, &first_date, &last_date);
 	    if (set_monthly_index) {
 		sprintf(month_str_pub, "%s %d", months[m], y);
 		sprintf(month_str, "%d%.2d", y, m + 1);
@@ -3136,93 +3661,100 @@ static void printmonths(FILE *fp, char *summary_filename, int amountmsgs)
 		FILE *fp1;
 		char *prev_text = "";
 		char subject_title[128];
+		int keep;
 		if (!show_index[0][j])
 		    continue;
 		snprintf(buf1, sizeof(buf1), "%sby%s", month_str, save_name[j]);
 		filename = htmlfilename(buf1, NULL, "");
-		fp1 = fopen(filename, "w");
-		if (!fp1) {
-	    	    snprintf(errmsg, sizeof(errmsg), "can't open %s", filename);
-		    progerr(errmsg);
-		}
-		snprintf(subject_title, sizeof(subject_title), "%s %s", month_str_pub, indextypename[j]);
-		print_index_header(fp1, set_label, set_dir, subject_title, filename);
-		/* 
-		 * Print out the index page links 
-		 */
-		print_index_header_links(fp1, j, first_date, last_date, count, NULL);
+		keep = keep_month_page(y, m, count, filename);
+		if (!keep) {
+		    fp1 = page_fopen(filename);
+		    if (!fp1) {
+			snprintf(errmsg, sizeof(errmsg), "can't open %s", filename);
+			progerr(errmsg);
+		    }
+		    snprintf(subject_title, sizeof(subject_title), "%s %s", month_str_pub, indextypename[j]);
+		    print_index_header(fp1, set_label, set_dir, subject_title, filename);
+		    /* 
+		     * Print out the index page links 
+		     */
+		    print_index_header_links(fp1, j, first_date, last_date, count, NULL);
 		
-		if (set_indextable) {
-		    fprintf(fp1, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[j == AUTHOR_INDEX ? MSG_CAUTHOR : MSG_CSUBJECT], lang[j == AUTHOR_INDEX ? MSG_CSUBJECT : MSG_CAUTHOR], lang[MSG_CDATE]);
-		}
-		else {
-		    fprintf(fp1, "<ul>\n");
-		}
-		switch (j) {
-		    case DATE_INDEX:
-		      {
-			char prev_date_str[DATESTRLEN + 40];
-			prev_date_str[0] = '\0';
-		        printdates(fp1, datelist, y, m, NULL, prev_date_str);
-			if (*prev_date_str)  /* close the previous date item */
-			  fprintf (fp, "</ul></li>\n");
-			break;
-		      }
-		    case THREAD_INDEX:
-		        print_all_threads(fp1, y, m, NULL);
-			break;
-		    case SUBJECT_INDEX:
-			printsubjects(fp1, subjectlist, &prev_text, y, m, NULL);
-			break;
-		    case AUTHOR_INDEX:
-		        printauthors(fp1, authorlist, &prev_text, y, m, NULL);
-			break;
-		}
+		    if (set_indextable) {
+			hm_fprintf(fp1, "<div class=\"center\">\n<table>\n<tr><td><strong>%s</strong></td><td><strong>%s</strong></td><td><strong> %s</strong></td></tr>\n", lang[j == AUTHOR_INDEX ? MSG_CAUTHOR : MSG_CSUBJECT], lang[j == AUTHOR_INDEX ? MSG_CSUBJECT : MSG_CAUTHOR], lang[MSG_CDATE]);
+		    }
+		    else {
+			hm_fprintf(fp1, "<ul>\n");
+		    }
+		    switch (j) {
+			case DATE_INDEX:
+			  {
+			    char prev_date_str[DATESTRLEN + 40];
+			    prev_date_str[0] = '\0';
+			    printdates(fp1, by_date + slot, -1, -1, NULL, prev_date_str);
+			    if (*prev_date_str)  /* close the previous date item */
+			      hm_fprintf (fp1, "</ul></li>\n");
+			    break;
+			  }
+			case THREAD_INDEX:
+			    print_all_threads(fp1, y, m, NULL);
+			    break;
+			case SUBJECT_INDEX:
+			    printsubjects(fp1, by_subject + slot, &prev_text, -1, -1, NULL);
+			    break;
+			case AUTHOR_INDEX:
+			    printauthors(fp1, by_author + slot, &prev_text, -1, -1, NULL);
+			    break;
+		    }
 
-		if (set_indextable) {
-		    fprintf(fp1, "</table>\n</div>\n");
-		}
-		else {
-		    fprintf(fp1, "</ul>\n");
-		}
+		    if (set_indextable) {
+			hm_fprintf(fp1, "</table>\n</div>\n");
+		    }
+		    else {
+			hm_fprintf(fp1, "</ul>\n");
+		    }
 
-		/* 
-		 * Print out archive information links at the bottom 
-		 * of the index page
-		 */
+		    /* 
+		     * Print out archive information links at the bottom 
+		     * of the index page
+		     */
 
-		print_index_footer_links(fp1, j, last_date, count, NULL);
+		    print_index_footer_links(fp1, j, last_date, count, NULL);
 
-		printfooter(fp1, ihtmlfooterfile, set_label, set_dir, subject_title, 
-			    save_name[j], FALSE);
-		fclose(fp1);
+		    printfooter(fp1, ihtmlfooterfile, set_label, set_dir, subject_title, 
+				save_name[j], FALSE);
+		    page_fclose(fp1, filename);
+		}
 		if (!count) {
-		    remove(filename);
+		    if (!keep)
+			remove(filename);
 		    if (started_line)
-		        fprintf(fp, "<td></td>");
+		        hm_fprintf(fp, "<td></td>");
 		    else
 			++empties;
 		}
 		else {
 		    if (!started_line) {
-			fprintf(fp, "<tr><td>%s</td><td>%d %s</td>", month_str_pub, count, lang[MSG_ARTICLES]);
+			hm_fprintf(fp, "<tr><td>%s</td><td>%d %s</td>", month_str_pub, count, lang[MSG_ARTICLES]);
 			while (empties--)
-			    fprintf(fp, "<td></td>");
+			    hm_fprintf(fp, "<td></td>");
 			started_line = 1;
 		    }
-		    chmod(filename, set_filemode);
-		    fprintf(fp, "<td><a href=\"%sby%s\">%s</a></td>", month_str, save_name[j], indextypename[j]);
+		    hm_fprintf(fp, "<td><a href=\"%sby%s\">%s</a></td>", month_str, save_name[j], indextypename[j]);
 		}
 		free(filename);
 	    }
 	    if (started_line)
-		fprintf(fp, "</tr>\n");
+		hm_fprintf(fp, "</tr>\n");
 	}
     }
-	fprintf(fp, "</table>\n");
+	hm_fprintf(fp, "</table>\n");
 	printfooter(fp, ihtmlfooterfile, set_label, set_dir, subject, summary_filename, FALSE);
     for (j = 0; j <= AUTHOR_INDEX; ++j)
 	index_name[0][j] = save_name[j];
+    header_split_free(by_date);
+    header_split_free(by_subject);
+    header_split_free(by_author);
 }
 
 void init_index_names(void)
@@ -3240,21 +3772,101 @@ void write_summary_indices(int amount_new)
 		char *filename;
 		FILE *fp;
 		filename = htmlfilename("summary", NULL, set_htmlsuffix);
-		fp = fopen(filename, "w");	/* AUDIT biege: where? */
+		fp = page_fopen(filename);	/* AUDIT biege: where? */
 		if (!fp) {
 			snprintf(errmsg, sizeof(errmsg), "Couldn't write \"%s\".", filename);
 			progerr(errmsg);
 		}
 		printmonths(fp, filename, amount_new);
-		fclose(fp);
-		chmod(filename, set_filemode);
+		page_fclose(fp, filename);
 		free(filename);
 	}
 }
 
+/*
+** Write the index pages of one folder, except those keep_folder_page()
+** finds still current. offset is the index that comes first.
+*/
+
+static void write_folder_indices(struct emailsubdir *sd, int offset)
+{
+    int j, k;
+    int written = FALSE;
+
+    for (j = 0; j <= ATTACHMENT_INDEX; ++j) {
+	k = (j + offset) % (ATTACHMENT_INDEX + 1);
+	if (!show_index[1][k] || keep_folder_page(sd, index_name[1][k]))
+	    continue;
+	switch (k) {
+	    case DATE_INDEX:
+		writedates(sd->count, sd->first_email);
+		break;
+	    case THREAD_INDEX:
+		writethreads(sd->count, sd->first_email);
+		break;
+	    case SUBJECT_INDEX:
+		writesubjects(sd->count, sd->first_email);
+		break;
+	    case AUTHOR_INDEX:
+		writeauthors(sd->count, sd->first_email);
+		break;
+	    case ATTACHMENT_INDEX:
+		writeattachments(sd->count, sd->first_email);
+		break;
+	}
+	written = TRUE;
+    }
+    if (set_writehaof && written)
+	writehaof(sd->count, sd->first_email);
+}
+
+#ifdef PARALLEL_WRITE
+
+struct folder_jobs {
+    struct emailsubdir **folders;
+    int offset;
+};
+
+static void write_folder_job(int item, void *arg)
+{
+    struct folder_jobs *jobs = (struct folder_jobs *)arg;
+
+    write_folder_indices(jobs->folders[item], jobs->offset);
+}
+
+/*
+** Folders don't share index pages, so each worker gets folders of its
+** own. The thread pages split by thread_file_depth are numbered across
+** all folders, so they have to be written in order by one process.
+*/
+
+static int fork_folder_indices(int offset)
+{
+    struct folder_jobs jobs;
+    struct emailsubdir *sd;
+    int count = 0;
+
+    if (set_jobs < 2 || set_thread_file_depth)
+	return FALSE;
+    for (sd = folders; sd != NULL; sd = sd->next_subdir)
+	++count;
+    if (count < 2)
+	return FALSE;
+    jobs.folders = (struct emailsubdir **)emalloc(count * sizeof(struct emailsubdir *));
+    jobs.offset = offset;
+    count = 0;
+    for (sd = folders; sd != NULL; sd = sd->next_subdir)
+	jobs.folders[count++] = sd;
+    fork_jobs(count, write_folder_job, &jobs);
+    free(jobs.folders);
+    return TRUE;
+}
+
+#endif
+
 void write_toplevel_indices(int amountmsgs)
 {
-    int i, j, newfile, offset, k;
+    int i, j, offset, k;
     bool first = TRUE;
     struct emailsubdir *sd;
     char *subject = lang[MSG_FOLDERS_INDEX];
@@ -3269,38 +3881,33 @@ void write_toplevel_indices(int amountmsgs)
     char *verbose_dateformat = "%A, %e %B %Y";
 
     char *tmpstr;
+    int written_ahead = FALSE;
 
     FILE *fp;
 
     filename = htmlfilename(index_name[0][FOLDERS_INDEX], NULL, "");
-    if (isfile(filename)) 
-	newfile = 0;
-    else
-	newfile = 1;
-
     if (!show_index[0][FOLDERS_INDEX])
 	fp = NULL;
-    else if ((fp = fopen(filename, "w")) == NULL) {
+    else if ((fp = page_fopen(filename)) == NULL) {
         snprintf(errmsg, sizeof(errmsg), "%s \"%s\".", lang[MSG_COULD_NOT_WRITE], filename);
 	progerr(errmsg);
     }
+    /* find which element of index_name is the default index */
+    offset = 0;
+    if (set_defaultindex) {
+      tmpstr = setindex(INDEXNAME, INDEXNAME, set_htmlsuffix);
+      for (j = 0; j <= ATTACHMENT_INDEX; ++j) {
+	if (0 == strcmp(tmpstr, index_name[1][j])) {
+	  offset = j;
+	  break;
+	}
+      }
+    }
     if (fp) {
       print_index_header(fp, set_label, set_dir, subject, filename);
       print_index_header_links(fp, FOLDERS_INDEX, firstdatenum, lastdatenum, amountmsgs, NULL);
-      fprintf (fp, "</div>\n");
-      fprintf(fp, "<table>\n");
-
-      /* find which element of index_name is the default index */
-      offset = 0;
-      if (set_defaultindex) {
-	tmpstr = setindex(INDEXNAME, INDEXNAME, set_htmlsuffix);
-	for (j = 0; j <= ATTACHMENT_INDEX; ++j) {
-	  if (0 == strcmp(tmpstr, index_name[1][j])) {
-	    offset = j;
-	    break;
-	  }
-	}
-      }
+      hm_fprintf (fp, "</div>\n");
+      hm_fprintf(fp, "<table>\n");
 
       for (i = 0, j = 0; j <= ATTACHMENT_INDEX; ++j) {
 	if (show_index[1][j])
@@ -3310,58 +3917,63 @@ void write_toplevel_indices(int amountmsgs)
 	 with all configurations. */
       if (i > 0)
 	i--;
-      fprintf(fp, "<thead>\n  <tr>\n"
+      hm_fprintf(fp, "<thead>\n  <tr>\n"
 	      "    <th>%s</th>\n    <th colspan=\"%d\">%s</th>\n"
 	      "    <th align=\"right\" class=\"count\">%s</th>\n"
 	      "  </tr>\n</thead>\n"
 	      "<tbody>\n", lang[MSG_PERIOD], i, lang[MSG_RESORTED], 
 	      lang[MSG_ARTICLES]);
     }
+    saved_set_dateformat = set_dateformat;
+    for (i = 0, sd = folders; sd != NULL; sd = sd->next_subdir)
+	sd->index = i++;
+    if (i) {
+	folder_lists[0] = header_split(datelist, i, folder_slot, NULL);
+	folder_lists[1] = header_split(subjectlist, i, folder_slot, NULL);
+	folder_lists[2] = header_split(authorlist, i, folder_slot, NULL);
+    }
     sd = folders;
     if (set_reverse_folders)
 	while (sd->next_subdir)
 	    sd = sd->next_subdir;
-    saved_set_dateformat = set_dateformat;
+#ifdef PARALLEL_WRITE
+    if (datelist->count)
+	written_ahead = fork_folder_indices(offset);
+#endif
     for (; sd != NULL; sd = set_reverse_folders ? sd->prior_subdir : sd->next_subdir) {
 	int started_line = 0;
-	if (!datelist->data)
+	if (!datelist->count)
+	    continue;
+	set_dateformat = saved_set_dateformat;
+	if (!written_ahead)
+	    write_folder_indices(sd, offset);
+	if (!fp)
 	    continue;
 	for (j = 0; j <= ATTACHMENT_INDEX; ++j) {
             /* apply offset so the period column's href points to index.html */
 	    k = (j + offset) % (ATTACHMENT_INDEX + 1);
 	    if (!show_index[1][k])
 		continue;
-	    set_dateformat = saved_set_dateformat;
 	    switch (k) {
 		case DATE_INDEX:
-		    writedates(sd->count, sd->first_email);
 		    index_title = lang[MSG_LTITLE_LISTED_BY_DATE];
 		    break;
 	        case THREAD_INDEX:
-		    writethreads(sd->count, sd->first_email);
 		    index_title = lang[MSG_LTITLE_DISCUSSION_THREADS];
 		    break;
 	        case SUBJECT_INDEX:
-		    writesubjects(sd->count, sd->first_email);
 		    index_title = lang[MSG_LTITLE_LISTED_BY_SUBJECT];
 		    break;
 		case AUTHOR_INDEX:
-		    writeauthors(sd->count, sd->first_email);
 		    index_title = lang[MSG_LTITLE_LISTED_BY_AUTHOR];
 		    break;
 		case ATTACHMENT_INDEX:
-		    writeattachments(sd->count, sd->first_email);
 		    index_title = lang[MSG_LTITLE_LISTED_BY_ATTACHMENT];
 		    break;
   	        default:
 		    index_title = "";
 		    break;
 	    }
-	    if (set_writehaof)
-	        writehaof(sd->count, sd->first_email);
-
-	    if (!fp)
-	        continue;
 
 	    if (!started_line) {
 	      time_t first_date = sd->first_email->fromdate;
@@ -3384,55 +3996,54 @@ void write_toplevel_indices(int amountmsgs)
 		strcat (verbose_period_name, lang[MSG_TO]);
 		strcat (verbose_period_name, end_date);
 	      }
-	      fprintf(fp, "  <tr%s>\n    <td scope=\"row\" class=\"period\" align=\"left\">%s",
+	      hm_fprintf(fp, "  <tr%s>\n    <td scope=\"row\" class=\"period\" align=\"left\">%s",
 		      (first) ? " class=\"first\"" : "",
 		      (first) ? "<a name=\"first\" id=\"first\"></a>" : "");
 	      /* only add a link to the index if it is not empty */
 	      if (sd->count > 0)
-		fprintf (fp, "<a title=\"%s %s\" href=\"%s%s\">",
+		hm_fprintf (fp, "<a title=\"%s %s\" href=\"%s%s\">",
 			 verbose_period_name, index_title, 
 			 sd->subdir, index_name[1][k]);
-	      fprintf (fp, "%s", abbr_period_name);
+	      hm_fprintf (fp, "%s", abbr_period_name);
 	      if (sd->count > 0)
-		fprintf (fp, "</a>");
-	      fprintf (fp, "</td>\n");
+		hm_fprintf (fp, "</a>");
+	      hm_fprintf (fp, "</td>\n");
 	      if (first)
 		first = FALSE;
 	      started_line = 1;
 	    } 
 	    else {
-	      fprintf(fp, "    <td>");
+	      hm_fprintf(fp, "    <td>");
 	      /* only add a link to the index if it is not empty */
 	      if (sd->count > 0)
-		fprintf (fp, "<a title=\"%s %s\" href=\"%s%s\">",
+		hm_fprintf (fp, "<a title=\"%s %s\" href=\"%s%s\">",
 			 verbose_period_name, index_title, 
 			 sd->subdir, index_name[1][k]);
-	      fprintf (fp, "%s", indextypename[k]);
+	      hm_fprintf (fp, "%s", indextypename[k]);
 	      if (sd->count > 0)
-		fprintf (fp, "</a>");
-	      fprintf (fp, "</td>\n");
+		hm_fprintf (fp, "</a>");
+	      hm_fprintf (fp, "</td>\n");
 	    }
 	}
 	if (started_line && fp)
-	    fprintf(fp, "    <td align=\"right\" class=\"count\">%d</td>\n  </tr>\n", sd->count);
+	    hm_fprintf(fp, "    <td align=\"right\" class=\"count\">%d</td>\n  </tr>\n", sd->count);
     }
     set_dateformat = saved_set_dateformat;
+    for (j = 0; j < 3; ++j) {
+	header_split_free(folder_lists[j]);
+	folder_lists[j] = NULL;
+    }
 
     if (fp) {
-      fprintf(fp, "</tbody>\n</table>\n");
+      hm_fprintf(fp, "</tbody>\n</table>\n");
       
       /* 
        * Print out archive information links at the bottom of the index
        */
       print_index_footer_links(fp, FOLDERS_INDEX, lastdatenum, amountmsgs, NULL);
       printfooter(fp, ihtmlfooterfile, set_label, set_dir, subject, filename, TRUE);
-      fclose(fp);
+      page_fclose(fp, filename);
       
-      if (newfile && chmod(filename, set_filemode) == -1) {
-	snprintf(errmsg, sizeof(errmsg), "%s \"%s\": %o.", lang[MSG_CANNOT_CHMOD], filename,
-		 set_filemode);
-	progerr(errmsg);
-	}
     }
     free(filename);
 }
@@ -3457,19 +4068,18 @@ void write_messageindex(int startnum, int maxnum)
 
     /* write the intial message and number of messages in the index */
 	filename = messageindex_name();
-	fp = fopen(filename, "w");
-	fprintf(fp, "%.04d %.04d\n", startnum, maxnum - 1);
+	fp = page_fopen(filename);
+	hm_fprintf(fp, "%.04d %.04d\n", startnum, maxnum - 1);
 
     /* write the reference to the message filenames */
     num = startnum;
     while (num <  maxnum) {
 		if ((bp = hashnumlookup(num, &email)) != NULL) {
 	  buf = message_name(email);
-	  fprintf(fp, "%.04d %s\n", num, buf);
+	  hm_fprintf(fp, "%.04d %s\n", num, buf);
 	}
       num++;
     }
-    fclose(fp);
-    chmod(filename, set_filemode);
+    page_fclose(fp, filename);
     free(filename);
 } /* end write_messageindex () */
@@ -4,8 +4,15 @@
 
 #ifdef GDBM
 int togdbm(void *gp, struct emailinfo *);
+void *gdbm_session(int);
+void *gdbm_session_new(void);
+void gdbm_session_close(void);
 #endif
 
+FILE *page_fopen(char *);
+void page_fclose(FILE *, char *);
+void page_report(void);
+
 void printcomment(FILE *, char *, char *);
 void print_headers(FILE *, struct emailinfo *, int);
 int print_links(FILE *, struct emailinfo *, int, int);
@@ -22,12 +29,12 @@ void writehaof(int, struct emailinfo *);
 
 void writeattachments(int, struct emailinfo *);
 
-void printdates(FILE *, struct header *, int, int, struct emailinfo *, char *);
-void printsubjects(FILE *, struct header *, char **, int, int,
+void printdates(FILE *, struct headerlist *, int, int, struct emailinfo *, char *);
+void printsubjects(FILE *, struct headerlist *, char **, int, int,
 		   struct emailinfo *);
-void printauthors(FILE *, struct header *, char **, int, int,
+void printauthors(FILE *, struct headerlist *, char **, int, int,
 		  struct emailinfo *);
-int printattachments(FILE *, struct header *, struct emailinfo *, bool *);
+int printattachments(FILE *, struct headerlist *, struct emailinfo *, bool *);
 
 int checkreplies(FILE *, int, int level, int thread_file_depth);
 void fprint_menu(FILE *, mindex_t, char *, char *, char *, int,
@@ -42,6 +49,9 @@ void printhtml(FILE *, char *);
 int showheader(char *);
 void ConvURLs(FILE *, char *, char *, char *, char *);
 char *ConvURLsString(char *, char *, char *, char *);
+int message_period(struct emailinfo *);
+int in_period(struct emailinfo *, int, int);
+void mark_touched_periods(int);
 void write_summary_indices(int);
 void write_toplevel_indices(int);
 struct emailinfo *nextinthread(int);
@@ -80,13 +80,13 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 		  cp = convchars(tmpptr,charset);
 		  if(tmpptr)
 		    free(tmpptr);
-		  fprintf(fp,
+		  hm_fprintf(fp,
 			"<meta name=\"Author\" content=\"%s (%s)\" />",
 			cp, obfuscate_email_address(email));
 		  if (cp)
 		    free(cp);
 #else
-		fprintf(fp,
+		hm_fprintf(fp,
 			"<meta name=\"Author\" content=\"%s (%s)\" />",
 			tmpptr=convchars(name,charset), obfuscate_email_address(email));
 		if (tmpptr)
@@ -113,7 +113,7 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 	    case 'c':
 		if (charset && *charset) {
 		    /* only output this if we have a charset */
-		    fprintf(fp, "<meta http-equiv=\"Content-Type\""
+		    hm_fprintf(fp, "<meta http-equiv=\"Content-Type\""
 			    " content=\"text/html; charset=%s\" />\n",
 			    charset);
 		}
@@ -121,7 +121,7 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 
 	    case 'D':		/* %D - date of message */
 		if (date) {
-		    fprintf(fp,
+		    hm_fprintf(fp,
 			    "<meta name=\"Date\" content=\"%s\" />",
 			    date);
 		}
@@ -180,10 +180,10 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 	    case 'S':		/* %s - Subject of message or Index Title */
 #ifdef HAVE_ICONV
 	        tmpptr=i18n_convstring(subject,"UTF-8",charset, &tmplen);
-		fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />",
+		hm_fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />",
 			cp = convchars(tmpptr,charset));
 #else
-		fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />",
+		hm_fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />",
 			cp = convchars(subject, charset));
 #endif
 		free(cp);
@@ -192,7 +192,7 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 	      {
 		struct emailinfo *ep;
 		if(hashnumlookup(0, &ep))
-		    fprintf(fp, ep->subdir ? ep->subdir->rel_path_to_top : "");
+		    hm_fprintf(fp, ep->subdir ? ep->subdir->rel_path_to_top : "");
 		continue;
 	      }
 	    case 'v':		/* %v - VERSION */
@@ -200,7 +200,7 @@ int printfile(FILE *fp, char *format, char *label, char *subject,
 		    putc(*cp, fp);
 		continue;
 	    case 'u':		/* %u - Expanded Version link */
-		fprintf(fp, "<a href=\"%s\">%s %s</a>",
+		hm_fprintf(fp, "<a href=\"%s\">%s %s</a>",
 			HMURL, PROGNAME, VERSION);
 		continue;
 	    default:
@@ -234,21 +234,21 @@ void print_main_header(FILE *fp, bool index_header, char *label, char *name,
       rp = charset;
     else
       rp = "ISO-8859-1";
-    fprintf(fp,
+    hm_fprintf(fp,
 	    "<?xml version=\"1.0\" encoding=\"%s\"?>\n"
 	    "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\"\n"
 	    "    \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd\">\n",
 	    rp);
-    fprintf(fp, "<html xmlns=\"http://www.w3.org/1999/xhtml\" lang=\"%s\">\n", set_language);
-    fprintf(fp, "<head>\n");
+    hm_fprintf(fp, "<html xmlns=\"http://www.w3.org/1999/xhtml\" lang=\"%s\">\n", set_language);
+    hm_fprintf(fp, "<head>\n");
 
     if (charset && *charset) {
 	/* charset info "as early as possible within the HEAD of the document"
 	 */
-	fprintf(fp, "<meta http-equiv=\"Content-Type\""
+	hm_fprintf(fp, "<meta http-equiv=\"Content-Type\""
 		" content=\"text/html; charset=%s\" />\n", charset);
     }
-    fprintf(fp, "<meta name=\"generator\" content=\"%s %s, see %s\" />\n",
+    hm_fprintf(fp, "<meta name=\"generator\" content=\"%s %s, see %s\" />\n",
                 PROGNAME, VERSION, HMURL);
 
     /* 
@@ -290,23 +290,23 @@ void print_main_header(FILE *fp, bool index_header, char *label, char *name,
       *(title+64) = '\0';
       */
 
-    fprintf(fp, "<title>%s</title>\n", (is_deleted) ? lang[MSG_SUBJECT_DELETED] : title);
+    hm_fprintf(fp, "<title>%s</title>\n", (is_deleted) ? lang[MSG_SUBJECT_DELETED] : title);
     free(title);
 
     if (name && email){
-      fprintf(fp, "<meta name=\"Author\" content=\"%s (%s)\" />\n",convchars(name,charset),obfuscate_email_address(email));
+      hm_fprintf(fp, "<meta name=\"Author\" content=\"%s (%s)\" />\n",convchars(name,charset),obfuscate_email_address(email));
     }
-    fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />\n", rp =
+    hm_fprintf(fp, "<meta name=\"Subject\" content=\"%s\" />\n", rp =
 	    convchars(subject, charset));
     free(rp);
     if (date)
-	fprintf(fp, "<meta name=\"Date\" content=\"%s\" />\n",date);
+	hm_fprintf(fp, "<meta name=\"Date\" content=\"%s\" />\n",date);
     if (use_mailto)
-	fprintf(fp, "<link rev=\"made\" href=\"mailto:%s\" />\n", set_mailto);
+	hm_fprintf(fp, "<link rev=\"made\" href=\"mailto:%s\" />\n", set_mailto);
 
     /* robot handling */
     if (index_header && set_noindex_onindexes) {
-      fprintf(fp,"<meta name=\"robots\" content=\"noindex\" />\n");
+      hm_fprintf(fp,"<meta name=\"robots\" content=\"noindex\" />\n");
 
     } else if (is_deleted || annotation_robot) {
       char *value;
@@ -321,16 +321,16 @@ void print_main_header(FILE *fp, bool index_header, char *label, char *name,
 	value = "noindex";
       else if (annotation_robot == 3)
 	value = "nofollow, noindex";
-      fprintf(fp,"<meta name=\"robots\" content=\"%s\" />\n", value);
+      hm_fprintf(fp,"<meta name=\"robots\" content=\"%s\" />\n", value);
     }
 
     /* print the css url according to the type of header */
     if (index_header && set_icss_url && *set_icss_url) {
-      fprintf(fp, "<link rel=\"stylesheet\" href=\"%s\" type=\"text/css\" />\n",
+      hm_fprintf(fp, "<link rel=\"stylesheet\" href=\"%s\" type=\"text/css\" />\n",
               set_icss_url);
 
     } else if (!index_header && set_mcss_url && *set_mcss_url) {
-      fprintf(fp, "<link rel=\"stylesheet\" href=\"%s\" type=\"text/css\" />\n",
+      hm_fprintf(fp, "<link rel=\"stylesheet\" href=\"%s\" type=\"text/css\" />\n",
               set_mcss_url);
 
     } else {
@@ -338,38 +338,38 @@ void print_main_header(FILE *fp, bool index_header, char *label, char *name,
        * if style sheets are not specified, emit a default one.
        */
        /* @@ JK: the new css */
-      fprintf (fp, "<style type=\"text/css\">\n");
+      hm_fprintf (fp, "<style type=\"text/css\">\n");
       
-      fprintf (fp,"/*<![CDATA[*/\n");
-      fprintf (fp, "/* To be incorporated in the main stylesheet, don't code it in hypermail! */\n");
-      fprintf (fp, "body {color: black; background: #ffffff;}\n");
-      fprintf (fp, "dfn {font-weight: bold;}\n");
-      fprintf (fp, "pre { background-color:inherit;}\n");
-      fprintf (fp, ".head { border-bottom:1px solid black;}\n");
-      fprintf (fp, ".foot { border-top:1px solid black;}\n");
-      fprintf (fp, "th {font-style:italic;}\n");
-      fprintf (fp, "table { margin-left:2em;}");
+      hm_fprintf (fp,"/*<![CDATA[*/\n");
+      hm_fprintf (fp, "/* To be incorporated in the main stylesheet, don't code it in hypermail! */\n");
+      hm_fprintf (fp, "body {color: black; background: #ffffff;}\n");
+      hm_fprintf (fp, "dfn {font-weight: bold;}\n");
+      hm_fprintf (fp, "pre { background-color:inherit;}\n");
+      hm_fprintf (fp, ".head { border-bottom:1px solid black;}\n");
+      hm_fprintf (fp, ".foot { border-top:1px solid black;}\n");
+      hm_fprintf (fp, "th {font-style:italic;}\n");
+      hm_fprintf (fp, "table { margin-left:2em;}");
 
       /* JK: This was the WAI rule before */
-      /* fprintf (fp, "#body {background-color:#fff;}\n"); */
-      fprintf (fp, "map ul {list-style:none;}\n");
-      fprintf (fp, "#mid { font-size:0.9em;}\n");
-      fprintf (fp, "#received { float:right;}\n");
-      fprintf (fp, "address { font-style:inherit;}\n");
-      fprintf (fp, "/*]]>*/\n");
-      fprintf(fp, ".quotelev1 {color : #990099;}\n");
-      fprintf(fp, ".quotelev2 {color : #ff7700;}\n");
-      fprintf(fp, ".quotelev3 {color : #007799;}\n");
-      fprintf(fp, ".quotelev4 {color : #95c500;}\n");
-      fprintf (fp, ".period {font-weight: bold;}\n");
-      fprintf (fp, "</style>\n");
+      /* hm_fprintf (fp, "#body {background-color:#fff;}\n"); */
+      hm_fprintf (fp, "map ul {list-style:none;}\n");
+      hm_fprintf (fp, "#mid { font-size:0.9em;}\n");
+      hm_fprintf (fp, "#received { float:right;}\n");
+      hm_fprintf (fp, "address { font-style:inherit;}\n");
+      hm_fprintf (fp, "/*]]>*/\n");
+      hm_fprintf(fp, ".quotelev1 {color : #990099;}\n");
+      hm_fprintf(fp, ".quotelev2 {color : #ff7700;}\n");
+      hm_fprintf(fp, ".quotelev3 {color : #007799;}\n");
+      hm_fprintf(fp, ".quotelev4 {color : #95c500;}\n");
+      hm_fprintf (fp, ".period {font-weight: bold;}\n");
+      hm_fprintf (fp, "</style>\n");
     }
 
     if (ihtmlheadfile)
-      fprintf (fp, "%s", ihtmlheadfile);
+      hm_fprintf (fp, "%s", ihtmlheadfile);
 
-    fprintf(fp, "</head>\n");
-    fprintf(fp, "<body>\n");
+    hm_fprintf(fp, "</head>\n");
+    hm_fprintf(fp, "<body>\n");
 }
 
 /*
@@ -422,12 +422,12 @@ void print_index_header(FILE *fp, char *label, char *dir, char *subject,
 #else
         print_main_header(fp, TRUE, label, NULL, NULL, subject, NULL, NULL, NULL, 0, 0);
 #endif
-	fprintf (fp, "<div class=\"head\">\n");
+	hm_fprintf (fp, "<div class=\"head\">\n");
 	if (ihtmlnavbar2upfile)
-	  fprintf(fp, "<map title=\"%s\" id=\"upper\">\n%s</map>\n", 
+	  hm_fprintf(fp, "<map title=\"%s\" id=\"upper\">\n%s</map>\n", 
 		  lang[MSG_NAVBAR2UPPERLEVELS], ihtmlnavbar2upfile);
 
-	fprintf(fp, "<h1>%s %s</h1>\n", label, subject);
+	hm_fprintf(fp, "<h1>%s %s</h1>\n", label, subject);
     }
 }
 
@@ -444,15 +444,15 @@ void printfooter(FILE *fp, char *htmlfooter, char *label, char *dir,
 	printfile(fp, htmlfooter, label, subject,
 		  dir, NULL, NULL, NULL, NULL, NULL, filename);
     else {
-	fprintf(fp, "<p><small><em>\n");
-	fprintf(fp, "%s ", lang[MSG_ARCHIVE_GENERATED_BY]);
-	fprintf(fp, "<a href=\"%s\">%s %s</a>\n", HMURL, PROGNAME, VERSION);
-	fprintf(fp, ": %s\n", getlocaltime());
-	fprintf(fp, "</em></small></p>\n");
+	hm_fprintf(fp, "<p><small><em>\n");
+	hm_fprintf(fp, "%s ", lang[MSG_ARCHIVE_GENERATED_BY]);
+	hm_fprintf(fp, "<a href=\"%s\">%s %s</a>\n", HMURL, PROGNAME, VERSION);
+	hm_fprintf(fp, ": %s\n", getlocaltime());
+	hm_fprintf(fp, "</em></small></p>\n");
     }
     if (close_div)
-      fprintf (fp, "</div>\n");
-    fprintf(fp, "</body>\n</html>\n");
+      hm_fprintf (fp, "</div>\n");
+    hm_fprintf(fp, "</body>\n</html>\n");
 }
 
 /*
@@ -461,10 +461,10 @@ void printfooter(FILE *fp, char *htmlfooter, char *label, char *dir,
 
 void printlaststats (FILE *fp, long lastdatenum)
 {
-    fprintf (fp, "<ul>\n");
-    fprintf (fp, "<li><dfn><a id=\"end\" name=\"end\">%s</a></dfn>: <em>%s</em></li>\n",
+    hm_fprintf (fp, "<ul>\n");
+    hm_fprintf (fp, "<li><dfn><a id=\"end\" name=\"end\">%s</a></dfn>: <em>%s</em></li>\n",
 	     lang[MSG_LAST_MESSAGE_DATE], getdatestr(lastdatenum));
 
-    fprintf (fp, "<li><dfn>%s</dfn>: %s</li>\n",  lang[MSG_ARCHIVED_ON], getlocaltime());
-    fprintf (fp, "</ul>\n");
+    hm_fprintf (fp, "<li><dfn>%s</dfn>: %s</li>\n",  lang[MSG_ARCHIVED_ON], getlocaltime());
+    hm_fprintf (fp, "</ul>\n");
 }
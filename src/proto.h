@@ -19,6 +19,8 @@ char *secs_to_iso_meta(time_t);
 time_t iso_to_secs(char *);
 int year_of_datenum(time_t);
 int month_of_datenum(time_t);
+struct tm *datenum_tm(time_t, struct tm *);
+struct tm *local_tm(time_t, struct tm *);
 
 /*
 ** domains.c
@@ -34,6 +36,7 @@ int isdir(char *);
 int isfile(char *);
 void check1dir(char *);
 void checkdir(char *);
+int replace_file(const char *, const char *);
 char *getfilecontents(char *);
 char *add_char(char *, char);
 char *add_string(char *, char *);
@@ -77,11 +80,20 @@ char **valid_language(char *, char **);
 */
 void lock_archive(char *);
 void unlock_archive(void);
+extern int i_locked_it;
 
 /*
 ** mem.c function
 */
 void *emalloc(int);
+void *erealloc(void *, int);
+struct arena *arena_new(void);
+void *arena_alloc(struct arena *, int);
+char *arena_strsav(struct arena *, const char *);
+long arena_mark(struct arena *);
+void arena_release(struct arena *, long);
+void arena_free(struct arena *);
+void arena_report(void);
 
 /*
 ** setup.c functions
@@ -104,6 +116,7 @@ int i18n_replace_non_ascii_chars(char *);
 char *PushByte(struct Push *, char);
 char *PushString(struct Push *, const char *);
 char *PushNString(struct Push *, const char *, int);
+int hm_fprintf(FILE *, const char *, ...);
 
 char *strcasestr (const char *, const char *);
 char *strsav(const char *);
@@ -20,58 +20,57 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <sys/stat.h>
 #include "proto.h"
 #include "setup.h"
 #include "struct.h"
 #include "print.h"
 #include "search.h"
 
-static int bigram_count = 0;
 static struct reply *replylist_tmp;
 
-#if 1
-typedef unsigned long BIGRAM_TYPE;
-static const unsigned max_tokens = 400000; /* increase this if you have plenty of RAM */
-#else				/* for systems with little RAM and archives less than 10 megs? */
-typedef unsigned short BIGRAM_TYPE;
-static const unsigned max_tokens = 0xfff0;
-#endif
+/*
+** Quoted text is found through the bigrams (pairs of neighbouring
+** words) of the message bodies. Each distinct word gets a number from
+** the token table, keyed by its length and case folded CRC-32. The
+** bigram table maps a pair of word numbers to a list of the places in
+** the bodies where that pair occurs, newest first. Both tables use
+** open addressing with linear probing and double in size when they get
+** three quarters full, and the places live in one growing array, so
+** nothing has to be sized up front.
+*/
 
-struct bigram_list {
-    struct body *bp;
-    short offset;
-    struct bigram_list *next;
+#define SEARCH_MIN_SIZE 4096
+
+struct token_slot {
+    unsigned int crc32;
+    int length;
+    int itok;			/* 0 if the slot is free */
 };
 
-struct bigram_tree_entry {
-    struct bigram_tree_entry *left;
-    struct bigram_tree_entry *right;
-    struct bigram_list list;
-    BIGRAM_TYPE bigram1;
-    BIGRAM_TYPE bigram2;
+struct bigram_slot {
+    int itok1;			/* 0 if the slot is free */
+    int itok2;
+    int first;			/* newest place in places[] */
 };
-static struct bigram_tree_entry *bigram_tree = NULL;
-
-#define MAXSEARCHTOKEN 26
-struct search_text {
-    struct search_text *left;
-    struct search_text *right;
-#ifdef BY_TOKEN_STRING
-    char token[MAXSEARCHTOKEN];
-#else
-    int token_length;
-    unsigned int token_crc32;
-#endif				/* !BY_TOKEN_STRING */
-    BIGRAM_TYPE itok;
-#ifdef COUNT_TOKEN_FREQ
-    int count;
-#endif
+
+struct bigram_place {
+    struct body *bp;
+    int offset;			/* of the end of the bigram in bp->line */
+    int next;			/* older place, or -1 */
 };
-static struct search_text *text_tree = NULL;
-static BIGRAM_TYPE next_itoken = 1;
 
-static int start_time;
-static int tree_alloc = 0;
+static struct token_slot *tokens;
+static unsigned token_size;
+static unsigned token_count;
+
+static struct bigram_slot *bigrams;
+static unsigned bigram_size;
+static unsigned bigram_count;
+
+static struct bigram_place *places;
+static int place_count;
+static int place_alloc;
 
 static void add_old_replies(void);
 static void find_replyto_from_html(int num);
@@ -81,29 +80,6 @@ void set_alt_replylist(struct reply *r)
     replylist_tmp = r;
 }
 
-/* change the order of itok entries for more balanced tree */
-static BIGRAM_TYPE reverse_bits(BIGRAM_TYPE i)
-{
-    BIGRAM_TYPE r = 0;
-    int j;
-    for (j = 0; j < 16; ++j)
-	if (i & (1 << j))
-	    r |= (1 << (16 - 1 - j));
-    return r;
-}
-
-#ifdef BY_TOKEN_STRING
-#define ENCODE_TOKEN(a)	encode_token(a)
-#define COMPARE_TOKEN(a, b)	strcasecmp(a, (b)->token)
-#else
-#define ENCODE_TOKEN(a)	encode_token((a), strlen(a))
-#define COMPARE_TOKEN(a, b)	token_digest_order(token_length, token_crc32, (b))
-
-static int token_digest_order(const int token_length, const unsigned int token_crc32, const struct search_text *const p)
-{
-	return ((token_length > p->token_length) ? 1 : (token_length < p->token_length) ? -1 : (token_crc32 > p->token_crc32) ? 1 : (token_crc32 < p->token_crc32) ? -1 : 0);
-}
-
 /* crc32.c -- compute the CRC-32 of a data stream
  * Copyright (C) 1995 Mark Adler
  * For conditions of distribution and use, see copyright notice in zlib.h
@@ -193,173 +169,154 @@ static unsigned int crc32_lower(register const unsigned char *buf,	/* pointer to
 	} while (--len);
     return crc ^ 0xffffffffL;	/* (instead of ~c for 64-bit machines) */
 }
-#endif				/* !BY_TOKEN_STRING */
 
-static int encode_token(const char *token
-#ifndef BY_TOKEN_STRING
-			, const int token_length
-#endif
-    )
+static unsigned search_start(unsigned hashval, unsigned size)
 {
-    struct search_text *p = text_tree;
-#ifndef BY_TOKEN_STRING
-    unsigned int token_crc32 = crc32_lower((const unsigned char *)token, token_length);
-#endif
-    int r;
-    while (1) {
-	if (!p) {
-	    return 0;
-	}
-#ifdef BY_TOKEN_STRING
-	r = COMPARE_TOKEN(token, p);
-#else
-	r = token_length - p->token_length;
-	if (!r)
-			r = ((token_crc32 > p->token_crc32) ? 1 : (token_crc32 < p->token_crc32) ? -1 : 0);
-#endif				/* !BY_TOKEN_STRING */
-	if (!r)
-	    return p->itok;
-	if (r < 0)
-	    p = p->left;
-	else
-	    p = p->right;
+    hashval ^= hashval >> 16;
+    hashval *= 0x45d9f3b;
+    hashval ^= hashval >> 16;
+    return hashval & (size - 1);
+}
+
+static struct token_slot *token_slot(unsigned int crc32, int length)
+{
+    unsigned i;
+
+    for (i = search_start(crc32 ^ length, token_size); tokens[i].itok;
+	 i = (i + 1) & (token_size - 1)) {
+	if (tokens[i].crc32 == crc32 && tokens[i].length == length)
+	    break;
     }
+    return &tokens[i];
 }
 
-static int b_times_entered;
-static int b_loops_done;
+static struct bigram_slot *bigram_slot(int itok1, int itok2)
+{
+    unsigned i;
 
-static int addb(const char *token, struct body *bp)
+    for (i = search_start(itok1 * 0x9e3779b1u + itok2, bigram_size);
+	 bigrams[i].itok1; i = (i + 1) & (bigram_size - 1)) {
+	if (bigrams[i].itok1 == itok1 && bigrams[i].itok2 == itok2)
+	    break;
+    }
+    return &bigrams[i];
+}
+
+static void grow_tokens(void)
 {
-    struct search_text **pp = &text_tree;
-    struct search_text *p = *pp;
-    int r;
-#ifndef BY_TOKEN_STRING
-    int token_length = strlen(token);
-    unsigned int token_crc32 = crc32_lower((const unsigned char *)token, token_length);
-#endif
-    static struct search_text *next_token = NULL;
-    if (!text_tree) {
-	next_token = (struct search_text *)malloc(max_tokens * sizeof(struct search_text));
-	if (!next_token) {
-	    snprintf(errmsg, sizeof(errmsg), "Couldn't allocate %d bytes of memory.", max_tokens * sizeof(struct search_text));
-	    progerr(errmsg);
-	}
-	memset(next_token, 0, max_tokens * sizeof(struct search_text));
+    struct token_slot *old = tokens;
+    unsigned oldsize = token_size;
+    unsigned i;
+
+    token_size = oldsize ? oldsize * 2 : SEARCH_MIN_SIZE;
+    tokens = (struct token_slot *)emalloc(token_size * sizeof(struct token_slot));
+    memset(tokens, 0, token_size * sizeof(struct token_slot));
+    for (i = 0; i < oldsize; i++) {
+	if (old[i].itok)
+	    *token_slot(old[i].crc32, old[i].length) = old[i];
     }
-    ++b_times_entered;
-    while (1) {
-	++b_loops_done;
-	p = *pp;
-	if (!p) {
-	    *pp = p = next_token++;
-	    if (next_token >= text_tree + max_tokens) {
-		snprintf(errmsg, sizeof(errmsg), "Too many distinct tokens(%d)", max_tokens);
-		progerr(errmsg);
-	    }
-	    p->left = p->right = NULL;
-#ifdef BY_TOKEN_STRING
-	    strncpy(p->token, token, MAXSEARCHTOKEN);
-	    p->token[MAXSEARCHTOKEN - 1] = 0;
-#else
-	    p->token_length = token_length;
-	    p->token_crc32 = token_crc32;
-#endif				/* !BY_TOKEN_STRING */
-	    p->itok = reverse_bits(next_itoken++);
-#ifdef COUNT_TOKEN_FREQ
-	    p->count = 1;
-#endif
-	    if (!next_itoken >= max_tokens) {
-		snprintf(errmsg, sizeof(errmsg), "Internal error - too many distinct tokens.");
-		progerr(errmsg);
-	    }
-	    return p->itok;
-	}
-	r = COMPARE_TOKEN(token, p);
-	if (!r) {
-#ifdef COUNT_TOKEN_FREQ
-	    ++p->count;
-#endif
-	    return p->itok;
-	}
-	if (r < 0)
-	    pp = &p->left;
-	else
-	    pp = &p->right;
+    if (old)
+	free(old);
+}
+
+static void grow_bigrams(void)
+{
+    struct bigram_slot *old = bigrams;
+    unsigned oldsize = bigram_size;
+    unsigned i;
+
+    bigram_size = oldsize ? oldsize * 2 : SEARCH_MIN_SIZE;
+    bigrams = (struct bigram_slot *)emalloc(bigram_size * sizeof(struct bigram_slot));
+    memset(bigrams, 0, bigram_size * sizeof(struct bigram_slot));
+    for (i = 0; i < oldsize; i++) {
+	if (old[i].itok1)
+	    *bigram_slot(old[i].itok1, old[i].itok2) = old[i];
     }
+    if (old)
+	free(old);
 }
 
-static int bi_times_entered;
+/*
+** Returns the number of a word, 0 if no body has it.
+*/
 
+static int encode_token(const char *token)
+{
+    int length = strlen(token);
+
+    if (!token_size)
+	return 0;
+    return token_slot(crc32_lower((const unsigned char *)token, length), length)->itok;
+}
 
-static void add_bigram(BIGRAM_TYPE b1, BIGRAM_TYPE b2, struct body *bp, char *ptr)
+/*
+** Returns the number of a word, giving it one if it is new.
+*/
+
+static int addb(const char *token)
 {
-    static struct bigram_tree_entry *next_bigram = NULL;
-    struct bigram_tree_entry **pp = &bigram_tree;
-    struct bigram_tree_entry *p = *pp;
-    int r;
-    if (!bigram_tree) {
-	if (0)
-	    printf("bigram_count %d\n\n", bigram_count);
-		bigram_tree = (struct bigram_tree_entry *)malloc(bigram_count * sizeof(struct bigram_tree_entry));
-	if (!bigram_tree) {
-			snprintf(errmsg, sizeof(errmsg), "Couldn't allocate %d bytes of memory.", bigram_count * sizeof(struct bigram_tree_entry));
-	    progerr(errmsg);
-	}
-		memset(bigram_tree, 0, bigram_count * sizeof(struct bigram_tree_entry));
-	next_bigram = bigram_tree;
-    }
-    ++bi_times_entered;
-    while (1) {
-	p = *pp;
-	if (!p) {
-	    *pp = p = next_bigram++;
-	    tree_alloc += sizeof(struct bigram_tree_entry);
-	    p->bigram1 = b1;
-	    p->bigram2 = b2;
-	    p->left = p->right = NULL;
-	    p->list.offset = ptr - bp->line;
-	    p->list.bp = bp;
-	    p->list.next = NULL;
-	    return;
-	}
-	r = p->bigram1 - b1;
-	if (!r && !(r = p->bigram2 - b2)) {
-	    struct bigram_list *old = p->list.next;
-	    p->list.next = (struct bigram_list *)next_bigram++;
-	    p->list.next->next = old;
-	    p->list.next->offset = p->list.offset;
-	    p->list.next->bp = p->list.bp;
-	    p->list.offset = ptr - bp->line;
-	    p->list.bp = bp;
-	    return;
-	}
-	if (r < 0)
-	    pp = &p->left;
-	else
-	    pp = &p->right;
+    int length = strlen(token);
+    unsigned int crc32 = crc32_lower((const unsigned char *)token, length);
+    struct token_slot *t;
+
+    if ((token_count + 1) * 4 > token_size * 3)
+	grow_tokens();
+    t = token_slot(crc32, length);
+    if (!t->itok) {
+	t->crc32 = crc32;
+	t->length = length;
+	t->itok = ++token_count;
     }
+    return t->itok;
 }
 
-static struct bigram_list *find_bigram(BIGRAM_TYPE b1, BIGRAM_TYPE b2)
+static void add_bigram(int b1, int b2, struct body *bp, char *ptr)
 {
-    struct bigram_tree_entry *p = bigram_tree;
-    int r;
-    while (1) {
-	if (!p) {
-	    return NULL;
-	}
-	r = p->bigram1 - b1;
-	if (!r)
-	    r = p->bigram2 - b2;
-	if (!r) {
-	    return &p->list;
+    struct bigram_slot *b;
+    struct bigram_place *place;
+
+    if ((bigram_count + 1) * 4 > bigram_size * 3)
+	grow_bigrams();
+    b = bigram_slot(b1, b2);
+    if (!b->itok1) {
+	b->itok1 = b1;
+	b->itok2 = b2;
+	b->first = -1;
+	++bigram_count;
+    }
+    if (place_count == place_alloc) {
+	place_alloc = place_alloc ? place_alloc * 2 : SEARCH_MIN_SIZE;
+	places = (struct bigram_place *)realloc(places, place_alloc * sizeof(struct bigram_place));
+	if (!places) {
+	    snprintf(errmsg, sizeof(errmsg), "Couldn't allocate %lu bytes of memory.",
+		     (unsigned long)(place_alloc * sizeof(struct bigram_place)));
+	    progerr(errmsg);
 	}
-	if (r < 0)
-	    p = p->left;
-	else
-	    p = p->right;
     }
+    place = &places[place_count];
+    place->bp = bp;
+    place->offset = ptr - bp->line;
+    place->next = b->first;
+    b->first = place_count++;
+}
+
+/*
+** Returns the newest place of a bigram, NULL if it isn't in any body.
+*/
+
+static struct bigram_place *find_bigram(int b1, int b2)
+{
+    struct bigram_slot *b;
+
+    if (!bigram_size || !b1 || !b2)
+	return NULL;
+    b = bigram_slot(b1, b2);
+    return b->itok1 ? &places[b->first] : NULL;
+}
+
+static struct bigram_place *next_place(struct bigram_place *place)
+{
+    return place->next == -1 ? NULL : &places[place->next];
 }
 
 static struct body *next_body_pos(struct body *bp, char **ptr)
@@ -449,42 +406,21 @@ struct body *tokenize_body(struct body *bp, char *token, char **ptr, int *bigram
     return bp;
 }
 
-static void add_search_text(struct body *bp, int msgnum)
-{
-    char *ptr = bp->line;
-    int bigram_index = 0;
-    char token[MAXLINE];
-    if (!start_time)
-	start_time = time(NULL);
-	while ((bp = tokenize_body(bp, token, &ptr, &bigram_index, TRUE)) != NULL) {
-	addb(token, bp);
-	++bigram_count;
-    }
-    if (0)
-		printf("avg b %d avg bi %d (%d) msgnum %d %d allocated %d elapsed %ld\n", b_loops_done / b_times_entered, 0, bi_times_entered, msgnum, tree_alloc / 1024, time(NULL) - start_time, next_itoken);
-}
-
 static void add_bigrams(struct body *bp, int msgnum)
 {
     int last_itok = 0;
-    static int bigram_index = 0;
-#if 0
-    struct body *bp = hashnum_set_index(msgnum, bigram_index);
-#endif
+    int bigram_index = 0;
     char *ptr = bp->line;
     char token[MAXLINE];
     int itok;
-    if (!start_time)
-	start_time = time(NULL);
-	while ((bp = tokenize_body(bp, token, &ptr, &bigram_index, TRUE)) != NULL) {
-	itok = ENCODE_TOKEN(token);
+
+    while ((bp = tokenize_body(bp, token, &ptr, &bigram_index, TRUE)) != NULL) {
+	itok = addb(token);
 	if (last_itok)
 	    add_bigram(last_itok, itok, bp, ptr);
 	bp->msgnum = msgnum;
 	last_itok = itok;
     }
-    if (0 && b_times_entered && bi_times_entered)
-		printf("avg b %d msgnum %d %d allocated %d elapsed %ld\n", b_loops_done / b_times_entered, msgnum, tree_alloc / 1024, time(NULL) - start_time, next_itoken);
 }
 
 static void add_old_replies()
@@ -496,6 +432,9 @@ static void add_old_replies()
 	    if (rp->frommsgnum == rp2->frommsgnum) {
 		rp->msgnum = rp2->msgnum;
 		rp->maybereply = 0;
+#ifdef FASTREPLYCODE
+		index_reply(rp);
+#endif
 		break;
 	    }
 	}
@@ -511,38 +450,257 @@ static void add_old_replies()
     }
 }
 
-static void find_replyto_from_html(int num)
+/*
+** The "In reply to" links of the old article pages. Reading every page
+** for them on each incremental run is the slow part of analyze_headers,
+** so they are kept in REPLY_INDEX_NAME together with the inode, size and
+** mtime of the page they came from. A page whose stat() still matches
+** its record is not opened again. The file is a head followed by the
+** fixed size records and the links they point into, in host byte order;
+** anything unexpected in it just means all pages get read.
+*/
+
+#define REPLYINDEX_MAGIC	"HMRPLIX"
+#define REPLYINDEX_VERSION	1
+
+struct replyindex_head {
+    char magic[8];
+    int version;
+    int recsize;		/* sizeof(struct replyindex_rec) of the writer */
+    int nrecords;
+    int nlinks;
+};
+
+struct replyindex_rec {
+    long ino;
+    long size;
+    long mtime;
+    int first;			/* index of the first link */
+    int count;			/* number of links, -1 if not known */
+};
+
+static struct replyindex_rec *reply_recs;
+static int reply_nrecs;
+static int *reply_links;
+static int reply_nlinks;
+static int reply_linkalloc;
+static int reply_loaded;
+
+static char *replyindex_name(char *dir)
 {
-    char *filename;
+    char *name;
+
+    trio_asprintf(&name, (dir[strlen(dir) - 1] == '/') ? "%s%s" : "%s/%s",
+		  dir, REPLY_INDEX_NAME);
+    return name;
+}
+
+static void grow_reply_recs(int num)
+{
+    int n = reply_nrecs ? reply_nrecs : 1024;
+
+    while (n <= num)
+	n *= 2;
+    reply_recs = (struct replyindex_rec *)erealloc(reply_recs, n * sizeof(struct replyindex_rec));
+    for (; reply_nrecs < n; reply_nrecs++)
+	reply_recs[reply_nrecs].count = -1;
+}
+
+static void add_reply_link(int msgn)
+{
+    if (reply_nlinks == reply_linkalloc) {
+	reply_linkalloc = reply_linkalloc ? 2 * reply_linkalloc : 1024;
+	reply_links = (int *)erealloc(reply_links, reply_linkalloc * sizeof(int));
+    }
+    reply_links[reply_nlinks++] = msgn;
+}
+
+static void replyindex_load(char *dir)
+{
+    struct replyindex_head head;
+    char *name;
+    FILE *fp;
+    int ok = FALSE;
+
+    reply_loaded = TRUE;
+    name = replyindex_name(dir);
+    fp = fopen(name, "r");
+    free(name);
+    if (!fp)
+	return;
+    if (fread(&head, sizeof(head), 1, fp) == 1
+	&& !memcmp(head.magic, REPLYINDEX_MAGIC, sizeof(head.magic))
+	&& head.version == REPLYINDEX_VERSION
+	&& head.recsize == sizeof(struct replyindex_rec)
+	&& head.nrecords > 0 && head.nlinks >= 0) {
+	int i;
+
+	grow_reply_recs(head.nrecords - 1);
+	reply_linkalloc = head.nlinks + 1024;
+	reply_links = (int *)erealloc(reply_links, reply_linkalloc * sizeof(int));
+	ok = fread(reply_recs, sizeof(struct replyindex_rec), head.nrecords, fp)
+	     == (size_t)head.nrecords
+	     && fread(reply_links, sizeof(int), head.nlinks, fp)
+	     == (size_t)head.nlinks;
+	for (i = 0; ok && i < head.nrecords; i++)
+	    if (reply_recs[i].count >= 0
+		&& (reply_recs[i].first < 0
+		    || reply_recs[i].count > head.nlinks - reply_recs[i].first))
+		ok = FALSE;
+	if (ok)
+	    reply_nlinks = head.nlinks;
+    }
+    fclose(fp);
+    if (!ok) {
+	int i;
+	for (i = 0; i < reply_nrecs; i++)
+	    reply_recs[i].count = -1;
+    }
+}
+
+/*
+** Return the record with the links on the page of message num, reading
+** the page only if it changed since the record was made. Returns NULL
+** if the page can't be read.
+*/
+
+static struct replyindex_rec *reply_record(int num, char *filename)
+{
+    struct replyindex_rec *rec;
+    struct stat st;
     char line[MAXLINE];
     FILE *fp;
     char *ptr;
     static const char *href_str = "<a href=\"";
+
+    if (!reply_loaded)
+	replyindex_load(set_dir);
+    if (num >= reply_nrecs)
+	grow_reply_recs(num);
+    rec = reply_recs + num;
+    if (stat(filename, &st) == -1) {
+	rec->count = -1;
+	return NULL;
+    }
+    if (rec->count >= 0 && rec->ino == (long)st.st_ino
+	&& rec->size == (long)st.st_size && rec->mtime == (long)st.st_mtime)
+	return rec;
+
+    rec->count = -1;
+    if ((fp = fopen(filename, "r")) == NULL)
+	return NULL;
+    rec->first = reply_nlinks;
+    while (fgets(line, MAXLINE, fp)) {
+	if ((ptr = strcasestr(line, lang[MSG_IN_REPLY_TO])) != NULL) {
+	    const char *ptr2 = strcasestr(ptr, href_str);
+	    if (ptr2 != NULL)
+		add_reply_link(atoi(ptr2 + strlen(href_str)));
+	}
+	if (!strcmp(line, "<!-- lnextthread=\"start\" -->\n"))
+	    break;
+    }
+    fclose(fp);
+    rec->count = reply_nlinks - rec->first;
+    rec->ino = (long)st.st_ino;
+    rec->size = (long)st.st_size;
+    rec->mtime = (long)st.st_mtime;
+    return rec;
+}
+
+static void find_replyto_from_html(int num)
+{
+    char *filename;
+    struct replyindex_rec *rec;
     struct emailinfo *ep;
+    int i;
+
     if (!hashnumlookup(num, &ep))
 	return;
     filename = articlehtmlfilename(ep);
-    if ((fp = fopen(filename, "r")) != NULL) {
-	while (fgets(line, MAXLINE, fp)) {
-	    if ((ptr = strcasestr(line, lang[MSG_IN_REPLY_TO])) != NULL) {
-		const char *ptr2 = strcasestr(ptr, href_str);
-		if (ptr2 != NULL) {
-		    int msgn = atoi(ptr2 + strlen(href_str));
+    rec = reply_record(num, filename);
+    free(filename);
+    if (!rec)
+	return;
+    for (i = rec->first; i < rec->first + rec->count; i++) {
+	int msgn = reply_links[i];
 #ifdef FASTREPLYCODE
-		    struct emailinfo *email2;
-		    if (hashnumlookup(msgn, &email2))
-						replylist_tmp = addreply2(replylist_tmp, email2, ep, 0, NULL);
+	struct emailinfo *email2;
+	if (hashnumlookup(msgn, &email2))
+	    replylist_tmp = addreply2(replylist_tmp, email2, ep, 0, NULL);
 #else
-		    replylist_tmp = addreply(replylist_tmp, msgn, ep, 0, NULL);
+	replylist_tmp = addreply(replylist_tmp, msgn, ep, 0, NULL);
 #endif
-		}
-	    }
-	    if (!strcmp(line, "<!-- lnextthread=\"start\" -->\n"))
-		break;
+    }
+}
+
+/*
+** Save the links of the pages of messages 0 to maxnum - 1 for the next
+** run. Only the pages written since analyze_headers() looked at them
+** need to be read again here.
+*/
+
+void replyindex_write(char *dir, int maxnum)
+{
+    struct replyindex_head head;
+    struct replyindex_rec *recs;
+    int *links;
+    int nlinks = 0;
+    char *name;
+    char *tmpname;
+    FILE *fp;
+    int num;
+    int ok;
+
+    if (maxnum <= 0)
+	return;
+    recs = (struct replyindex_rec *)emalloc(maxnum * sizeof(struct replyindex_rec));
+    links = NULL;
+    for (num = 0; num < maxnum; num++) {
+	struct emailinfo *ep;
+	struct replyindex_rec *rec = NULL;
+
+	if (hashnumlookup(num, &ep)) {
+	    char *filename = articlehtmlfilename(ep);
+	    rec = reply_record(num, filename);
+	    free(filename);
+	}
+	if (!rec) {
+	    memset(recs + num, 0, sizeof(struct replyindex_rec));
+	    recs[num].count = -1;
+	    continue;
+	}
+	recs[num] = *rec;
+	recs[num].first = nlinks;
+	if (rec->count) {
+	    links = (int *)erealloc(links, (nlinks + rec->count) * sizeof(int));
+	    memcpy(links + nlinks, reply_links + rec->first, rec->count * sizeof(int));
+	    nlinks += rec->count;
 	}
-	fclose(fp);
     }
-    free(filename);
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, REPLYINDEX_MAGIC, sizeof(head.magic));
+    head.version = REPLYINDEX_VERSION;
+    head.recsize = sizeof(struct replyindex_rec);
+    head.nrecords = maxnum;
+    head.nlinks = nlinks;
+
+    name = replyindex_name(dir);
+    trio_asprintf(&tmpname, "%s.tmp", name);
+    if ((fp = fopen(tmpname, "w")) != NULL) {
+	ok = fwrite(&head, sizeof(head), 1, fp) == 1
+	    && fwrite(recs, sizeof(struct replyindex_rec), maxnum, fp)
+	       == (size_t)maxnum
+	    && (size_t)fwrite(links, sizeof(int), nlinks, fp) == (size_t)nlinks;
+	if (fclose(fp))
+	    ok = FALSE;
+	if (!ok || replace_file(tmpname, name) == -1)
+	    unlink(tmpname);
+    }
+    free(tmpname);
+    free(name);
+    free(links);
+    free(recs);
 }
 
 void analyze_headers(int max_num)
@@ -558,12 +716,6 @@ void analyze_headers(int max_num)
 	find_replyto_from_html(i);
     if (set_showprogress)
 	printf("\nparsing bodies for later search.\n");
-    for (i = min_search_msgnum; i < num; ++i) {
-	struct emailinfo *ep;
-	if (hashnumlookup(i, &ep) && ep->bodylist) {
-	    add_search_text(ep->bodylist, i);
-	}
-    }
     for (i = min_search_msgnum; i < num; ++i) {
 	struct emailinfo *ep;
 	if (hashnumlookup(i, &ep) && ep->bodylist)
@@ -574,17 +726,6 @@ void analyze_headers(int max_num)
     add_old_replies();
 }
 
-static void print_count(struct search_text *t)
-{
-    if (t->left)
-	print_count(t->left);
-#ifdef COUNT_TOKEN_FREQ
-    printf("%d\t%s\n", t->count, t->token);
-#endif
-    if (t->right)
-	print_count(t->right);
-}
-
 static int better_match(struct body *bp, const char *matched_string, const char *last_matched_string)
 {
     int i;
@@ -610,7 +751,7 @@ static int better_match(struct body *bp, const char *matched_string, const char
     return 0;
 }
 
-static void check_match(struct bigram_list *bigram, struct body *bp, char *ptr, int max_msgnum, String_Match * match_info, const char *match_start_ptr, const char *exact_line)
+static void check_match(struct bigram_place *bigram, struct body *bp, char *ptr, int max_msgnum, String_Match * match_info, const char *match_start_ptr, const char *exact_line)
 {
     int match_len = 1;
     int alloc_len = 0;
@@ -635,7 +776,7 @@ static void check_match(struct bigram_list *bigram, struct body *bp, char *ptr,
 				printf("compare_match: %d %s, %20.20s\n", match_len, token3, ptr3);
 	    if (!bp2 || !bp3)
 		break;
-	    if (ENCODE_TOKEN(token2) != ENCODE_TOKEN(token3))
+	    if (encode_token(token2) != encode_token(token3))
 		break;
 	    ++match_len;
 	    last_ptr = ptr2;
@@ -720,13 +861,13 @@ int search_for_quote(char *search_line, char *exact_line, int max_msgnum, String
     if (!bp)
 	return -1;
     ++count_searched;
-    last_itok = ENCODE_TOKEN(token);
+    last_itok = encode_token(token);
     next_match_start_ptr = ptr;
     next_exact_ptr = exact_line;
 
     while ((bp = tokenize_body(bp, token, &ptr, &dummy, TRUE)) != NULL) {
-	int itok = ENCODE_TOKEN(token);
-	struct bigram_list *bigram;
+	int itok = encode_token(token);
+	struct bigram_place *bigram;
 	bigram = find_bigram(last_itok, itok);
 	if (!bigram)
 			printf("Warning, internal inconsistency in search_for_quote:\n(%d,%d) %s %d best %d, msg %d %s || %s\n", last_itok, itok, token, dummy, match_info->match_len_tokens, max_msgnum, ptr, search_line);
@@ -736,7 +877,7 @@ int search_for_quote(char *search_line, char *exact_line, int max_msgnum, String
 			check_match(bigram, bp, ptr, max_msgnum, match_info, match_start_ptr, exact_line);
 	    if (match_info->match_len_bytes == search_len)
 		break;
-	    bigram = bigram->next;
+	    bigram = next_place(bigram);
 	}
 		if (match_info->last_matched_string != NULL && strlen(match_info->last_matched_string) > search_len / 2)
 	    break;
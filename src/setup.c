@@ -66,6 +66,7 @@ bool set_spamprotect;
 bool set_spamprotect_id;
 bool set_attachmentsindex;
 bool set_usegdbm;
+bool set_headerindex;
 bool set_writehaof;
 bool set_append;
 char *set_append_filename;
@@ -75,6 +76,7 @@ bool set_files_by_thread;
 bool set_href_detection;
 bool set_mbox_shortened;
 bool set_report_new_file;
+bool set_rewrite_unchanged;
 bool set_report_new_folder;
 bool set_use_sender_date;
 bool set_inline_addlink;
@@ -88,6 +90,8 @@ int set_filemode;
 
 int set_locktime;
 
+int set_jobs;
+
 int set_searchbackmsgnum;
 int set_quote_hide_threshold;
 int set_thread_file_depth;
@@ -205,7 +209,8 @@ struct Config cfg[] = {
 
     {"mbox", &set_mbox, NULL, CFG_STRING,
      "# This is the mailbox to read messages in from. Set this with \n"
-     "# a value of NONE to read from standard input.\n", FALSE},
+     "# a value of NONE to read from standard input. It can also be\n"
+     "# a Maildir or MH folder.\n", FALSE},
 
      {"ietf_mbox",  &set_ietf_mbox, BFALSE, CFG_SWITCH,
      "# Set this to On to read mboxes using the IETF convention.\n", FALSE},
@@ -401,6 +406,12 @@ struct Config cfg[] = {
 #endif
     , FALSE},
 
+    {"headerindex", &set_headerindex, BTRUE, CFG_SWITCH,
+     "# Set this to On to keep a binary copy of the message headers in\n"
+     "# the archive directory (" HEADER_INDEX_NAME "), so that incremental\n"
+     "# updates don't have to read every old message file. It is not\n"
+     "# used with the usegdbm, linkquotes or nonsequential options.\n", FALSE},
+
     {"writehaof", &set_writehaof, BFALSE, CFG_SWITCH,
      "# Set this to On to let hypermail write an XML archive overview file\n"
      "# in each directory. The filename is " HAOF_NAME ".\n", FALSE},
@@ -590,6 +601,11 @@ struct Config cfg[] = {
      "# Specify number of seconds to wait for a lock before we\n"
      "# override it! .\n", FALSE},
 
+    {"jobs", &set_jobs, INT(1), CFG_INTEGER,
+     "# Number of processes to write the message pages with, when\n"
+     "# linkquotes and usegdbm are off. The index pages of the folders\n"
+     "# are written in parallel too, unless thread_file_depth is set.\n", FALSE},
+
     {"dateformat", &set_dateformat, NULL, CFG_STRING,
      "# Format (see strftime(3)) for displaying dates.\n", FALSE},
 
@@ -899,6 +915,12 @@ struct Config cfg[] = {
      "# new files created for new messages. It will print the full path\n"
      "# if that is what you use to specify the archive directory.\n", FALSE},
 
+    {"rewrite_unchanged", &set_rewrite_unchanged, BFALSE, CFG_SWITCH,
+     "# Pages are written to a temporary file and renamed into place.\n"
+     "# A page that comes out the same as the one already in the archive,\n"
+     "# apart from the generation date, is left untouched. Set this to On\n"
+     "# to replace such pages anyway.\n", FALSE},
+
     {"use_sender_date", &set_use_sender_date, BFALSE, CFG_SWITCH,
      "# Set this to On to have it use the Date: header (created by the\n"
      "# the system that sent the message) rather than the date/time the\n"
@@ -1380,8 +1402,10 @@ void dump_config(void)
     printf("set_userobotmeta = %d\n",set_userobotmeta);
     printf("set_uselock = %d\n",set_uselock);
     printf("set_locktime = %d\n",set_locktime);
+    printf("set_jobs = %d\n",set_jobs);
     printf("set_ietf_mbox = %d\n",set_ietf_mbox);
     printf("set_usegdbm = %d\n",set_usegdbm);
+    printf("set_headerindex = %d\n",set_headerindex);
     printf("set_writehaof = %d\n",set_writehaof);
     printf("set_append = %d\n",set_append);
     printf("set_nonsequential = %d\n",set_nonsequential);
@@ -85,6 +85,7 @@ extern bool set_spamprotect;
 extern bool set_spamprotect_id;
 extern bool set_attachmentsindex;
 extern bool set_usegdbm;
+extern bool set_headerindex;
 extern bool set_writehaof;
 extern bool set_append;
 extern char *set_append_filename;
@@ -94,6 +95,7 @@ extern bool set_files_by_thread;
 extern bool set_href_detection;
 extern bool set_mbox_shortened;
 extern bool set_report_new_file;
+extern bool set_rewrite_unchanged;
 extern bool set_report_new_folder;
 extern bool set_use_sender_date;
 extern bool set_inline_addlink;
@@ -105,6 +107,7 @@ extern int set_thrdlevels;
 extern int set_dirmode;
 extern int set_filemode;
 extern int set_locktime;
+extern int set_jobs;
 extern int set_searchbackmsgnum;
 extern int set_quote_hide_threshold;
 extern int set_thread_file_depth;
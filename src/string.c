@@ -243,103 +243,187 @@ char *i18n_canonicalize_charset(char *cs){
 }
 
 
+/*
+** Open conversion descriptors, most recently used first. Opening one
+** means loading the converter tables, so they are kept for reuse.
+*/
+
+#define I18N_ICONV_CACHE 8
+
+struct i18n_iconv_cache {
+  char *from;
+  char *to;
+  iconv_t cd;		/* (iconv_t)(-1) if it couldn't be opened */
+  int open_errno;
+  int ascii_same;	/* plain ASCII text comes out unchanged */
+};
+
+static struct i18n_iconv_cache i18n_iconvs[I18N_ICONV_CACHE];
+static int i18n_niconvs;
+
+/* does cd pass every plain ASCII character through as it is? */
+static int i18n_ascii_identity(iconv_t cd){
+
+  char probe[128],out[1024];
+  char *in,*o;
+  size_t inleft,outleft,n=0;
+  int c,same;
+
+  for(c=1;c<128;c++){
+    if(c!=0x0e && c!=0x0f && c!=0x1b)
+      probe[n++]=c;
+  }
+  in=probe;inleft=n;
+  o=out;outleft=sizeof(out);
+  same=iconv(cd,&in,&inleft,&o,&outleft)!=(size_t)-1
+    && iconv(cd,NULL,NULL,&o,&outleft)!=(size_t)-1
+    && sizeof(out)-outleft==n && !memcmp(out,probe,n);
+  iconv(cd,NULL,NULL,NULL,NULL);
+  return same;
+}
+
+static struct i18n_iconv_cache *i18n_iconv_get(char *fromcharset, char *tocharset){
+
+  struct i18n_iconv_cache entry;
+  char *from=i18n_canonicalize_charset(fromcharset);
+  char *to=i18n_canonicalize_charset(tocharset);
+  int x;
+
+  for(x=0;x<i18n_niconvs;x++){
+    if(!strcasecmp(i18n_iconvs[x].from,from) && !strcasecmp(i18n_iconvs[x].to,to))
+      break;
+  }
+  if(x<i18n_niconvs){
+    entry=i18n_iconvs[x];
+  }else{
+    entry.cd=iconv_open(to,from);
+    entry.open_errno=errno;
+    entry.from=strsav(from);
+    entry.to=strsav(to);
+    entry.ascii_same=entry.cd!=(iconv_t)(-1) && i18n_ascii_identity(entry.cd);
+    if(i18n_niconvs==I18N_ICONV_CACHE){
+      /* drop the least recently used one */
+      x=--i18n_niconvs;
+      if(i18n_iconvs[x].cd!=(iconv_t)(-1))
+        iconv_close(i18n_iconvs[x].cd);
+      free(i18n_iconvs[x].from);
+      free(i18n_iconvs[x].to);
+    }
+    x=i18n_niconvs++;
+  }
+  memmove(&i18n_iconvs[1],&i18n_iconvs[0],x*sizeof(struct i18n_iconv_cache));
+  i18n_iconvs[0]=entry;
+  /* back to the initial shift state */
+  if(entry.cd!=(iconv_t)(-1))
+    iconv(entry.cd,NULL,NULL,NULL,NULL);
+  return &i18n_iconvs[0];
+}
+
+/* no bytes with the high bit set, and no ISO-2022 shifts or escapes */
+static int i18n_is_plain_ascii(const char *string, size_t len){
+
+  const unsigned char *s=(const unsigned char *)string;
+  unsigned long word;
+  unsigned long high=(unsigned long)-1/0xff*0x80;	/* 0x8080...80 */
+
+  for(;len>=sizeof(word);s+=sizeof(word),len-=sizeof(word)){
+    memcpy(&word,s,sizeof(word));
+    if(word & high)
+      return 0;
+  }
+  for(;len>0;s++,len--){
+    if(*s & 0x80)
+      return 0;
+  }
+  return !strpbrk(string,"\016\017\033");
+}
+
+static void i18n_growbuf(char **buf, char **pos, size_t *buflen, size_t *bufleft){
+
+  size_t used=*buflen-*bufleft;
+
+  *buflen*=2;
+  *buf=realloc(*buf,*buflen+1);
+  *pos=*buf+used;
+  *bufleft=*buflen-used;
+}
+
+static char *i18n_convfailed(const char *format, char *string, size_t *len){
+
+  char *buf=malloc(strlen(format)+strlen(string)+1);
+
+  *len=sprintf(buf,format,string);
+  return buf;
+}
+
 char *i18n_convstring(char *string, char *fromcharset, char *tocharset, size_t *len){
 
   size_t origlen,strleft,bufleft;
-  size_t origbuflen;
+  size_t buflen;
   char *convbuf,*origconvbuf;
-  iconv_t iconvfd;
+  struct i18n_iconv_cache *conv;
   size_t ret;
-  int error;
 
   if (string){
     strleft=origlen=strlen(string);
   }else{
     strleft=origlen=0;
   }
-  origbuflen = origlen*7;
-  origconvbuf=convbuf=malloc(origbuflen+1);
-  memset(origconvbuf,0,origbuflen);
-  bufleft=origlen*7;
 
-  if (!set_i18n || strcasecmp(fromcharset,tocharset)==0){
+  if (!set_i18n || strcasecmp(fromcharset,tocharset)==0
+      || ((conv=i18n_iconv_get(fromcharset,tocharset))->ascii_same && i18n_is_plain_ascii(string ? string : "",origlen))){
     /* we don't need to convert string here */
+    origconvbuf=malloc(origlen+1);
     *len=origlen;
     memcpy(origconvbuf,string,origlen);
     origconvbuf[origlen]=0x0;
     return origconvbuf;
   }
 
-  iconvfd=iconv_open(i18n_canonicalize_charset(tocharset),i18n_canonicalize_charset(fromcharset));
-  if(iconvfd==(iconv_t)(-1)){
+  if(conv->cd==(iconv_t)(-1)){
     if(set_showprogress){
-      if(errno==EINVAL){
+      if(conv->open_errno==EINVAL){
         printf("I18N: unsupported encoding: charset=(from=%s, to=%s).\n",fromcharset,tocharset);
       }else{
         printf("I18N: libiconv open error.\n");
       }
     }
-    origlen=snprintf(origconvbuf,origbuflen, "(unknown charset) %s",string);
-    origconvbuf[origlen]=0x0;
-    *len=origlen;
-    return origconvbuf;
+    return i18n_convfailed("(unknown charset) %s",string ? string : "",len);
+  }
+
+  /* the output buffer grows when iconv runs out of room */
+  buflen=origlen*2+16;
+  origconvbuf=convbuf=malloc(buflen+1);
+  bufleft=buflen;
+  while((ret=iconv(conv->cd, &string, &strleft, &convbuf, &bufleft))==(size_t)-1
+	&& errno==E2BIG)
+    i18n_growbuf(&origconvbuf,&convbuf,&buflen,&bufleft);
+  if (ret!=(size_t)-1){
+    /* return to initial state */
+    while((ret=iconv(conv->cd, NULL, NULL, &convbuf, &bufleft))==(size_t)-1
+	  && errno==E2BIG)
+      i18n_growbuf(&origconvbuf,&convbuf,&buflen,&bufleft);
   }
-  errno=0;
-  ret=iconv(iconvfd, &string, &strleft, &convbuf, &bufleft);
 
   if (ret==(size_t)-1){
-    error = 1;
     switch (errno){
-    case E2BIG:
-      if(set_showprogress){
-	printf("I18N: buffer overflow.\n");
-      }
-      origlen=snprintf(origconvbuf, origbuflen,"(buffer overflow) %s",string);
-      error = 1;
-      break;
     case EILSEQ:
       if(set_showprogress){
 	printf("I18N: invalid multibyte sequence, from %s to %s: %s.\n",fromcharset,tocharset,string);
       }
-      origlen=snprintf(origconvbuf, origbuflen,"(wrong string) %s",string);
-      error = 1;
       break;
     case EINVAL:
       if(set_showprogress){
 	printf("I18N: incomplete multibyte sequence, from %s to %s: %s.\n",fromcharset,tocharset,string);
       }
-      origlen=snprintf(origconvbuf, origbuflen,"(wrong string) %s",string);
-      error = 1;
       break;
     }
-  } else {
-    /* return to initial state */
-    iconv(iconvfd, NULL, NULL, &convbuf, &bufleft);
-    error = 0;
-  }
-  iconv_close(iconvfd);
-
-  if (error) {
-    origconvbuf[origlen]=0x0;
-    *len=origlen;
-  } else {
-#if 0
-    /* hmm... do we really need to do this? (daigo) */
-    if (strncasecmp(tocharset,"ISO-2022-JP",11)==0){
-      *len=origlen*7-bufleft;
-      *(origconvbuf+*len)=0x1b;
-      *(origconvbuf+*len+1)=0x28;
-      *(origconvbuf+*len+2)=0x42;
-      *len+=3;
-    }else{
-      *len=origlen*7-bufleft;
-    }
-#else
-   *len=origlen*7-bufleft; 
-#endif
-    *(origconvbuf+*len)=0x0;
+    free(origconvbuf);
+    return i18n_convfailed("(wrong string) %s",string,len);
   }
 
+  *len=buflen-bufleft;
+  *(origconvbuf+*len)=0x0;
   return origconvbuf;
 }
 
@@ -475,6 +559,96 @@ int i18n_replace_non_ascii_chars(char *string)
 #endif
 /* end of I18N hack */
 
+/*
+** Format the plain conversions %s, %d and %% into the buffer, without
+** trio. Returns -1 for anything else, and for a NULL string, which trio
+** prints its own way.
+*/
+static int quick_format(char **buf, size_t *bufsize, const char *format,
+			va_list args)
+{
+    size_t len = 0;
+    const char *p, *str;
+    char num[24];
+    size_t n;
+
+    for (p = format; *p; ) {
+	if (*p != '%') {
+	    str = p;
+	    n = strcspn(p, "%");
+	    p += n;
+	}
+	else if (p[1] == 's') {
+	    if ((str = va_arg(args, const char *)) == NULL)
+		return -1;
+	    n = strlen(str);
+	    p += 2;
+	}
+	else if (p[1] == 'd') {
+	    int value = va_arg(args, int);
+	    unsigned int u = value < 0 ? 0U - (unsigned int)value : (unsigned int)value;
+	    char *q = num + sizeof(num);
+	    do
+		*--q = '0' + u % 10;
+	    while ((u /= 10) != 0);
+	    if (value < 0)
+		*--q = '-';
+	    str = q;
+	    n = num + sizeof(num) - q;
+	    p += 2;
+	}
+	else if (p[1] == '%') {
+	    str = p;
+	    n = 1;
+	    p += 2;
+	}
+	else
+	    return -1;
+	if (len + n >= *bufsize) {
+	    while (len + n >= *bufsize)
+		*bufsize *= 2;
+	    *buf = (char *)erealloc(*buf, *bufsize);
+	}
+	memcpy(*buf + len, str, n);
+	len += n;
+    }
+    return (int)len;
+}
+
+/*
+** fprintf() as used by the page writers. trio parses every format and
+** puts the result out a character at a time, so the common conversions
+** are formatted by quick_format() instead, into a reused buffer that is
+** written with one fwrite(). Other formats still go through trio.
+*/
+int hm_fprintf(FILE *fp, const char *format, ...)
+{
+    static char *buf;
+    static size_t bufsize;
+    va_list args, copy;
+    int len;
+
+    if (!strchr(format, '%'))
+	return fputs(format, fp) == EOF ? -1 : (int)strlen(format);
+    if (!buf) {
+	bufsize = 4096;
+	buf = (char *)emalloc(bufsize);
+    }
+    va_start(args, format);
+    va_copy(copy, args);
+    len = quick_format(&buf, &bufsize, format, copy);
+    va_end(copy);
+    if (len < 0) {
+	len = trio_vfprintf(fp, format, args);
+	va_end(args);
+	return len;
+    }
+    va_end(args);
+    if (len > 0 && fwrite(buf, 1, len, fp) != (size_t)len)
+	return -1;
+    return len;
+}
+
 /*
 ** Push byte onto a buffer realloc the buffer if needed.
 **
@@ -1049,84 +1223,143 @@ char *convdash (char *line)
 } /* end convdash() */
 
 /*
-** Converts <, >, and & to &lt;, &gt; and &amp;.
-** It was ugly. Now its better. And probably faster.
-**
-** Returns an ALLOCATED string!
+** The HTML escaping done by convcharsreal(). conv_entity[] has the
+** replacement for each byte that needs one. conv_stop[] marks the bytes
+** where copying a run of plain text has to stop, including the
+** terminating zero: CONV_LATIN1 adds the WinLatin1 bytes 0x80-0x9f and
+** CONV_DOT adds the '.' that is hidden after an '@' with spamprotect.
 */
 
-char *convcharsreal(char *line, char *charset, int spamprotect)
+#define CONV_LATIN1 1
+#define CONV_DOT    2
+
+static const char *conv_entity[256];
+static unsigned char conv_stop[4][256];
+
+static void conv_init(void)
+{
+    static char win1252[0x20][12];
+    int c, v;
+
+    conv_entity['<'] = "&lt;";
+    conv_entity['>'] = "&gt;";
+    conv_entity['&'] = "&amp;";
+    conv_entity['\"'] = "&quot;";
+    conv_entity['@'] = "&#64;";	/* pkn added: simple "antispam" measure */
+    conv_entity['.'] = "&#46;<!--nospam-->";
+    for (c = 0x80; c <= 0x9f; c++) {
+	/* @@ JK : try to convert from the WinLatin1 code */
+	snprintf(win1252[c - 0x80], sizeof(win1252[0]), "&#x%x;",
+		 WIN1252CP[c - WIN1252CP_length]);
+	conv_entity[c] = win1252[c - 0x80];
+    }
+    for (v = 0; v < 4; v++) {
+	conv_stop[v][0] = 1;
+	conv_stop[v]['<'] = conv_stop[v]['>'] = 1;
+	conv_stop[v]['&'] = conv_stop[v]['\"'] = conv_stop[v]['@'] = 1;
+	if (v & CONV_DOT)
+	    conv_stop[v]['.'] = 1;
+	if (v & CONV_LATIN1)
+	    for (c = 0x80; c <= 0x9f; c++)
+		conv_stop[v][c] = 1;
+    }
+}
+
+/*
+** convcharsreal() for ISO-2022-JP text, where the bytes inside
+** escape sequences are copied untouched.
+*/
+
+static char *convchars_iso2022(char *line, int latin1, int spamprotect)
 {
     struct Push buff;
     int in_ascii = TRUE, esclen = 0;
     int seen_at = FALSE;
-    bool is_iso_8859_1;
-
-    if (charset && !strcasecmp ("iso-8859-1", charset))
-      is_iso_8859_1 = TRUE;
-    else
-      is_iso_8859_1 = FALSE;
+    unsigned char c;
 
     INIT_PUSH(buff);		/* init macro */
 
-    /* avoid strlen() for speed */
-
     for (; *line; line++) {
 
-	if (set_iso2022jp) {
-		iso2022_state(line, &in_ascii, &esclen);
-		if (esclen && in_ascii == FALSE) {
-			for (; in_ascii == FALSE && *line; line++) {
-				PushByte(&buff, *line);
-				iso2022_state(line, &in_ascii, &esclen);
-			}
-			line--;
-			continue;
+	iso2022_state(line, &in_ascii, &esclen);
+	if (esclen && in_ascii == FALSE) {
+		for (; in_ascii == FALSE && *line; line++) {
+			PushByte(&buff, *line);
+			iso2022_state(line, &in_ascii, &esclen);
 		}
+		line--;
+		continue;
 	}
 
-	/* @@ JK : try to convert from the WinLatin1 code */
-	if (is_iso_8859_1
-	    && (unsigned char) (*line) >= 0x80 && (unsigned char) (*line) <= 0x9f) {
-	  char *unicode_entity;
-	  trio_asprintf (&unicode_entity, 
-			 "&#x%x;", WIN1252CP[(unsigned char) (*line) - WIN1252CP_length]);
-
-	  if (unicode_entity) {
-	    PushString(&buff, (const char *) unicode_entity);
-	    free (unicode_entity);
-	  }
-	  continue;
-	}
-
-	switch (*line) {
-	case '<':
-	    PushString(&buff, "&lt;");
-	    break;
-	case '>':
-	    PushString(&buff, "&gt;");
-	    break;
-	case '&':
-	    PushString(&buff, "&amp;");
-	    break;
-	case '\"':
-	    PushString(&buff, "&quot;");
-	    break;
-	case '@': /* pkn added: simple "antispam" measure */
-	    PushString(&buff, "&#64;");
-	    seen_at = TRUE;
-	    break;
-	case '.': /* pkn added */
-	    if (seen_at && spamprotect)
-	    {
-	    	PushString(&buff, "&#46;<!--nospam-->");
-	    	seen_at = FALSE;
-	    	break;
+	c = (unsigned char)*line;
+	if (c == '.') {
+	    if (!seen_at || !spamprotect) {
+		PushByte(&buff, *line);
+		continue;
 	    }
-	    /* fall through */
-	default:
+	    seen_at = FALSE;
+	}
+	else if (!conv_stop[latin1][c]) {
 	    PushByte(&buff, *line);
+	    continue;
 	}
+	else if (c == '@')
+	    seen_at = TRUE;
+	PushString(&buff, conv_entity[c]);
+    }
+    RETURN_PUSH(buff);
+}
+
+/*
+** Converts <, >, and & to &lt;, &gt; and &amp;.
+** It was ugly. Now its better. And probably faster.
+** Runs of bytes that need no escaping are copied in one go.
+**
+** Returns an ALLOCATED string!
+*/
+
+char *convcharsreal(char *line, char *charset, int spamprotect)
+{
+    struct Push buff;
+    const unsigned char *p = (const unsigned char *)line;
+    const unsigned char *run;
+    const unsigned char *stop;
+    int latin1;
+    size_t len;
+
+    if (!conv_entity['<'])
+	conv_init();
+
+    if (charset && !strcasecmp ("iso-8859-1", charset))
+      latin1 = CONV_LATIN1;
+    else
+      latin1 = 0;
+
+    if (set_iso2022jp)
+	return convchars_iso2022(line, latin1, spamprotect);
+
+    INIT_PUSH(buff);		/* init macro */
+
+    if ((len = strlen(line)) == 0)
+	RETURN_PUSH(buff);
+    /* room for the text and some entities */
+    buff.alloc = len + len / 4 + 32;
+    buff.string = (char *)emalloc(buff.alloc);
+    buff.string[0] = '\0';
+
+    stop = conv_stop[latin1];
+    for (;;) {
+	for (run = p; !stop[*p]; p++)
+	    ;
+	if (p > run)
+	    PushNString(&buff, (const char *)run, p - run);
+	if (!*p)
+	    break;
+	if (*p == '@' && spamprotect)
+	    stop = conv_stop[latin1 | CONV_DOT];
+	else if (*p == '.')
+	    stop = conv_stop[latin1];
+	PushString(&buff, conv_entity[*p++]);
     }
     RETURN_PUSH(buff);
 } /* end convcharsreal() */
@@ -1179,7 +1412,14 @@ char *unconvchars(char *line)
     INIT_PUSH(buff);
 
     for (; *line; line++) {
-	if (*line == '&') {
+	if (*line != '&') {
+	    /* copy up to the next entity at once */
+	    char *amp = strchr(line, '&');
+	    int n = amp ? amp - line : (int)strlen(line);
+	    PushNString(&buff, line, n);
+	    line += n - 1;
+	}
+	else {
 	    if (!strncmp("lt;", line + 1, 3)) {
 		PushByte(&buff, '<');
 		line += 3;
@@ -1214,8 +1454,6 @@ char *unconvchars(char *line)
 	    else
 	        PushByte(&buff, *line);
 	}
-	else
-	  PushByte(&buff, *line);
     }
     RETURN_PUSH(buff);
 }
@@ -1423,6 +1661,20 @@ char *replacechar(char *string, char old, char *new)
 
     INIT_PUSH(buff);
 
+    if (!set_iso2022jp && old) {
+	/* copy the text between the characters to replace at once */
+	char *hit;
+
+	while ((hit = strchr(string, old)) != NULL) {
+	    PushNString(&buff, string, hit - string);
+	    PushString(&buff, new);
+	    string = hit + 1;
+	}
+	if (*string)
+	    PushString(&buff, string);
+	RETURN_PUSH(buff);
+    }
+
     for (; *string; string++) {
 	if (set_iso2022jp) iso2022_state(string, &in_ascii, &esclen);
 	if (in_ascii == TRUE && *string == old) {
@@ -1613,6 +1865,17 @@ char *unspamify(char *s)
 **
 */
 
+/*
+** Can c be part of the user name of an email address?
+*/
+
+static int valid_in_email_username(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+	|| (c >= '0' && c <= '9')
+	|| (c && strchr(".!#$%&'*+-/=?^_`{|}~", c));
+}
+
 char *parseemail(char *input,	/* string to parse */
 		 char *mid,	/* message ID */
 		 char *msubject,
@@ -1675,26 +1938,14 @@ char *parseemail(char *input,	/* string to parse */
       if (ptr) {
 	    /* found a @ */
 	    char *email = ptr - 1;
-	    char content[2];
 	    int backoff = ptr - start;	/* max */
 
-#define VALID_IN_EMAIL_USERNAME   "a-zA-Z0-9.!#$%&'*+-/=?^_`{|}~"
 #define VALID_IN_EMAIL_DOMAINNAME "a-zA-Z0-9.-"
 
 	    /* check left side */
-	    while (backoff) {
-                int res;
-
-                res = sscanf(email, "%1[" VALID_IN_EMAIL_USERNAME "]", content);
-                /* for some reason, if we have ,name sscanf will interpret the , as
-                   if were declared in VALID_IN_EMAIL_USERNAME, thus the additional
-                   check */
-		if (res && content[0] != ',') {
-		    email--;
-		    backoff--;
-		}
-		else
-		    break;
+	    while (backoff && valid_in_email_username((unsigned char)*email)) {
+		email--;
+		backoff--;
 	    }
 	    if (backoff > 2 && email[0] == '/' && email[-1] == '/'
 		&& email[-2] == ':') {
@@ -1756,8 +2007,10 @@ char *parseemail(char *input,	/* string to parse */
 	    start = input;
 	    continue;
       }
-      else
+      else if (set_iso2022jp)
 	input++;
+      else			/* addresses are only looked for at '@' and "&#64;" */
+	input += 1 + strcspn(input + 1, "@&");
     }
     if (lastpos < input) {
 	PushNString(&buff, lastpos, input - lastpos);
@@ -46,28 +46,282 @@ struct body *hashnumlookup(int, struct emailinfo **);
 ** Ladies and germs - the hash function.
 */
 
-unsigned hash(char *s)
+unsigned hash(const char *s)
 {
     unsigned hashval;
 
     /* We MUST deal with NULL pointers passed to this */
     if (!s)
-	return HASHSIZE - 1;	/* (Daniel) I think a high value is fun ;-) */
+	return 0;
 
     for (hashval = 0; *s; s++)
 	hashval = *s + 31 * hashval;
-    return (hashval % HASHSIZE);
+    return hashval;
 }
 
-void reinit_structs()
+/*
+** The message indexes. Each keyed index is an open addressing table
+** (linear probing, power of two size) that maps a key to the list of
+** messages filed under it, newest first. A table doubles in size when
+** it gets three quarters full. Messages are also kept in a dense array
+** indexed by message number.
+*/
+
+#define INDEX_MIN_SIZE 1024
+
+struct hashslot {
+    char *key;			/* NULL if the slot is free */
+    unsigned hashval;
+    struct hashemail *list;
+    struct emailinfo *low[2];	/* the two lowest numbered in list */
+};
+
+struct hashindex {
+    struct hashslot *slots;
+    unsigned size;
+    unsigned count;
+};
+
+static struct hashindex msgid_index;	/* by Message-ID */
+static struct hashindex inreply_index;	/* by In-Reply-To */
+static struct hashindex subject_index;	/* by case folded subject */
+static struct hashindex date_index;	/* by date string */
+
+static struct emailinfo **num_index;	/* by message number */
+static int num_index_size;
+
+/*
+** Skip hints for neighborlookup(). For a number that has no live
+** message, next_live[num] (prev_live[num]) points further along in
+** that direction, past numbers that were found empty or deleted. The
+** hints are shortened as they are followed. Messages never come back
+** from deletion, so only adding a message makes the hints stale.
+*/
+
+static int *next_live;
+static int *prev_live;
+static bool live_hints_valid;
+
+/*
+** The raw string hash is a poor fit for a power of two table, mix the
+** bits before masking.
+*/
+
+static unsigned index_start(unsigned hashval, unsigned size)
 {
-    int i;
-    for (i = 0; i < HASHSIZE; ++i) {
-	if (etable[i]) {
-	    free(etable[i]);
-	    etable[i] = NULL;
+    hashval ^= hashval >> 16;
+    hashval *= 0x45d9f3b;
+    hashval ^= hashval >> 16;
+    return hashval & (size - 1);
+}
+
+static struct hashslot *index_find(struct hashindex *ix, const char *key,
+				   unsigned hashval)
+{
+    unsigned i;
+
+    if (!ix->size)
+	return NULL;
+    for (i = index_start(hashval, ix->size); ix->slots[i].key;
+	 i = (i + 1) & (ix->size - 1)) {
+	if (ix->slots[i].hashval == hashval && !strcmp(ix->slots[i].key, key))
+	    return &ix->slots[i];
+    }
+    return NULL;
+}
+
+static struct hashslot *index_free_slot(struct hashindex *ix, unsigned hashval)
+{
+    unsigned i;
+
+    for (i = index_start(hashval, ix->size); ix->slots[i].key;
+	 i = (i + 1) & (ix->size - 1))
+	;
+    return &ix->slots[i];
+}
+
+static void index_grow(struct hashindex *ix)
+{
+    struct hashslot *old = ix->slots;
+    unsigned oldsize = ix->size;
+    unsigned i;
+
+    ix->size = oldsize ? oldsize * 2 : INDEX_MIN_SIZE;
+    ix->slots = (struct hashslot *)emalloc(ix->size * sizeof(struct hashslot));
+    memset(ix->slots, 0, ix->size * sizeof(struct hashslot));
+    for (i = 0; i < oldsize; i++) {
+	if (old[i].key)
+	    *index_free_slot(ix, old[i].hashval) = old[i];
+    }
+    if (old)
+	free(old);
+}
+
+static void index_add(struct hashindex *ix, const char *key, struct emailinfo *e)
+{
+    unsigned hashval;
+    struct hashslot *slot;
+    struct hashemail *h;
+
+    if (!key)
+	return;
+    hashval = hash(key);
+    slot = index_find(ix, key, hashval);
+    if (!slot) {
+	if ((ix->count + 1) * 4 > ix->size * 3)
+	    index_grow(ix);
+	slot = index_free_slot(ix, hashval);
+	slot->key = strsav(key);
+	slot->hashval = hashval;
+	slot->list = NULL;
+	slot->low[0] = slot->low[1] = NULL;
+	++ix->count;
+    }
+    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
+    h->data = e;
+    h->next = slot->list;
+    slot->list = h;
+    if (e == slot->low[0] || e == slot->low[1])
+	return;			/* filed twice, it still takes one place */
+    if (!slot->low[0] || e->msgnum < slot->low[0]->msgnum) {
+	slot->low[1] = slot->low[0];
+	slot->low[0] = e;
+    }
+    else if (!slot->low[1] || e->msgnum < slot->low[1]->msgnum)
+	slot->low[1] = e;
+}
+
+static struct hashemail *index_lookup(struct hashindex *ix, const char *key)
+{
+    struct hashslot *slot;
+
+    if (!key)
+	return NULL;
+    slot = index_find(ix, key, hash(key));
+    return slot ? slot->list : NULL;
+}
+
+/*
+** The lowest numbered message filed under key, other than msgnum.
+*/
+
+static struct emailinfo *index_lowest(struct hashindex *ix, const char *key,
+				      int msgnum)
+{
+    struct hashslot *slot;
+
+    if (!key || !(slot = index_find(ix, key, hash(key))))
+	return NULL;
+    if (slot->low[0]->msgnum != msgnum)
+	return slot->low[0];
+    if (slot->low[1] && slot->low[1]->msgnum != msgnum)
+	return slot->low[1];
+    return NULL;
+}
+
+static void index_free(struct hashindex *ix)
+{
+    unsigned i;
+    struct hashemail *h, *next;
+
+    for (i = 0; i < ix->size; i++) {
+	if (!ix->slots[i].key)
+	    continue;
+	for (h = ix->slots[i].list; h != NULL; h = next) {
+	    next = h->next;
+	    free(h);
 	}
+	free(ix->slots[i].key);
     }
+    if (ix->slots)
+	free(ix->slots);
+    ix->slots = NULL;
+    ix->size = ix->count = 0;
+}
+
+/*
+** Subjects are filed case folded so that "Re: foo" and "RE: FOO"
+** end up in the same list. The caller frees the returned key.
+*/
+
+static char *subject_key(const char *subject)
+{
+    char *key = strsav(subject);
+    char *p;
+
+    for (p = key; *p; p++)
+	*p = tolower((unsigned char)*p);
+    return key;
+}
+
+static void num_index_add(struct emailinfo *e)
+{
+    if (e->msgnum < 0)
+	return;
+    if (e->msgnum >= num_index_size) {
+	int newsize = num_index_size ? num_index_size : INDEX_MIN_SIZE;
+	while (newsize <= e->msgnum)
+	    newsize *= 2;
+	num_index = (struct emailinfo **)erealloc(num_index,
+						  newsize * sizeof(struct emailinfo *));
+	memset(num_index + num_index_size, 0,
+	       (newsize - num_index_size) * sizeof(struct emailinfo *));
+	num_index_size = newsize;
+    }
+    num_index[e->msgnum] = e;
+    live_hints_valid = FALSE;
+}
+
+static void init_live_hints(void)
+{
+    int i;
+
+    next_live = (int *)erealloc(next_live, num_index_size * sizeof(int));
+    prev_live = (int *)erealloc(prev_live, num_index_size * sizeof(int));
+    for (i = 0; i < num_index_size; i++) {
+	next_live[i] = i + 1;
+	prev_live[i] = i - 1;
+    }
+    live_hints_valid = TRUE;
+}
+
+/*
+** Follows the hints from num to the first live message in the given
+** direction. Returns -1 or num_index_size if there is none.
+*/
+
+static int find_live(int *hints, int num, int direction)
+{
+    int end = (direction > 0) ? num_index_size : -1;
+    int found, next;
+
+    for (found = num; found != end
+	 && (!num_index[found] || num_index[found]->is_deleted);
+	 found = hints[found])
+	;
+    for (; num != found; num = next) {
+	next = hints[num];
+	hints[num] = found;
+    }
+    return found;
+}
+
+void reinit_structs()
+{
+    index_free(&msgid_index);
+    index_free(&inreply_index);
+    index_free(&subject_index);
+    index_free(&date_index);
+    if (num_index)
+	free(num_index);
+    num_index = NULL;
+    num_index_size = 0;
+    if (next_live)
+	free(next_live);
+    if (prev_live)
+	free(prev_live);
+    next_live = prev_live = NULL;
+    live_hints_valid = FALSE;
 }
 
 void fill_email_dates(struct emailinfo *e, char *date, char *fromdate, char *isodate, char *isofromdate)
@@ -156,10 +410,7 @@ void fill_email_dates(struct emailinfo *e, char *date, char *fromdate, char *iso
 struct emailinfo *addhash(int num, char *date, char *name, char *email, char *msgid, char *subject, char *inreply, char *fromdate, char *charset, char *isodate, char *isofromdate, struct body *sp)
 {
     struct emailinfo *e;
-    struct hashemail *h;
-
-    unsigned hashval;
-    char numstr[NUMSTRLEN];
+    char *subjkey;
     bool msgid_dup = 0;
     bool msgid_missing = 0;
     static int freedummy = 0;
@@ -177,17 +428,8 @@ struct emailinfo *addhash(int num, char *date, char *name, char *email, char *ms
 	}
     }
 
-    if (!msgid_missing) {
-	h = (struct hashemail *)etable[hash(msgid)];
-
-	while (h) {
-	    if (!strcmp(h->data->msgid, msgid)) {
-		msgid_dup = 1;
-		break;
-	    }
-	    h = h->next;
-	}
-    }
+    if (!msgid_missing && index_lookup(&msgid_index, msgid))
+	msgid_dup = 1;
 
     if (msgid_dup && set_discard_dup_msgids) {
 	if (set_showprogress)
@@ -204,16 +446,8 @@ struct emailinfo *addhash(int num, char *date, char *name, char *email, char *ms
          */
 	newmsgid = emalloc(MSGDSTRLEN);
 	do {
-	    msgid_dup = 0;
 	    sprintf(newmsgid, "%d.%4.4d@hypermail.dummy", time(NULL), freedummy);
-	    h = (struct hashemail *)etable[hash(newmsgid)];
-	    while (h) {
-		if (!strcmp(h->data->msgid, newmsgid)) {
-		    msgid_dup = 1;
-		    break;
-		}
-		h = h->next;
-	    }
+	    msgid_dup = (index_lookup(&msgid_index, newmsgid) != NULL);
 	    freedummy++;
 	} while (msgid_dup && (freedummy < 1000));
 
@@ -274,39 +508,15 @@ struct emailinfo *addhash(int num, char *date, char *name, char *email, char *ms
 
     /* Added by Daniel 1999-03-19, we need this hash later to find the mail
        we replied to */
-    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
-    hashval = hash(inreply);
-    h->next = etable[hashval];
-    h->data = e;
-    etable[hashval] = h;
-
-    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
-    hashval = hash(date);
-    h->next = etable[hashval];
-    h->data = e;
-    etable[hashval] = h;
-
-    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
-#if 0
-    printf("ADD msgid %s to HASH!\n", msgid);
-#endif
-    hashval = hash(msgid);
-    h->next = etable[hashval];
-    h->data = e;
-    etable[hashval] = h;
-
-    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
-    hashval = hash(subject);
-    h->next = etable[hashval];
-    h->data = e;
-    etable[hashval] = h;
-
-    h = (struct hashemail *)emalloc(sizeof(struct hashemail));
-    sprintf(numstr, "%d", num);
-    hashval = hash(numstr);
-    h->next = etable[hashval];
-    h->data = e;
-    etable[hashval] = h;
+    index_add(&inreply_index, inreply, e);
+    index_add(&date_index, date, e);
+    index_add(&msgid_index, msgid, e);
+    if (subject) {
+	subjkey = subject_key(subject);
+	index_add(&subject_index, subjkey, e);
+	free(subjkey);
+    }
+    num_index_add(e);
 
     return e;			/* the actual mail struct pointer */
 }
@@ -324,11 +534,15 @@ int insert_in_lists(struct emailinfo *emp, const bool * require_filter, int rlen
 		    --emp->subdir->count;
 	    }
 #endif
+	    if (!emp->is_deleted)
+		emp->flags |= DELETION_CHANGED;
 	    emp->is_deleted = FILTERED_DELETE;
 	}
     }
 	for (i = 0; i < rlen; ++i) {
 	if (!require_filter[i]) {
+	    if (!emp->is_deleted)
+		emp->flags |= DELETION_CHANGED;
 	    emp->is_deleted = FILTERED_REQUIRED;
 	}
     }
@@ -365,72 +579,15 @@ int insert_in_lists(struct emailinfo *emp, const bool * require_filter, int rlen
 	}
     }
     else {
-        authorlist = addheader(authorlist, emp, 1, 0);
+        authorlist = addheader(authorlist, emp, 1);
 
-	subjectlist = addheader(subjectlist, emp, 0, 0);
+	subjectlist = addheader(subjectlist, emp, 0);
 
     }
-    datelist = addheader(datelist, emp, 2, 0);
+    datelist = addheader(datelist, emp, 2);
     return !emp->is_deleted;
 }
 
-/*
- * Given an "in-reply-to:" field and a message number, this function
- * retrieves information about the message that this message is a 
- * reply to.
- * If all else fails but a reply is
- * found by comparing subjects, issubjmatch is set to 1.
- *
- * Daniel 1999-03-19. Changed return type and parameters.
-*/
-#ifdef USE_OBSOLETE_HASHREPLYLOOKUP
-
-struct emailinfo *hashreplylookup(int msgnum, char *inreply, int *issubjmatch)
-{
-    struct hashemail *ep;
-
-#if DEBUG_THREAD
-    fprintf(stderr, "hashreplylookup(%d, '%s'...)\n", msgnum, inreply);
-#endif
-    *issubjmatch = 0;
-    ep = etable[hash(inreply)];
-    while (ep) {
-		if ((msgnum != ep->data->msgnum) && (strcmp(inreply, ep->data->msgid) == 0)) {
-#if DEBUG_THREAD
-	    fprintf(stderr, "match on msgid [%d]\n", ep->data->msgnum);
-#endif
-	    return ep->data;
-	}
-	ep = ep->next;
-    }
-
-    ep = etable[hash(inreply)];
-    while (ep != NULL) {
-		if ((msgnum != ep->data->msgnum) && (strstr(inreply, ep->data->datestr))) {
-#if DEBUG_THREAD
-	    fprintf(stderr, "match on date [%d]\n", ep->data->msgnum);
-#endif
-	    return ep->data;
-	}
-	ep = ep->next;
-    }
-
-    ep = etable[hash(inreply)];
-    while (ep != NULL) {
-		if ((msgnum != ep->data->msgnum) && (strcmp(inreply, ep->data->subject) == 0)) {
-	    *issubjmatch = 1;
-#if DEBUG_THREAD
-	    fprintf(stderr, "match on subject [%d]\n", ep->data->msgnum);
-#endif
-	    return ep->data;
-	}
-	ep = ep->next;
-    }
-
-    return NULL;
-}
-#endif
-
 /*
  * Given an "message-id:" field, this tries to retrieve information
  * about an article that has replied. If all else fails but a reply is
@@ -444,15 +601,8 @@ struct emailinfo *hashmsgidlookup(char *msgid, int *issubjmatch)
     struct hashemail *ep;
 
     *issubjmatch = 0;
-    ep = etable[hash(msgid)];
-    while (ep) {
-	if (strcmp(msgid, ep->data->inreplyto) == 0) {
-	    return ep->data;
-	}
-	ep = ep->next;
-    }
-
-    return NULL;
+    ep = index_lookup(&inreply_index, msgid);
+    return ep ? ep->data : NULL;
 }
 
 /*
@@ -466,6 +616,7 @@ struct emailinfo *hashmsgidlookup(char *msgid, int *issubjmatch)
 struct emailinfo *hashreplylookup(int msgnum, char *inreply, char *subject, int *maybereply)
 {
     struct hashemail *ep;
+    char *s;
 
 #if DEBUG_THREAD > 1
 	fprintf(stderr, "hashreplynumlookup(%d, '%s'...)\n", msgnum, (inreply == NULL) ? "" : inreply);
@@ -474,18 +625,15 @@ struct emailinfo *hashreplylookup(int msgnum, char *inreply, char *subject, int
 
     if ((inreply != NULL) && *inreply) {
 
-	ep = etable[hash(inreply)];
-	while (ep) {
-	    if (strcmp(inreply, ep->data->msgid) == 0) {
+	ep = index_lookup(&msgid_index, inreply);
+	if (ep) {
 #if DEBUG_THREAD
-				fprintf(stderr, "match on msgid   %4d %4d\n", msgnum, ep->data->msgnum);
+	    fprintf(stderr, "match on msgid   %4d %4d\n", msgnum, ep->data->msgnum);
 #endif
-		return ep->data;
-	    }
-	    ep = ep->next;
+	    return ep->data;
 	}
 
-	ep = etable[hash(inreply)];
+	ep = index_lookup(&date_index, inreply);
 	while (ep) {
 			if ((msgnum != ep->data->msgnum) && (strstr(inreply, ep->data->datestr))) {
 #if DEBUG_THREAD
@@ -496,7 +644,9 @@ struct emailinfo *hashreplylookup(int msgnum, char *inreply, char *subject, int
 	    ep = ep->next;
 	}
 
-	ep = etable[hash(inreply)];
+	s = subject_key(inreply);
+	ep = index_lookup(&subject_index, s);
+	free(s);
 	while (ep != NULL) {
 			if ((msgnum != ep->data->msgnum) && (strcmp(inreply, ep->data->subject) == 0)) {
 		*maybereply = 1;
@@ -517,7 +667,7 @@ struct emailinfo *hashreplylookup(int msgnum, char *inreply, char *subject, int
     {
 #define MAX_SUBJ_LEN 300
 
-	char *s, *saved_s;
+	char *saved_s;
 	struct emailinfo *lowest_so_far = NULL;
 	int match = 0;
 
@@ -540,14 +690,15 @@ struct emailinfo *hashreplylookup(int msgnum, char *inreply, char *subject, int
 #if DEBUG_THREAD > 1
                 fprintf(stderr, "extra %s\n", s);
 #endif
-                ep = etable[hash(s)];
-                while (ep != NULL) {
-					if ((strcasecmp(s, ep->data->subject) == 0) && (msgnum != ep->data->msgnum)) {
-                        match = 1;
-						if (lowest_so_far == NULL || ep->data->msgnum < lowest_so_far->msgnum)
-                            lowest_so_far = ep->data;
-                    }
-                    ep = ep->next;
+                /* everything filed under the case folded key has the
+                   same subject as s, ignoring case */
+                char *key = subject_key(s);
+                struct emailinfo *low = index_lowest(&subject_index, key, msgnum);
+                free(key);
+                if (low != NULL) {
+                    match = 1;
+                    if (lowest_so_far == NULL || low->msgnum < lowest_so_far->msgnum)
+                        lowest_so_far = low;
                 }
                 s = oneunre(s);
             } while (s != NULL);
@@ -596,21 +747,19 @@ int hashreplynumlookup(int msgnum, char *inreply, char *subject, int *maybereply
 
 struct body *hashnumlookup(int num, struct emailinfo **emailp)
 {
-    struct hashemail *ep;
+    struct emailinfo *e;
     struct body *lp_tmp;
-    char numstr[NUMSTRLEN];
-
-    sprintf(numstr, "%d", num);
-    for (ep = etable[hash(numstr)]; ep != NULL; ep = ep->next) {
-	if (ep->data && (num == ep->data->msgnum)) {
-	    /* return a mere pointer to it! */
-	    *emailp = ep->data;
-	    if (!ep->data->bodylist)
-	        ep->data->bodylist = addbody(NULL, &lp_tmp, "\n", 0);
-	    return ep->data->bodylist;
-	}
+
+    if (num < 0 || num >= num_index_size || (e = num_index[num]) == NULL)
+	return NULL;
+    /* return a mere pointer to it! */
+    *emailp = e;
+    if (!e->bodylist) {
+	struct arena *a = set_body_arena(NULL);
+	e->bodylist = addbody(NULL, &lp_tmp, "\n", 0);
+	set_body_arena(a);
     }
-    return NULL;
+    return e->bodylist;
 }
 
 /*
@@ -622,15 +771,8 @@ struct emailinfo *hashlookupbymsgid(char *msgid)
     struct hashemail *ep;
     if (!msgid || !*msgid)
 	return NULL;
-    ep = etable[hash(msgid)];
-    while (ep) {
-	if (strcmp(msgid, ep->data->msgid) == 0) {
-	    return ep->data;
-	}
-	ep = ep->next;
-    }
-
-    return NULL;
+    ep = index_lookup(&msgid_index, msgid);
+    return ep ? ep->data : NULL;
 }
 
 int insert_older_msgs(int num)
@@ -640,9 +782,9 @@ int insert_older_msgs(int num)
     for(i = set_startmsgnum; i < num; ++i) {
 	struct emailinfo *emp;
 	if (hashnumlookup(i, &emp)) {
-	    authorlist = addheader(authorlist, emp, 1, 0);
-	    subjectlist = addheader(subjectlist, emp, 0, 0);
-	    datelist = addheader(datelist, emp, 2, 0);
+	    authorlist = addheader(authorlist, emp, 1);
+	    subjectlist = addheader(subjectlist, emp, 0);
+	    datelist = addheader(datelist, emp, 2);
 	    ++num_added;
 	}
     }
@@ -656,22 +798,32 @@ int insert_older_msgs(int num)
 
 struct emailinfo *neighborlookup(int num, int direction)
 {
-    struct hashemail *ep;
-    char numstr[NUMSTRLEN];
     num += direction;
 
-    while (num >= 0 && num <= max_msgnum) {
-	sprintf(numstr, "%d", num);
-	for (ep = etable[hash(numstr)]; ep != NULL; ep = ep->next)
-	    if (ep->data && (num == ep->data->msgnum)) {
-	        if (ep->data->is_deleted)
-		    break;
-	          /* return a mere pointer to it! */
-		return ep->data;
-	    }
-	num += direction;
+    if (direction != 1 && direction != -1) {
+	while (num >= 0 && num <= max_msgnum) {
+	    if (num < num_index_size && num_index[num]
+		&& !num_index[num]->is_deleted)
+		return num_index[num];
+	    num += direction;
+	}
+	return NULL;
     }
-    return NULL;
+
+    if (num < 0 || num > max_msgnum)
+	return NULL;
+    if (num >= num_index_size) {
+	if (direction > 0)
+	    return NULL;
+	num = num_index_size - 1;
+    }
+    if (!live_hints_valid)
+	init_live_hints();
+    num = find_live(direction > 0 ? next_live : prev_live, num, direction);
+    if (num < 0 || num >= num_index_size || num > max_msgnum)
+	return NULL;
+    /* return a mere pointer to it! */
+    return num_index[num];
 }
 
 /*
@@ -903,6 +1055,20 @@ bool has_multipart (const struct boundary *multipartp, char *mime_type)
     return res;
 }
 
+/*
+** Arena that addbody() allocates nodes and lines from, or NULL for
+** plain malloc(). Returns the previous one so callers can restore it.
+*/
+
+static struct arena *body_arena;
+
+struct arena *set_body_arena(struct arena *a)
+{
+    struct arena *prev = body_arena;
+    body_arena = a;
+    return prev;
+}
+
 /*
 ** Add a line to a linked list that makes up an article's body.
 */
@@ -937,9 +1103,24 @@ struct body *addbody(struct body *bp, struct body **lp,	/* points to the last po
     }
     
     if (!(flags & BODY_CONTINUE)) {
-	newnode = (struct body *)emalloc(sizeof(struct body));
-	memset(newnode, 0, sizeof(struct body));
-	newnode->line = spamify(strsav(unstuffed_line));
+	if (body_arena) {
+	    newnode = (struct body *)arena_alloc(body_arena,
+						 sizeof(struct body));
+	    memset(newnode, 0, sizeof(struct body));
+	    newnode->inarena = 1;
+	    if (strchr(unstuffed_line, '@')) {
+		char *spamified = spamify(strsav(unstuffed_line));
+		newnode->line = arena_strsav(body_arena, spamified);
+		free(spamified);
+	    }
+	    else
+		newnode->line = arena_strsav(body_arena, unstuffed_line);
+	}
+	else {
+	    newnode = (struct body *)emalloc(sizeof(struct body));
+	    memset(newnode, 0, sizeof(struct body));
+	    newnode->line = spamify(strsav(unstuffed_line));
+	}
 	newnode->html = (flags & BODY_HTMLIZED) ? 1 : 0;
 	newnode->header = (flags & BODY_HEADER) ? 1 : 0;
 	newnode->attached = (flags & BODY_ATTACHED) ? 1 : 0;
@@ -962,7 +1143,14 @@ struct body *addbody(struct body *bp, struct body **lp,	/* points to the last po
 	    newlen = strlen(tempnode->line) + strlen(unstuffed_line) + 1;
 
 	    /* extend the former memory area: */
-	    newbuf = (char *)realloc(tempnode->line, newlen);
+	    if (tempnode->inarena) {
+		newbuf = body_arena ? (char *)arena_alloc(body_arena, newlen)
+		    : NULL;
+		if (newbuf)
+		    strcpy(newbuf, tempnode->line);
+	    }
+	    else
+		newbuf = (char *)realloc(tempnode->line, newlen);
 
 	    /* if successful, continue */
 	    if (newbuf) {
@@ -1021,8 +1209,10 @@ struct body *append_body(struct body *origbp, struct body **origlp, struct body
 			 | (bp->html ? BODY_HTMLIZED : 0)
 			 | (bp->attached ? BODY_ATTACHED : 0));
 	next = bp->next;
-	free(bp->line);
-	free(bp);
+	if (!bp->inarena) {
+	    free(bp->line);
+	    free(bp);
+	}
 	bp = next;
     }
     return origbp;
@@ -1032,9 +1222,11 @@ void free_body(struct body *bp)
 {
     while (bp != NULL) {
 	struct body *cp = bp->next;
-	if (bp->line)
-	    free(bp->line);
-	free(bp);
+	if (!bp->inarena) {
+	    if (bp->line)
+		free(bp->line);
+	    free(bp);
+	}
 	bp = cp;
     }
 }
@@ -1086,140 +1278,267 @@ struct reply *addreply(struct reply *rp, int fromnum, struct emailinfo *email, i
     return rp;
 }
 
-struct reply *addreply2(struct reply *rp, struct emailinfo *from_email, struct emailinfo *email, int maybereply, struct reply **last_node)
-{
 #ifdef FASTREPLYCODE
-    struct reply *tempnode;
-    for (tempnode = rp; tempnode != NULL; tempnode = tempnode->next) {
-	if (tempnode->msgnum == email->msgnum) { /* duplicate? */
-	    if (tempnode->maybereply)
-	        tempnode->maybereply = maybereply;
-	    return rp;		/* don't add 2nd time */
-	}
-    }
-    from_email->replylist = addreply(from_email->replylist, from_email->msgnum, email, maybereply, NULL);
-#endif
-    return addreply(rp, from_email->msgnum, email, maybereply, last_node);
-}
+/*
+** The node of each message in replylist, by message number, so that
+** finding out whether a message is already listed as a reply doesn't
+** take a walk down the whole list. A message is listed at most once.
+*/
+
+static struct reply **reply_by_msgnum;
+static int reply_by_msgnum_size;
 
 /*
-** Mark an article number as having been printed.
+** Find the node of message msgnum in the global replylist.
 */
 
-struct printed *markasprinted(struct printed *pp, int num)
+struct reply *lookup_reply(int msgnum)
 {
-    struct printed *tempnode, *newnode;
-
-    newnode = (struct printed *)emalloc(sizeof(struct printed));
-    newnode->msgnum = num;
-    newnode->next = NULL;
+    struct reply *rp;
 
-    if (pp == NULL)
-	pp = newnode;
-    else {
-		for (tempnode = pp; tempnode->next != NULL; tempnode = tempnode->next);
-	tempnode->next = newnode;
-    }
-    return pp;
+    if (msgnum < 0 || msgnum >= reply_by_msgnum_size)
+	return NULL;
+    rp = reply_by_msgnum[msgnum];
+    return (rp && rp->msgnum == msgnum) ? rp : NULL;
 }
 
 /*
-** Has an article already been printed?
+** File rp under its message number, unless there is a node for that
+** number already. Called for every node added to replylist, and for
+** nodes whose msgnum gets changed.
 */
 
-int wasprinted(struct printed *list, int num)
+void index_reply(struct reply *rp)
 {
-    struct printed *pp;
+    int num = rp->msgnum;
+
+    if (num < 0)
+	return;
+    if (num >= reply_by_msgnum_size) {
+	int newsize = reply_by_msgnum_size ? reply_by_msgnum_size : INDEX_MIN_SIZE;
+	while (newsize <= num)
+	    newsize *= 2;
+	reply_by_msgnum = (struct reply **)erealloc(reply_by_msgnum,
+					newsize * sizeof(struct reply *));
+	memset(reply_by_msgnum + reply_by_msgnum_size, 0,
+	       (newsize - reply_by_msgnum_size) * sizeof(struct reply *));
+	reply_by_msgnum_size = newsize;
+    }
+    if (!lookup_reply(num))
+	reply_by_msgnum[num] = rp;
+}
+#endif
 
-    for (pp = list; pp != NULL; pp = pp->next)
-	if (pp->msgnum == num)
-	    return 1;
-    return 0;
+struct reply *addreply2(struct reply *rp, struct emailinfo *from_email, struct emailinfo *email, int maybereply, struct reply **last_node)
+{
+#ifdef FASTREPLYCODE
+    struct reply *tempnode;
+
+    if (last_node == NULL) {
+	/* a scratch list, not replylist: it isn't in reply_by_msgnum */
+	for (tempnode = rp; tempnode != NULL; tempnode = tempnode->next)
+	    if (tempnode->msgnum == email->msgnum)
+		break;
+    }
+    else if (rp == NULL) {	/* a new list, forget the old one */
+	if (reply_by_msgnum)
+	    memset(reply_by_msgnum, 0,
+		   reply_by_msgnum_size * sizeof(struct reply *));
+	tempnode = NULL;
+    }
+    else
+	tempnode = lookup_reply(email->msgnum);
+    if (tempnode != NULL) {	/* duplicate */
+	if (tempnode->maybereply)
+	    tempnode->maybereply = maybereply;
+	return rp;		/* don't add 2nd time */
+    }
+    from_email->replylist = addreply(from_email->replylist, from_email->msgnum, email, maybereply, NULL);
+    rp = addreply(rp, from_email->msgnum, email, maybereply, last_node);
+    if (last_node != NULL)
+	index_reply(*last_node);
+    return rp;
+#else
+    return addreply(rp, from_email->msgnum, email, maybereply, last_node);
+#endif
 }
 
 /*
-** Add article header information to a binary tree and sort by date,
-** subject, or author. This is necessary for printing the index files.
+** Add article header information to a list sorted by date, subject, or
+** author. This is necessary for printing the index files. The entries
+** are only appended here, with their sort key worked out once; the list
+** gets sorted when header_next() first walks it.
 */
 
-struct header *addheader(struct header *hp, struct emailinfo *email, int sorttype, int depth)
+struct headerlist *addheader(struct headerlist *list, struct emailinfo *email, int sorttype)
 {
-    int isbigger;
+    struct header *hp;
     long yearsecs;
-    static int max_depth, count_d;
-
-    isbigger = 0;
-    if (hp == NULL) {
-	max_depth = depth;
-	hp = (struct header *)emalloc(sizeof(struct header));
-	if (!hp)
-	    return NULL;
-
-	hp->data = email;
+    char *p;
 
-	if (sorttype == 2) {
-	    yearsecs = hp->data->datenum = email->fromdate;
-	    if (set_use_sender_date)
-	        yearsecs = hp->data->datenum = email->date;
-	    if (!firstdatenum || yearsecs < firstdatenum)
-		firstdatenum = yearsecs;
-	    if (yearsecs > lastdatenum)
-		lastdatenum = yearsecs;
-	}
-	else
-	    hp->data->datenum = 0;
-	hp->left = hp->right = NULL;
-	return hp;
+    if (list == NULL) {
+	list = (struct headerlist *)emalloc(sizeof(struct headerlist));
+	memset(list, 0, sizeof(struct headerlist));
+    }
+    if (list->count == list->size) {
+	list->size = list->size ? list->size * 2 : 1024;
+	list->items = (struct header *)erealloc(list->items,
+					list->size * sizeof(struct header));
     }
+    hp = list->items + list->count;
+    hp->data = email;
+    hp->seq = list->count++;
+    hp->key = NULL;
+    hp->datekey = 0;
 
     switch (sorttype) {
     case 1:
-	isbigger = (strcasecmp(email->name, hp->data->name) > 0) ? 0 : 1;
-	break;
     case 0:
-		isbigger = (strcasecmp(email->unre_subject, hp->data->unre_subject) > 0) ? 0 : 1;
+	/* casefolded, so that strcmp() sorts like strcasecmp() */
+	hp->key = strsav(sorttype ? email->name : email->unre_subject);
+	for (p = hp->key; *p; ++p)
+	    *p = tolower((unsigned char)*p);
 	break;
     case 2:
 	yearsecs = email->fromdate;
 	if (set_use_sender_date)
 	    yearsecs = email->date;
-	if (set_reverse)
-	    isbigger = (yearsecs < hp->data->datenum) ? 0 : 1;
-	else
-	    isbigger = (yearsecs >= hp->data->datenum) ? 0 : 1;
+	hp->datekey = email->datenum = yearsecs;
 	if (!firstdatenum || yearsecs < firstdatenum)
 	    firstdatenum = yearsecs;
 	if (yearsecs > lastdatenum)
 	    lastdatenum = yearsecs;
 	break;
     }
+    return list;
+}
 
-    if (isbigger)
-	hp->left = addheader(hp->left, email, sorttype, depth + 1);
-    else
-	hp->right = addheader(hp->right, email, sorttype, depth + 1);
-
-    if (sorttype == 2 && depth < max_depth / 2 && !(++count_d % 3)) {
-	/* semi-random rebalancing */
-	struct header **hpp = (set_reverse ? &hp->left : &hp->right);
-	struct header *hp1 = *hpp;
-	if (hp1 != NULL && (hp1->right != NULL || hp1->left != NULL)) {
-	    if (hp1->right != NULL && (hp1->left == NULL || (count_d & 1))) {
-		struct header *p = hp1->right;
-		hp1->right = p->left;
-		p->left = hp1;
-		*hpp = p;
-	    }
-	    else {
-		struct header *p = hp1->left;
-		hp1->left = p->right;
-		p->right = hp1;
-		*hpp = p;
-	    }
+/*
+** Index order. Equal names and subjects list the message added last
+** first, equal dates the one added first, like the binary trees these
+** lists replace did.
+*/
+
+static int header_cmp(const void *a, const void *b)
+{
+    const struct header *h1 = (const struct header *)a;
+    const struct header *h2 = (const struct header *)b;
+    int cmp;
+
+    if (h1->key) {
+	cmp = strcmp(h1->key, h2->key);
+	if (!cmp)
+	    cmp = (h1->seq < h2->seq) - (h1->seq > h2->seq);
+    }
+    else {
+	cmp = (h1->datekey > h2->datekey) - (h1->datekey < h2->datekey);
+	if (!cmp)
+	    cmp = (h1->seq > h2->seq) - (h1->seq < h2->seq);
+	if (set_reverse)
+	    cmp = -cmp;
+    }
+    return cmp;
+}
+
+/*
+** Bring the entries added since the last walk into order: sort them on
+** their own and merge them with the part that is sorted already.
+*/
+
+static void header_sort(struct headerlist *list)
+{
+    struct header *merged;
+    int i, j, k;
+
+    qsort(list->items + list->sorted, list->count - list->sorted,
+	  sizeof(struct header), header_cmp);
+    if (list->sorted) {
+	merged = (struct header *)emalloc(list->count * sizeof(struct header));
+	i = 0;
+	j = list->sorted;
+	for (k = 0; k < list->count; ++k) {
+	    if (j == list->count
+		|| (i < list->sorted
+		    && header_cmp(list->items + i, list->items + j) < 0))
+		merged[k] = list->items[i++];
+	    else
+		merged[k] = list->items[j++];
 	}
+	free(list->items);
+	list->items = merged;
+	list->size = list->count;
     }
+    list->sorted = list->count;
+}
 
-    return hp;
+/*
+** Walk a list in index order. Start with *pos at 0; each call returns
+** the next entry, or NULL at the end. The entries stay valid until the
+** next addheader() on the list.
+*/
+
+struct header *header_next(struct headerlist *list, int *pos)
+{
+    if (list == NULL || *pos >= list->count)
+	return NULL;
+    if (list->sorted != list->count)
+	header_sort(list);
+    return list->items + (*pos)++;
+}
+
+/*
+** Split a list into nslots lists in one walk, putting each entry into
+** the list slot_of() picks for its message, or into none if it returns
+** -1. The entries keep their order. The lists share one block of
+** entries and get freed with header_split_free().
+*/
+
+struct headerlist *header_split(struct headerlist *list, int nslots,
+				int (*slot_of)(struct emailinfo *, void *),
+				void *arg)
+{
+    struct headerlist *lists;
+    struct header *hp;
+    struct header *items;
+    int *slots;
+    int n = list ? list->count : 0;
+    int pos = 0;
+    int total = 0;
+    int i;
+
+    lists = (struct headerlist *)emalloc(nslots * sizeof(struct headerlist));
+    memset(lists, 0, nslots * sizeof(struct headerlist));
+    slots = (int *)emalloc((n + 1) * sizeof(int));
+    for (i = 0; (hp = header_next(list, &pos)) != NULL; ++i) {
+	slots[i] = slot_of(hp->data, arg);
+	if (slots[i] >= 0) {
+	    lists[slots[i]].size++;
+	    total++;
+	}
+    }
+
+    items = (struct header *)emalloc((total + 1) * sizeof(struct header));
+    for (i = 0, total = 0; i < nslots; ++i) {
+	lists[i].items = items + total;
+	total += lists[i].size;
+    }
+    for (i = 0; i < n; ++i)
+	if (slots[i] >= 0) {
+	    struct headerlist *sub = lists + slots[i];
+	    sub->items[sub->count++] = list->items[i];
+	}
+    for (i = 0; i < nslots; ++i)
+	lists[i].sorted = lists[i].count;
+    free(slots);
+    return lists;
+}
+
+void header_split_free(struct headerlist *lists)
+{
+    if (lists) {
+	free(lists[0].items);
+	free(lists);
+    }
 }
 
 struct emailsubdir *new_subdir(char *subdir, struct emailsubdir *last_subdir, char *description, time_t date)
@@ -1264,6 +1583,8 @@ struct emailsubdir *new_subdir(char *subdir, struct emailsubdir *last_subdir, ch
     new_sd->subdir = strsav(subdir);
     new_sd->description = description;
     new_sd->a_date = date;
+    new_sd->touched = FALSE;
+    new_sd->index = 0;
     if (set_base_url != NULL) {
 		if (set_base_url[strlen(set_base_url) - 1] != '/')
 	    trio_asprintf(&new_sd->rel_path_to_top, "%s/", set_base_url);
@@ -1368,93 +1689,217 @@ int inlist_pos(struct hmlist *listname, char *wildcard)
     return -1;
 }
 
-static int regex_index(struct hmlist *listname, int index)
-{
-	static int start[5] = { -1, -1, -1, -1, -1 };
-    if (start[0] == -1) {
-	struct hmlist *tlist;
-	start[1] = start[0] = 0;
-	for (tlist = set_filter_out; tlist != NULL; tlist = tlist->next)
-	    ++start[1];
-	start[2] = start[1];
-	for (tlist = set_filter_require; tlist != NULL; tlist = tlist->next)
-	    ++start[2];
-	start[3] = start[2];
-	for (tlist = set_filter_out_full_body; tlist != NULL; tlist = tlist->next)
-	    ++start[3];
-	start[4] = start[3];
-	for (tlist = set_filter_require_full_body; tlist != NULL; tlist = tlist->next)
-	    ++start[4];
-    }
-	if (index == -1)
-		return start[4];
-	if (listname == set_filter_out)
-		return start[0] + index;
-	if (listname == set_filter_require)
-		return start[1] + index;
-	if (listname == set_filter_out_full_body)
-		return start[2] + index;
-	if (listname == set_filter_require_full_body)
-		return start[3] + index;
-    return -1;
-}
+#ifdef HAVE_PCRE
 
 /*
-** like inlist_pos, but does regex search
+** A compiled filter list. Patterns without regex metacharacters are
+** kept as plain literals, chained by their first byte, and all of them
+** are looked for in one pass over the line; only the real regexes go
+** through pcre_exec. The hit counters, which count each message once,
+** are shown by filter_report().
 */
 
-int inlist_regex_pos(struct hmlist *listname, char *str)
+struct filterpat {
+    char *val;
+    pcre *re;			/* NULL for a literal pattern */
+    pcre_extra *extra;
+    size_t len;
+    long hits;
+    long counted;		/* filter_message of the last hit counted */
+    int next;			/* next literal with the same first byte */
+};
+
+struct filterset {
+    struct hmlist *list;
+    struct filterpat *pats;
+    int count;
+    int nregex;
+    int bucket[256];		/* first literal for each first byte */
+    char *found;
+    struct filterset *next;
+};
+
+static struct filterset *filtersets;
+static long filter_message;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+#define FILTER_STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+#else
+#define FILTER_STUDY_OPTIONS 0
+#endif
+
+static struct filterset *filterset_get(struct hmlist *listname)
 {
+    struct filterset *fs;
     struct hmlist *tlist;
     int i;
 
+    for (fs = filtersets; fs != NULL; fs = fs->next)
+	if (fs->list == listname)
+	    return fs;
+
+    fs = (struct filterset *)emalloc(sizeof(struct filterset));
+    fs->list = listname;
+    fs->count = fs->nregex = 0;
+    for (tlist = listname; tlist != NULL; tlist = tlist->next)
+	fs->count++;
+    fs->pats = (struct filterpat *)emalloc((fs->count + 1) * sizeof(struct filterpat));
+    fs->found = (char *)emalloc(fs->count + 1);
+    for (i = 0; i < 256; i++)
+	fs->bucket[i] = -1;
+
     for (i = 0, tlist = listname; tlist != NULL; i++, tlist = tlist->next) {
-#ifdef HAVE_PCRE
-	int r;
-	const char *errptr;
-	int epos;
-	int index = regex_index(listname, i);
-	static pcre *p, **pcre_list;
-	static pcre_extra *extra, **extra_list;
-	if (!pcre_list) {
-	    int n = regex_index(NULL, -1);
-	    int i;
-			pcre_list = (pcre **) emalloc(n * sizeof(pcre *));
-			extra_list = (pcre_extra **) emalloc(n * sizeof(pcre_extra *));
-	    for (i = 0; i < n; ++i) {
-	        pcre_list[i] = NULL;
-	        extra_list[i] = NULL;
-	    }
+	struct filterpat *fp = &fs->pats[i];
+	fp->val = tlist->val;
+	fp->len = strlen(tlist->val);
+	fp->re = NULL;
+	fp->extra = NULL;
+	fp->hits = 0;
+	fp->counted = -1;
+	fp->next = -1;
+	if (fp->len && !strpbrk(fp->val, "\\^$.[|()?*+{")) {
+	    unsigned char c = (unsigned char)fp->val[0];
+	    fp->next = fs->bucket[c];
+	    fs->bucket[c] = i;
 	}
-	if ((p = pcre_list[index]) == NULL) {
-	    p = pcre_compile(tlist->val, 0, &errptr, &epos, NULL);
-	    if (!p) {
-		snprintf(errmsg, sizeof(errmsg), "Error at position %d of regular expression '%s': %s", epos, tlist->val, errptr);
+	else {
+	    const char *errptr;
+	    int epos;
+	    fp->re = pcre_compile(fp->val, 0, &errptr, &epos, NULL);
+	    if (!fp->re) {
+		snprintf(errmsg, sizeof(errmsg), "Error at position %d of regular expression '%s': %s", epos, fp->val, errptr);
 		progerr(errmsg);
 	    }
-	    extra = pcre_study(p, 0, &errptr);
+	    fp->extra = pcre_study(fp->re, FILTER_STUDY_OPTIONS, &errptr);
 	    if (errptr) {
-		snprintf(errmsg, sizeof(errmsg), "Error studying regular expression '%s': %s", tlist->val, errptr);
+		snprintf(errmsg, sizeof(errmsg), "Error studying regular expression '%s': %s", fp->val, errptr);
 		progerr(errmsg);
 	    }
-	    pcre_list[index] = p;
-	    extra_list[index] = extra;
+	    fs->nregex++;
 	}
-	extra = extra_list[index];
-	r = pcre_exec(p, extra, str, strlen(str), 0, 0, NULL, 0);
-	
-	if (r >= 0)
-	    return i;
+    }
+    fs->next = filtersets;
+    filtersets = fs;
+    return fs;
+}
+
+/*
+** Tell the hit counters that the lines matched from now on belong to
+** the next message.
+*/
+
+void filter_next_message(void)
+{
+    filter_message++;
+}
+
+/*
+** Print how many messages each filter pattern matched, so that rules
+** which never fire can be spotted.
+*/
+
+void filter_report(void)
+{
+    static struct {
+	struct hmlist **list;
+	const char *name;
+    } names[] = {
+	{ &set_filter_out, "filter_out" },
+	{ &set_filter_require, "filter_require" },
+	{ &set_filter_out_full_body, "filter_out_full_body" },
+	{ &set_filter_require_full_body, "filter_require_full_body" },
+    };
+    struct filterset *fs;
+    int i, j;
+
+    for (j = 0; j < (int)(sizeof(names) / sizeof(names[0])); j++) {
+	for (fs = filtersets; fs != NULL; fs = fs->next)
+	    if (fs->list == *names[j].list)
+		break;
+	if (fs == NULL)
+	    continue;
+	for (i = 0; i < fs->count; i++)
+	    printf("%s: %ld messages matched '%s'%s\n", names[j].name,
+		   fs->pats[i].hits, fs->pats[i].val,
+		   fs->pats[i].re ? "" : " (literal)");
+    }
+}
+
 #else
-	static int warned = 0;
-	if (set_showprogress && !warned) {
-	    warned = 1;
-	    printf("warning - regex not available\n");
+
+void filter_next_message(void)
+{
+}
+
+void filter_report(void)
+{
+}
+
+#endif
+
+/*
+** like inlist_pos, but does regex search
+*/
+
+int inlist_regex_pos(struct hmlist *listname, char *str)
+{
+#ifdef HAVE_PCRE
+    struct filterset *fs;
+    struct filterpat *fp;
+    const unsigned char *s;
+    int nfound = 0;
+    int len = -1;
+    int i, j;
+
+    if (listname == NULL)
+	return -1;
+    fs = filterset_get(listname);
+
+    if (fs->nregex < fs->count) {
+	memset(fs->found, 0, fs->count);
+	for (s = (const unsigned char *)str; *s; s++) {
+	    for (j = fs->bucket[*s]; j != -1; j = fs->pats[j].next) {
+		fp = &fs->pats[j];
+		if (!fs->found[j] && !strncmp((const char *)s, fp->val, fp->len)) {
+		    fs->found[j] = 1;
+		    nfound++;
+		}
+	    }
+	}
+	if (!nfound && !fs->nregex)
+	    return -1;
+    }
+
+    for (i = 0; i < fs->count; i++) {
+	fp = &fs->pats[i];
+	if (fp->re) {
+	    if (len == -1)
+		len = strlen(str);
+	    if (pcre_exec(fp->re, fp->extra, str, len, 0, 0, NULL, 0) < 0)
+		continue;
+	}
+	else if (!fs->found[i])
+	    continue;
+	if (fp->counted != filter_message) {
+	    fp->counted = filter_message;
+	    fp->hits++;
 	}
+	return i;
+    }
+#else
+    struct hmlist *tlist;
+    int i;
+    static int warned = 0;
+
+    if (set_showprogress && !warned) {
+	warned = 1;
+	printf("warning - regex not available\n");
+    }
+    for (i = 0, tlist = listname; tlist != NULL; i++, tlist = tlist->next) {
 	if (strstr(tlist->val, str))
 	    return i;
-#endif
     }
+#endif
     return -1;
 }
 
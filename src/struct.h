@@ -2,7 +2,7 @@
 ** struct.c functions
 */
 
-unsigned hash(char *);
+unsigned hash(const char *);
 void reinit_structs(void);
 void fill_email_dates(struct emailinfo *, char *, char *, char *, char *);
 
@@ -21,6 +21,7 @@ int insert_older_msgs(int);
 struct body *hashnumlookup(int, struct emailinfo **);
 struct emailinfo *neighborlookup(int, int);
 
+struct arena *set_body_arena(struct arena *);
 struct body *addbody(struct body *, struct body **, char *, int);
 struct body *append_body(struct body *, struct body **, struct body *);
 void free_body(struct body *);
@@ -29,14 +30,19 @@ struct reply *addreply(struct reply *, int, struct emailinfo *, int,
 		       struct reply **);
 struct reply *addreply2(struct reply *, struct emailinfo *, struct emailinfo *,
 			int, struct reply **);
+#ifdef FASTREPLYCODE
+struct reply *lookup_reply(int);
+void index_reply(struct reply *);
+#endif
 int rmlastlines(struct body *);
 
 struct emailsubdir *new_subdir(char *, struct emailsubdir *, char *, time_t);
 
-struct printed *markasprinted(struct printed *, int);
-int wasprinted(struct printed *, int);
-
-struct header *addheader(struct header *, struct emailinfo *, int, int);
+struct headerlist *addheader(struct headerlist *, struct emailinfo *, int);
+struct header *header_next(struct headerlist *, int *);
+struct headerlist *header_split(struct headerlist *, int,
+				int (*)(struct emailinfo *, void *), void *);
+void header_split_free(struct headerlist *);
 struct boundary *bound(struct boundary *, char *);
 int free_bound(struct boundary *);
 struct boundary *multipart(struct boundary *, char *);
@@ -50,5 +56,7 @@ void print_list(char *, struct hmlist *);
 int inlist(struct hmlist *, char *);
 int inlist_pos(struct hmlist *, char *);
 int inlist_regex_pos(struct hmlist *, char *);
+void filter_next_message(void);
+void filter_report(void);
 struct hmlist *add_2_list(struct hmlist *, char *);
 struct hmlist *add_list(struct hmlist *, char *);
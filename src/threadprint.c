@@ -21,6 +21,20 @@ static void finish_thread_file(FILE *, struct emailinfo *, char *);
 static int num_open_li[MAXSTACK + 1];
 
 
+/*
+** TRUE if the thread starting at rp has a message that gets listed in
+** the given period.
+*/
+
+static bool thread_in_period(struct reply *rp, int year, int month)
+{
+    for (; rp != NULL && rp->msgnum != -1; rp = rp->next)
+	if (in_period(rp->data, year, month)
+	    && !rp->data->is_deleted)
+	    return TRUE;
+    return FALSE;
+}
+
 /*
 ** If year and/or month are != -1, only messages within the specified time
 ** period will be printed.
@@ -47,6 +61,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
     char *filenameb = NULL;
     int threadnum = 0;
     bool is_first = TRUE;
+    bool new_thread = TRUE;
 
     struct reply *rp = threadlist;
     last_email = rp->data;
@@ -69,6 +84,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 				     thread_file_depth, email, last_email,
 				     filenameb, fp_body);
 	    filenameb = NULL;
+	    new_thread = TRUE;
 	    rp = rp->next;
 	    continue;
 	}
@@ -76,6 +92,18 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	    rp = rp->next;
 	    continue;
 	}
+	else if (new_thread && (year != -1 || month != -1)
+		 && !thread_in_period(rp, year, month)) {
+	    /* nothing of this thread is listed, don't open its levels */
+	    while (rp->next != NULL && rp->next->msgnum != -1)
+		rp = rp->next;
+	    prev = rp->msgnum;
+	    hide_level = (rp->data->is_deleted && rp->frommsgnum != rp->msgnum);
+	    last_email = rp->data;
+	    rp = rp->next;
+	    continue;
+	}
+	new_thread = FALSE;
 
 #if DEBUG_THREAD
 	fprintf(stderr, "print_all_threads: %d: %s\n", rp->msgnum,
@@ -104,7 +132,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	    if (!set_indextable) {
 	      if (level < set_thrdlevels) {
 		if (level > thread_file_depth) {
-		    fprintf(fp, "<ul>\n");
+		    hm_fprintf(fp, "<ul>\n");
 		}
 		else if (level < MAXSTACK) {
 		    char *filename;
@@ -113,10 +141,8 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 				  "%u%s", reply_list_count,
 				  index_name[subdir != NULL][THREAD_INDEX]);
 		    filename = htmlfilename(filename_stack[level], email, "");
-                    /* AUDIT biege: What about using remove() to handle direc.c too? */
-		    unlink(filename);	/* so chmod won't fail if someone else owned it */
 		    fp_stack[level - 1] = fp;
-		    if ((fp = fopen(filename, "w")) == NULL) {
+		    if ((fp = page_fopen(filename)) == NULL) {
                         snprintf(errmsg,sizeof(errmsg),"Couldn't write \"%s\".",
 				 filename);
 			progerr(errmsg);
@@ -125,7 +151,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 		    subject_stack[level] = strsav(subject);
 		    print_index_header(fp, set_label, set_dir,
 				       subject, filename);
-		    fprintf(fp, "<ul>\n");
+		    hm_fprintf(fp, "<ul>\n");
 		    free(filename);
 		    ++reply_list_count;
 		}
@@ -133,7 +159,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	      else {
 		/* if we go over the thread limit, we just close the last open li */
 		if (!set_indextable && num_open_li[level - 1] != 0) {
-		  fprintf (fp, "</li>\n");
+		  hm_fprintf (fp, "</li>\n");
 		  num_open_li[level - 1]--;
 		}
 	      }
@@ -155,7 +181,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	    if (newlevel == level) {
 	      /* same level, close the previous item */
 	      if (!set_indextable && num_open_li[level] != 0) {
-		fprintf (fp, "</li>\n");
+		hm_fprintf (fp, "</li>\n");
 		num_open_li[level]--;
 	      }
 	    }
@@ -176,7 +202,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 		if (!set_indextable) {
 		    while (level < newlevel) {
 			if (level < set_thrdlevels) {
-			    fprintf(fp, "<li><ul>\n");
+			    hm_fprintf(fp, "<li><ul>\n");
 			    ++num_open_li[level];
 			}
 			level++;
@@ -203,7 +229,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	    }
 	    sprintf(thread_id, "thread_body%d", ++threadnum);
 	    filenameb = htmlfilename(thread_id, email, set_htmlsuffix);
-	    if ((fp_body = fopen(filenameb, "w")) == NULL) {
+	    if ((fp_body = page_fopen(filenameb)) == NULL) {
                  snprintf(errmsg, sizeof(errmsg), "Couldn't write \"%s\".", 
                           filenameb);
 		progerr(errmsg);
@@ -213,8 +239,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
 	    fprint_menu0(fp_body, rp->data, PAGE_TOP);
 	}
 	/* Now print this mail */
-	if ((year == -1 || year_of_datenum(rp->data->date) == year)
-	    && (month == -1 || month_of_datenum(rp->data->date) == month)
+	if (in_period(rp->data, year, month)
 	    && !rp->data->is_deleted) {
 	    format_thread_info(fp, rp->data, level, num_replies,
 			       email, fp_body, threadnum, is_first);
@@ -229,7 +254,7 @@ void print_all_threads(FILE *fp, int year, int month, struct emailinfo *email)
     }
 
     if (!set_indextable && num_open_li[0] != 0)
-      fprintf (fp, "</li>\n");
+      hm_fprintf (fp, "</li>\n");
 
     if (set_files_by_thread && filenameb && last_email) {
 	finish_thread_file(fp_body, last_email, filenameb);
@@ -258,10 +283,10 @@ static void format_thread_info(FILE *fp, struct emailinfo *email,
     if (set_files_by_thread) {
 	int maybe_reply = 0;
 	int is_reply = 1;
-	fprintf(fp_body, "<a name =\"%.4d\" id=\"%.4d\"></a>", email->msgnum, email->msgnum);
+	hm_fprintf(fp_body, "<a name =\"%.4d\" id=\"%.4d\"></a>", email->msgnum, email->msgnum);
 	print_headers(fp_body, email, TRUE);
 	if ((set_show_msg_links && set_show_msg_links != 4) || !set_usetable) {
-	    fprintf(fp_body, "</ul>\n");
+	    hm_fprintf(fp_body, "</ul>\n");
 	}
 	/* maybe_reply only affects code in finelink.c which we don't want to run twice? */
 	printbody(fp_body, email, maybe_reply, is_reply);
@@ -277,7 +302,7 @@ static void format_thread_info(FILE *fp, struct emailinfo *email,
 
     /* Print the thread info */
     if (set_indextable) {
-	fprintf(fp,
+	hm_fprintf(fp,
 		"<tr><td>%s<a href=\"%s\"%s><strong>%s</strong></a></td>"
 		"<td nowrap><a name=\"%s%d\" id=\"%s%d\">%s</a></td>" "<td nowrap>%s</td></tr>\n",
 		level > 1 ? "--&gt; " : "", 
@@ -286,10 +311,10 @@ static void format_thread_info(FILE *fp, struct emailinfo *email,
     }
     else {
         if (num_open_li[level] != 0) {
-	  fprintf (fp, "</li>\n");
+	  hm_fprintf (fp, "</li>\n");
 	  num_open_li[level]--;
 	}
-	fprintf(fp, "<li><a href=\"%s\"%s>%s</a>&nbsp;"
+	hm_fprintf(fp, "<li><a href=\"%s\"%s>%s</a>&nbsp;"
 		"<a name=\"%s%d\" id=\"%s%d\"><em>%s</em></a>&nbsp;<em>(%s)</em>\n", 
 		href, first_attributes, 
 		subj, set_fragment_prefix, email->msgnum, set_fragment_prefix, email->msgnum, tmpname, getindexdatestr(email->date));
@@ -301,7 +326,6 @@ static void format_thread_info(FILE *fp, struct emailinfo *email,
     ++num_replies[level];
     if (!set_indextable)
       ++num_open_li[level];
-    email->flags |= PRINT_THREAD;	/* its written now */
 }
 
 int isreplyto(int msgnum, int parent)
@@ -326,12 +350,7 @@ finish_thread_file(FILE *fp_body, struct emailinfo *email, char *filenameb)
 	fprint_menu0(fp_body, email, PAGE_BOTTOM);
 	printfooter(fp_body, mhtmlfooterfile, set_label, set_dir,
 		    email->subject, filenameb, TRUE);
-	fclose(fp_body);
-	if (chmod(filenameb, set_filemode) == -1) {
-            snprintf(errmsg, sizeof(errmsg), "Couldn't chmod \"%s\" to %o.", 
-                     filenameb, set_filemode);
-	    progerr(errmsg);
-	}
+	page_fclose(fp_body, filenameb);
 	free(filenameb);
 }
 
@@ -353,39 +372,33 @@ static int finish_thread_levels(FILE **fp, int level, int newlevel,
 	    if (level < set_thrdlevels) {
 		if (level > thread_file_depth) {
 		    if (num_open_li[level] != 0) {
-		      fprintf(*fp, "</li>");
+		      hm_fprintf(*fp, "</li>");
 		      num_open_li[level]--;
 		    }
-		    fprintf(*fp, "</ul>\n");
+		    hm_fprintf(*fp, "</ul>\n");
 
 		    if (num_open_li[level] != 0) {
-		      fprintf(*fp, "</li>");
+		      hm_fprintf(*fp, "</li>");
 		      num_open_li[level]--;
 		    }
 		}
 		else if (level < MAXSTACK) {
 		    char *filename = htmlfilename(filename_stack[level],
 						  subdir_email, "");
-		    fprintf(*fp, "</li></ul>\n");
+		    hm_fprintf(*fp, "</li></ul>\n");
 		    if (num_open_li[level] != 0) {
-		      fprintf(*fp, "</li>");
+		      hm_fprintf(*fp, "</li>");
 		      num_open_li[level]--;
 		    }
-		    fprintf (*fp, "</ul>");
+		    hm_fprintf (*fp, "</ul>");
 		    printfooter(*fp, ihtmlfooterfile, set_label, set_dir,
 				subject_stack[level], filename, TRUE);
-		    fclose(*fp);
+		    page_fclose(*fp, filename);
 		    *fp = fp_stack[level - 1];
 		    if (num_replies[level]) {
-			fprintf(*fp,
+			hm_fprintf(*fp,
 				"<ul><li><a href=\"%s\">%u replies</a></ul>\n",
 				filename_stack[level], num_replies[level]);
-			if (chmod(filename, set_filemode) == -1) {
-                            snprintf(errmsg, sizeof(errmsg), 
-                                     "Couldn't chmod \"%s\" to %o.", 
-                                     filename, set_filemode);
-			    progerr(errmsg);
-			}
 			num_open_li[level]++;
 		    }
 		    else
@@ -396,7 +409,7 @@ static int finish_thread_levels(FILE **fp, int level, int newlevel,
 	    }
 	    else {
 	      if (num_open_li[level] != 0) {
-		fprintf(*fp, "</li>");
+		hm_fprintf(*fp, "</li>");
 		num_open_li[level]--;
 	      }	      
 	    }
@@ -245,11 +245,11 @@ static int startlist(FILE *fp, const char *number, const char *prefix, const cha
 	/* It doesn't start with 1,a,A.  Let's not screw with it. */
 	if ((*number != '1') && (*number != 'a') && (*number != 'A'))
 	    return 0;
-	fprintf(fp, "\n%s<ol>\n", list_indent);
+	hm_fprintf(fp, "\n%s<ol>\n", list_indent);
 	list[listnum] = OL;
     }
     else {
-	fprintf(fp, "\n%s<ul>\n", list_indent);
+	hm_fprintf(fp, "\n%s<ul>\n", list_indent);
 	list[listnum] = UL;
     }
 
@@ -264,10 +264,10 @@ static void endlist(FILE *fp, int n)
     for (; n > 0; n--, listnum--) {
 	set_list_indent(listnum - 1);
 	if (list[listnum - 1] == UL) {
-	    fprintf(fp, "\n%s</ul>\n", list_indent);
+	    hm_fprintf(fp, "\n%s</ul>\n", list_indent);
 	}
 	else if (list[listnum - 1] == OL) {
-	    fprintf(fp, "\n%s</ol>\n", list_indent);
+	    hm_fprintf(fp, "\n%s</ol>\n", list_indent);
 	}
 	else {
             snprintf(errmsg, sizeof(errmsg),
@@ -291,7 +291,7 @@ static char *continuelist(FILE *fp, char *line)
 			++p;
 	while (*p && isspace(*p))
 	    ++p;
-	fprintf(fp, "%s<li> ", list_indent);
+	hm_fprintf(fp, "%s<li> ", list_indent);
 	return --p;
     }
     if (list[listnum - 1] == OL) {
@@ -309,7 +309,7 @@ static char *continuelist(FILE *fp, char *line)
 	++p;
 	while (*p && isspace(*p))
 	    ++p;
-	fprintf(fp, "%s<li> ", list_indent);
+	hm_fprintf(fp, "%s<li> ", list_indent);
 	return --p;
     }
     return line;
@@ -524,10 +524,10 @@ void txt2html(FILE *fp, struct emailinfo *email, const struct body *bp, bool rep
 	     && !has_many_carets(line) && !has_many_carets(next_line)
 		 && (endpreformat_trigger_lines == 1 || !is_preformatted(next_line))) {
 	in_pre_block = 0;
-	fprintf(fp, "</pre>\n");
+	hm_fprintf(fp, "</pre>\n");
     }
     if (!in_pre_block && convert_to_hrule(line)) {
-	fprintf(fp, "<hr>\n");
+	hm_fprintf(fp, "<hr>\n");
 	line[0] = 0;
 	was_hrule = 1;
     }
@@ -543,7 +543,7 @@ void txt2html(FILE *fp, struct emailinfo *email, const struct body *bp, bool rep
     }
 
 	if (!in_pre_block && !islist && endpreformat_trigger_lines != 0 && !isquote(line) && !was_hrule && (preformat_trigger_lines == 0 || is_sig_start(line) || find_repetition(bp) || has_many_carets(line) || has_many_carets(next_line) || (is_preformatted(line) && (preformat_trigger_lines == 1 || is_preformatted(next_line))))) {
-	fprintf(fp, "<pre>\n");
+	hm_fprintf(fp, "<pre>\n");
 	in_pre_block = find_repetition(bp);	/* set #lines from find_vertical_repeats */
 	if (!in_pre_block)
 	    in_pre_block = 1;
@@ -551,12 +551,12 @@ void txt2html(FILE *fp, struct emailinfo *email, const struct body *bp, bool rep
 	    insig = 1;
     }
 	if (!is_blank_line && !in_pre_block && !was_break && !was_caps && !was_hrule && !was_par && !islist && (is_blank_prev || (line_indent > prev_indent + par_indent))) {
-	fprintf(fp, "<p>\n");
+	hm_fprintf(fp, "<p>\n");
 	was_par = 1;
     }
 
 	if (!islist && !in_pre_block && !is_blank_line && !inquote && !is_blank_prev && prev_line_length < short_line_length && !was_hrule && !was_par && !islist && !was_break) {
-	fprintf(fp, "<br>\n");
+	hm_fprintf(fp, "<br>\n");
 	was_break = 1;
     }
 
@@ -569,17 +569,17 @@ void txt2html(FILE *fp, struct emailinfo *email, const struct body *bp, bool rep
     }
 
     if ((is_caps_line = (!in_pre_block && iscaps(line))) != 0)
-	fprintf(fp, "<%s>", caps_tag);
+	hm_fprintf(fp, "<%s>", caps_tag);
 
     if (isquote(line)) {
 	if (!was_quote_prefix && !was_break && !was_par && !was_hrule) {
-	    fprintf(fp, "<br>\n");
+	    hm_fprintf(fp, "<br>\n");
 	    was_break = 1;
 	}
 	if (!set_linkquotes) {
-	    fprintf(fp, "<i class=\"%s\">", find_quote_class(line));
+	    hm_fprintf(fp, "<i class=\"%s\">", find_quote_class(line));
 	    ConvURLs(fp, chomp(line), email->msgid, email->subject, email->charset);
-	    fprintf(fp, "</i><br>\n");
+	    hm_fprintf(fp, "</i><br>\n");
 	}
 		else if (handle_quoted_text(fp, email, bp, line, inquote, quote_num, replace_quoted, maybe_reply)) {
 	    ++quote_num;
@@ -596,10 +596,10 @@ void txt2html(FILE *fp, struct emailinfo *email, const struct body *bp, bool rep
 	else
 	    sp = print_leading_whitespace(fp, line);
 	ConvURLs(fp, chomp(sp), email->msgid, email->subject, email->charset);
-	fprintf(fp, "\n");
+	hm_fprintf(fp, "\n");
     }
     if (is_caps_line)
-	fprintf(fp, "</%s>\n", caps_tag);
+	hm_fprintf(fp, "</%s>\n", caps_tag);
     is_blank_prev = is_blank_line;
     if (!isquote(line))
 	inquote = was_quote_prefix = 0;
@@ -646,7 +646,7 @@ void end_txt2html(FILE *fp)
     if (islist)
 	endlist(fp, listnum);	/* End all lists */
     if (in_pre_block)
-	fprintf(fp, "</pre>\n");
+	hm_fprintf(fp, "</pre>\n");
     if (unhyphenated_word) {
 	free(unhyphenated_word);
 	unhyphenated_word = NULL;
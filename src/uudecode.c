@@ -34,6 +34,7 @@
 
 #include "hypermail.h"
 #include "setup.h"
+#include "mboxread.h"
 #include "uudecode.h"
 
 #ifdef HAVE_SYS_PARAM_H
@@ -56,7 +57,7 @@
 ** uudecode returns non-zero on error 
 */
 
-int uudecode(FILE *input,	/* get file data from (if needed) */
+int uudecode(struct mbox_reader *input,	/* get file data from (if needed) */
 	     char *iptr,	/* input string from where we are right now */
 	     char *output,	/* write result to, must be at least 80 bytes */
 	     int *length,	/* output size */
@@ -67,6 +68,8 @@ int uudecode(FILE *input,	/* get file data from (if needed) */
     int mode;
     char buf[MAXPATHLEN] = { 0 };
     char scanfstring[MAXPATHLEN] = { 0 };
+    char *line = NULL;
+    size_t linesize = 0;
     int outlen = 0;
 
     if (length)
@@ -77,15 +80,19 @@ int uudecode(FILE *input,	/* get file data from (if needed) */
 	/* AUDIT biege: BOF in buf! */
 	sprintf(scanfstring, "begin %%o %%%us", sizeof(buf) - 1);
 	while (2 != sscanf(iptr, scanfstring, &mode, buf)) {
-	    if (!fgets(buf, MAXPATHLEN, input)) {
+	    if (!mbox_getline(input, &line, &linesize, NULL)) {
+		if (line)
+		    free(line);
 		return 2;
 	    }
-	    PushString(init, buf);
-	    iptr = buf + set_ietf_mbox;
+	    PushString(init, line);
+	    iptr = line + set_ietf_mbox;
 	}
 #if 0
 	fprintf(stderr, "FIRST %s", iptr);
 #endif
+	if (line)
+	    free(line);
 	/* ignore file mode    */
 	/* ignore file name too for now */
     }
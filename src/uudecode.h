@@ -2,4 +2,4 @@
 ** uudecode.c function 
 */
 
-int uudecode(FILE *, char *, char *, int *, struct Push *);
+int uudecode(struct mbox_reader *, char *, char *, int *, struct Push *);
@@ -0,0 +1,111 @@
+#!/usr/bin/perl
+
+# benchhm
+#
+# Time a full archive rebuild on a generated mailbox. Intended to
+# compare the speed of two hypermail builds, e.g.
+#
+#   benchhm.pl -n 100000 ../src/hypermail /usr/local/bin/hypermail
+#
+# The generated messages are threaded and a share of them carries an
+# X-Hypermail-Deleted: header, in runs, so that the message number
+# lookups and the next/previous link search get exercised.
+
+use strict;
+use warnings;
+
+use Getopt::Std;
+use Time::HiRes qw( gettimeofday tv_interval );
+use POSIX qw( strftime );
+
+our ($opt_n, $opt_d, $opt_r, $opt_k, $opt_h);
+
+sub usage {
+    print <<"EOF";
+Usage: $0 [-n messages] [-d percent] [-r runs] [-k] [hypermail ...]
+  -n messages : number of messages to generate (default 20000)
+  -d percent  : percentage of deleted messages (default 20)
+  -r runs     : runs per binary, the best one is reported (default 3)
+  -k          : keep the generated mailbox and archive
+The default binary is ../src/hypermail.
+EOF
+    exit 1;
+}
+
+getopts('n:d:r:kh') || usage();
+usage() if $opt_h;
+
+my $count = $opt_n || 20000;
+my $deleted = defined $opt_d ? $opt_d : 20;
+my $runs = $opt_r || 3;
+my @binaries = @ARGV ? @ARGV : ("../src/hypermail");
+
+my $mbox = "benchmail";
+my $dir = "benchdir";
+
+sub write_mbox {
+    my @words = qw(archive thread reply index subject message patch
+		   build release mailbox header folder date author);
+    my @ids;
+    my $time = 1104537600;
+    my $delete_run = 0;
+
+    srand(1);
+    open(my $fh, ">", $mbox) || die "can't write $mbox: $!";
+    for my $i (0 .. $count - 1) {
+	my $id = "<bench.$i\@hypermail.example>";
+	my $subject = join(" ", map { $words[rand @words] } 1 .. 4);
+	my $parent;
+
+	if (@ids && rand() < 0.6) {
+	    $parent = $ids[-1 - int(rand(@ids < 50 ? @ids : 50))];
+	    $subject = "Re: $parent->[1]";
+	}
+	push(@ids, [ $id, $subject =~ s/^(Re: )+//r ]);
+	$time += 600 + int(rand(3600));
+
+	if (!$delete_run && rand(100) < $deleted / 10) {
+	    $delete_run = 1 + int(rand(20));
+	}
+
+	print $fh "From bench\@hypermail.example ",
+	    strftime("%a %b %e %H:%M:%S %Y", gmtime($time)), "\n";
+	print $fh "From: Bench ", $i % 97, " <bench", $i % 97, "\@hypermail.example>\n";
+	print $fh "Date: ", strftime("%a, %d %b %Y %H:%M:%S +0000", gmtime($time)), "\n";
+	print $fh "Subject: $subject\n";
+	print $fh "Message-ID: $id\n";
+	print $fh "In-Reply-To: $parent->[0]\n" if $parent;
+	if ($delete_run) {
+	    print $fh "X-Hypermail-Deleted: yes\n";
+	    $delete_run--;
+	}
+	print $fh "\n";
+	for (1 .. 5 + int(rand(20))) {
+	    print $fh join(" ", map { $words[rand @words] } 1 .. 10), "\n";
+	}
+	print $fh "\n";
+    }
+    close($fh);
+}
+
+write_mbox();
+printf "%d messages, about %d%% deleted, best of %d runs\n",
+    $count, $deleted, $runs;
+
+for my $hypermail (@binaries) {
+    my $best;
+    for (1 .. $runs) {
+	system("rm", "-rf", $dir);
+	my $start = [gettimeofday];
+	system("$hypermail -c /dev/null -m $mbox -d $dir -l bench > /dev/null 2>&1") == 0
+	    || die "$hypermail failed\n";
+	my $elapsed = tv_interval($start);
+	$best = $elapsed if !defined $best || $elapsed < $best;
+    }
+    printf "%-40s %8.2f s\n", $hypermail, $best;
+}
+
+if (!$opt_k) {
+    system("rm", "-rf", $dir);
+    unlink($mbox);
+}